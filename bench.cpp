@@ -0,0 +1,1272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include "concurrent_radix_tree.h"
+#include "radix_thread.h"
+#include "radix_frozen.h"
+#include "radix_lpm.h"
+#include "radix_tree.hpp"
+#include "string_map.h"
+
+#define BENCH_KEYS      200000
+#define BENCH_THREADS   32
+#define BENCH_LOOKUPS   2000000
+#define BENCH_BATCH     64
+#define BENCH_ROUTES    100000
+#define BENCH_SUITE     100000
+#define BENCH_ZIPF      0.99
+#define BENCH_DELTA     10000
+
+struct bench_writer
+{
+    concurrent_radix_tree_t *tree;
+    int first;
+    int last;
+};
+
+static void bench_key(char *key, int i)
+{
+    // spread neighbouring ids over different subtrees the way hashed
+    // ingest keys would be
+    sprintf(key, "/ingest/%08x/%d", (unsigned int)(i * 2654435761u), i);
+}
+
+static void *bench_ingest(void *arg)
+{
+    struct bench_writer *w = (struct bench_writer *)arg;
+    char key[48];
+    void *value;
+    int i;
+
+    for (i = w->first; i < w->last; i++)
+    {
+        bench_key(key, i);
+        concurrent_radix_tree_insert(w->tree, (unsigned char *)key, strlen(key), (void *)(size_t)(i + 1));
+    }
+    for (i = w->first; i < w->last; i += 2)
+    {
+        bench_key(key, i);
+        concurrent_radix_tree_remove(w->tree, (unsigned char *)key, strlen(key), &value);
+    }
+    return NULL;
+}
+
+static double bench_run(int fine_grained, int threads)
+{
+    struct bench_writer w[BENCH_THREADS];
+    radix_thread_t handles[BENCH_THREADS];
+    concurrent_radix_tree_t *tree;
+    std::chrono::steady_clock::time_point start;
+    double seconds;
+    int per;
+    int i;
+
+    tree = fine_grained ? concurrent_radix_tree_create_olc(NULL, NULL) : concurrent_radix_tree_create(NULL, NULL);
+    per = BENCH_KEYS / threads;
+
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < threads; i++)
+    {
+        w[i].tree = tree;
+        w[i].first = i * per;
+        w[i].last = i + 1 == threads ? BENCH_KEYS : (i + 1) * per;
+        radix_thread_create(&handles[i], bench_ingest, &w[i]);
+    }
+    for (i = 0; i < threads; i++)
+    {
+        radix_thread_join(handles[i]);
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    concurrent_radix_tree_destroy(tree);
+    return seconds;
+}
+
+static void bench_scaling(int max_threads)
+{
+    int threads;
+    double locked;
+    double olc;
+    double ops;
+
+    ops = BENCH_KEYS * 1.5;
+    printf("%8s %16s %16s\n", "threads", "write lock Mops", "olc Mops");
+    for (threads = 1; threads <= max_threads; threads *= 2)
+    {
+        locked = bench_run(0, threads);
+        olc = bench_run(1, threads);
+        printf("%8d %16.2f %16.2f\n", threads, ops / locked / 1e6, ops / olc / 1e6);
+    }
+}
+
+/* one lookup at a time against batches of BENCH_BATCH, on a tree that
+   is well beyond the last level cache */
+static void bench_lookup()
+{
+    radix_tree_t *tree;
+    char *keys;
+    const unsigned char *batch[BENCH_BATCH];
+    int lens[BENCH_BATCH];
+    void *values[BENCH_BATCH];
+    std::chrono::steady_clock::time_point start;
+    radix_frozen_t *frozen;
+    double single;
+    double batched;
+    double frozen_single;
+    size_t found;
+    int i;
+    int j;
+
+    tree = radix_tree_create(0, NULL, NULL);
+    keys = (char *)malloc((size_t)BENCH_LOOKUPS * 48);
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        bench_key(keys + (size_t)i * 48, i);
+        radix_tree_insert(tree, (unsigned char *)keys + (size_t)i * 48, strlen(keys + (size_t)i * 48), (void *)(size_t)(i + 1));
+    }
+
+    found = 0;
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        j = (int)((i * 40503u) % BENCH_LOOKUPS);
+        found += radix_tree_exact_match(tree, (unsigned char *)keys + (size_t)j * 48, strlen(keys + (size_t)j * 48)) != NULL;
+    }
+    single = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i + BENCH_BATCH <= BENCH_LOOKUPS; i += BENCH_BATCH)
+    {
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            batch[j] = (unsigned char *)keys + (size_t)(((i + j) * 40503u) % BENCH_LOOKUPS) * 48;
+            lens[j] = strlen((const char *)batch[j]);
+        }
+        radix_tree_exact_match_batch(tree, batch, lens, BENCH_BATCH, values);
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            found += values[j] != NULL;
+        }
+    }
+    batched = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    frozen = radix_tree_freeze(tree);
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        j = (int)((i * 40503u) % BENCH_LOOKUPS);
+        found += radix_frozen_exact_match(frozen, (unsigned char *)keys + (size_t)j * 48, strlen(keys + (size_t)j * 48)) != NULL;
+    }
+    frozen_single = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%8s %16s %16s %16s %16s\n", "keys", "single Mops", "batch Mops", "frozen Mops", "frozen B/key");
+    printf("%8d %16.2f %16.2f %16.2f %16.1f\n", BENCH_LOOKUPS, BENCH_LOOKUPS / single / 1e6, BENCH_LOOKUPS / batched / 1e6,
+        BENCH_LOOKUPS / frozen_single / 1e6, (double)frozen->bytes / BENCH_LOOKUPS);
+    if (found != (size_t)BENCH_LOOKUPS * 3)
+    {
+        printf("lookups missed %d keys\n", (int)((size_t)BENCH_LOOKUPS * 3 - found));
+    }
+
+    radix_frozen_destroy(frozen);
+    radix_tree_destroy(tree);
+    free(keys);
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/* sorted input loaded key by key against one bulk pass and a build
+   split by leading byte over threads */
+static void bench_bulk(int threads)
+{
+    radix_tree_t *tree;
+    char *buf;
+    const unsigned char **keys;
+    int *lens;
+    void **values;
+    std::chrono::steady_clock::time_point start;
+    double inserted;
+    double bulk;
+    double arena;
+    double parallel;
+    int i;
+
+    buf = (char *)malloc((size_t)BENCH_LOOKUPS * 48);
+    keys = (const unsigned char **)malloc(BENCH_LOOKUPS * sizeof(const unsigned char *));
+    lens = (int *)malloc(BENCH_LOOKUPS * sizeof(int));
+    values = (void **)malloc(BENCH_LOOKUPS * sizeof(void *));
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        bench_key(buf + (size_t)i * 48, i);
+        keys[i] = (const unsigned char *)buf + (size_t)i * 48;
+    }
+    qsort(keys, BENCH_LOOKUPS, sizeof(const unsigned char *), bench_compare);
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        lens[i] = strlen((const char *)keys[i]);
+        values[i] = (void *)(size_t)(i + 1);
+    }
+
+    tree = radix_tree_create(0, NULL, NULL);
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        radix_tree_insert(tree, keys[i], lens[i], values[i]);
+    }
+    inserted = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    radix_tree_destroy(tree);
+
+    tree = radix_tree_create(0, NULL, NULL);
+    start = std::chrono::steady_clock::now();
+    radix_tree_bulk_load(tree, keys, lens, values, BENCH_LOOKUPS);
+    bulk = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    radix_tree_destroy(tree);
+
+    tree = radix_tree_create_arena(NULL, NULL, 0);
+    start = std::chrono::steady_clock::now();
+    radix_tree_bulk_load(tree, keys, lens, values, BENCH_LOOKUPS);
+    arena = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    radix_tree_destroy(tree);
+
+    tree = radix_tree_create_arena(NULL, NULL, 0);
+    start = std::chrono::steady_clock::now();
+    radix_tree_parallel_load(tree, keys, lens, values, BENCH_LOOKUPS, threads);
+    parallel = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    radix_tree_destroy(tree);
+
+    printf("%8s %16s %16s %16s %16s\n", "keys", "insert s", "bulk s", "bulk arena s", "parallel s");
+    printf("%8d %16.3f %16.3f %16.3f %16.3f\n", BENCH_LOOKUPS, inserted, bulk, arena, parallel);
+
+    free(values);
+    free(lens);
+    free(keys);
+    free(buf);
+}
+
+static void bench_lpm()
+{
+    radix_lpm_t *lpm;
+    unsigned int *addrs;
+    unsigned char prefix[4];
+    unsigned char key[4];
+    void *values[BENCH_BATCH];
+    void *value;
+    std::chrono::steady_clock::time_point start;
+    double tree;
+    double single;
+    double batched;
+    size_t found;
+    size_t routed;
+    unsigned int x;
+    int depth;
+    int i;
+    int j;
+    int k;
+
+    lpm = radix_lpm_create(32);
+    x = 2463534242u;
+    for (i = 0; i < BENCH_ROUTES; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        depth = i % 4 == 0 ? 16 + (int)(x % 17) : 24;
+        prefix[0] = (unsigned char)(x >> 24);
+        prefix[1] = (unsigned char)(x >> 16);
+        prefix[2] = (unsigned char)(x >> 8);
+        prefix[3] = (unsigned char)x;
+        radix_lpm_add(lpm, prefix, depth, (void *)(size_t)(i + 1));
+    }
+
+    addrs = (unsigned int *)malloc((size_t)BENCH_LOOKUPS * sizeof(unsigned int));
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        addrs[i] = x;
+    }
+
+    // the prefix tree alone, one bit per step
+    found = 0;
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            key[j] = 0;
+            for (k = 0; k < 8; k++)
+            {
+                key[j] |= ((addrs[i] >> (31 - j * 8 - k)) & 1) << k;
+            }
+        }
+        found += bit_radix_tree_prefix_match(lpm->prefixes, key, 32, &value) > 0;
+    }
+    tree = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    routed = 0;
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        routed += radix_lpm_lookup_ipv4(lpm, addrs[i]) != NULL;
+    }
+    single = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i + BENCH_BATCH <= BENCH_LOOKUPS; i += BENCH_BATCH)
+    {
+        radix_lpm_lookup_ipv4_batch(lpm, addrs + i, BENCH_BATCH, values);
+        for (j = 0; j < BENCH_BATCH; j++)
+        {
+            routed += values[j] != NULL;
+        }
+    }
+    batched = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%8s %16s %16s %16s\n", "routes", "tree Mops", "lpm Mops", "lpm batch Mops");
+    printf("%8d %16.2f %16.2f %16.2f\n", BENCH_ROUTES, BENCH_LOOKUPS / tree / 1e6, BENCH_LOOKUPS / single / 1e6,
+        BENCH_LOOKUPS / batched / 1e6);
+    if (routed != found * 2)
+    {
+        printf("lpm found %d routes, the tree %d\n", (int)(routed / 2), (int)found);
+    }
+
+    radix_lpm_destroy(lpm);
+    free(addrs);
+}
+
+static void bench_stride()
+{
+    bit_radix_tree_t *tree;
+    unsigned char *keys;
+    std::chrono::steady_clock::time_point start;
+    double insert;
+    double lookup;
+    size_t found;
+    unsigned int x;
+    int stride;
+    int i;
+    int j;
+
+    // IPv6 like keys below a common /32
+    keys = (unsigned char *)malloc((size_t)BENCH_KEYS * 16);
+    x = 88172645u;
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        keys[(size_t)i * 16] = 0x04;
+        keys[(size_t)i * 16 + 1] = 0x80;
+        keys[(size_t)i * 16 + 2] = 0xb0;
+        keys[(size_t)i * 16 + 3] = 0x1d;
+        for (j = 4; j < 16; j++)
+        {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            keys[(size_t)i * 16 + j] = (unsigned char)(x >> 11);
+        }
+    }
+
+    printf("%8s %16s %16s\n", "stride", "insert Mops", "lookup Mops");
+    for (stride = 1; stride <= 8; stride *= 2)
+    {
+        tree = bit_radix_tree_create(2, NULL, NULL);
+        bit_radix_tree_set_stride(tree, stride);
+        start = std::chrono::steady_clock::now();
+        for (i = 0; i < BENCH_KEYS; i++)
+        {
+            bit_radix_tree_insert(tree, keys + (size_t)i * 16, 128, (void *)(size_t)(i + 1));
+        }
+        insert = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        found = 0;
+        start = std::chrono::steady_clock::now();
+        for (i = 0; i < BENCH_KEYS; i++)
+        {
+            j = (int)((i * 40503u) % BENCH_KEYS);
+            found += bit_radix_tree_exact_match(tree, keys + (size_t)j * 16, 128) != NULL;
+        }
+        lookup = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("%8d %16.2f %16.2f\n", stride, BENCH_KEYS / insert / 1e6, BENCH_KEYS / lookup / 1e6);
+        if (found != BENCH_KEYS)
+        {
+            printf("lookups missed %d keys\n", (int)(BENCH_KEYS - found));
+        }
+        bit_radix_tree_destroy(tree);
+    }
+    free(keys);
+}
+
+struct bench_view
+{
+    const char *p;
+    size_t n;
+    const char *data() const { return p; }
+    size_t size() const { return n; }
+};
+
+static void *bench_copy_double(void *value)
+{
+    double *copy = (double *)malloc(sizeof(double));
+    *copy = *(double *)value;
+    return copy;
+}
+
+static void bench_template()
+{
+    radix_tree<bench_view, double> typed;
+    radix_tree_t *tree;
+    char *keys;
+    bench_view key;
+    std::chrono::steady_clock::time_point start;
+    double c_insert;
+    double c_lookup;
+    double b_lookup;
+    double t_insert;
+    double t_lookup;
+    double sum;
+    double v;
+    void *p;
+    int i;
+    int j;
+
+    keys = (char *)malloc((size_t)BENCH_KEYS * 48);
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        bench_key(keys + (size_t)i * 48, i);
+    }
+
+    sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        key.p = keys + (size_t)i * 48;
+        key.n = strlen(key.p);
+        typed.insert(key, (double)i);
+    }
+    t_insert = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        j = (int)((i * 40503u) % BENCH_KEYS);
+        key.p = keys + (size_t)j * 48;
+        key.n = strlen(key.p);
+        typed.find(key, v);
+        sum -= 2 * v;
+    }
+    t_lookup = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // values copied to the heap through the tree callbacks, lookups hand
+    // out copies as well
+    tree = radix_tree_create(0, bench_copy_double, free);
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        v = i;
+        radix_tree_insert(tree, (unsigned char *)keys + (size_t)i * 48, strlen(keys + (size_t)i * 48), &v);
+    }
+    c_insert = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        j = (int)((i * 40503u) % BENCH_KEYS);
+        p = radix_tree_exact_match(tree, (unsigned char *)keys + (size_t)j * 48, strlen(keys + (size_t)j * 48));
+        sum += *(double *)p;
+        free(p);
+    }
+    c_lookup = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        j = (int)((i * 40503u) % BENCH_KEYS);
+        sum += *(const double *)radix_tree_exact_match_borrow(tree, (unsigned char *)keys + (size_t)j * 48, strlen(keys + (size_t)j * 48));
+    }
+    b_lookup = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    radix_tree_destroy(tree);
+
+    printf("%8s %16s %16s %16s %16s %16s\n", "keys", "copy_leaf ins", "copy_leaf find", "borrow find", "typed ins", "typed find");
+    printf("%8d %16.2f %16.2f %16.2f %16.2f %16.2f\n", BENCH_KEYS, BENCH_KEYS / c_insert / 1e6, BENCH_KEYS / c_lookup / 1e6,
+        BENCH_KEYS / b_lookup / 1e6, BENCH_KEYS / t_insert / 1e6, BENCH_KEYS / t_lookup / 1e6);
+    if (sum != 0)
+    {
+        printf("typed values differ\n");
+    }
+    free(keys);
+}
+
+/* the suite: every structure against every dataset through the same
+   table of calls, so each one pays the same indirection */
+
+static size_t bench_heap;       // live bytes from operator new, for the std baselines
+static size_t bench_heap_base;  // bench_heap before the container was created
+
+/* the counting pair stays out of line, or the compiler inlines the malloc
+   and free into operator new and delete and reports them as mismatched */
+#ifdef _MSC_VER
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+static BENCH_NOINLINE void *bench_heap_alloc(size_t size)
+{
+    size_t *p = (size_t *)malloc(size + 16);
+    if (p != NULL)
+    {
+        p[0] = size;
+        bench_heap += size;
+    }
+    return p;
+}
+
+static BENCH_NOINLINE void bench_heap_free(void *p)
+{
+    bench_heap -= *(size_t *)p;
+    free(p);
+}
+
+void *operator new(size_t size)
+{
+    void *p = bench_heap_alloc(size);
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return (unsigned char *)p + 16;
+}
+
+// deallocation functions are noexcept without saying so
+void operator delete(void *p)
+{
+    if (p != NULL)
+    {
+        bench_heap_free((unsigned char *)p - 16);
+    }
+}
+
+void operator delete(void *p, size_t size)
+{
+    (void)size;
+    operator delete(p);
+}
+
+struct bench_target
+{
+    const char *name;
+    void *(*create)();
+    void (*insert)(void *map, const std::string &key, void *value);
+    void *(*find)(void *map, const std::string &key);
+    void *(*prefix)(void *map, const std::string &key);   // NULL when there is none
+    void (*remove)(void *map, const std::string &key);
+    size_t (*bytes)(void *map);                             // NULL when not measured
+    void (*destroy)(void *map);
+};
+
+static void *bench_radix_create()
+{
+    return radix_tree_create(0, NULL, NULL);
+}
+
+static void *bench_radix_arena_create()
+{
+    return radix_tree_create_arena(NULL, NULL, 0);
+}
+
+static void bench_radix_insert(void *map, const std::string &key, void *value)
+{
+    radix_tree_insert((radix_tree_t *)map, (const unsigned char *)key.data(), (int)key.size(), value);
+}
+
+static void *bench_radix_find(void *map, const std::string &key)
+{
+    return radix_tree_exact_match((radix_tree_t *)map, (const unsigned char *)key.data(), (int)key.size());
+}
+
+static void *bench_radix_prefix(void *map, const std::string &key)
+{
+    void *value;
+    radix_tree_prefix_match((radix_tree_t *)map, (const unsigned char *)key.data(), (int)key.size(), &value);
+    return value;
+}
+
+static void bench_radix_remove(void *map, const std::string &key)
+{
+    radix_tree_erase((radix_tree_t *)map, (const unsigned char *)key.data(), (int)key.size());
+}
+
+static size_t bench_radix_bytes(void *map)
+{
+    return ((radix_tree_t *)map)->arena->reserved;
+}
+
+static void bench_radix_destroy(void *map)
+{
+    radix_tree_destroy((radix_tree_t *)map);
+}
+
+static void *bench_bit_create(int stride)
+{
+    bit_radix_tree_t *tree = bit_radix_tree_create_arena(2, NULL, NULL, 0);
+    bit_radix_tree_set_stride(tree, stride);
+    return tree;
+}
+
+static void *bench_bit1_create()
+{
+    return bench_bit_create(1);
+}
+
+static void *bench_bit4_create()
+{
+    return bench_bit_create(4);
+}
+
+static void bench_bit_insert(void *map, const std::string &key, void *value)
+{
+    bit_radix_tree_insert((bit_radix_tree_t *)map, (const unsigned char *)key.data(), (int)key.size() * 8, value);
+}
+
+static void *bench_bit_find(void *map, const std::string &key)
+{
+    return bit_radix_tree_exact_match((bit_radix_tree_t *)map, (const unsigned char *)key.data(), (int)key.size() * 8);
+}
+
+static void *bench_bit_prefix(void *map, const std::string &key)
+{
+    void *value;
+    bit_radix_tree_prefix_match((bit_radix_tree_t *)map, (const unsigned char *)key.data(), (int)key.size() * 8, &value);
+    return value;
+}
+
+static void bench_bit_remove(void *map, const std::string &key)
+{
+    bit_radix_tree_erase((bit_radix_tree_t *)map, (const unsigned char *)key.data(), (int)key.size() * 8);
+}
+
+static size_t bench_bit_bytes(void *map)
+{
+    return ((bit_radix_tree_t *)map)->arena->reserved;
+}
+
+static void bench_bit_destroy(void *map)
+{
+    bit_radix_tree_destroy((bit_radix_tree_t *)map);
+}
+
+static void *bench_string_map_create()
+{
+    string_map_t *map = (string_map_t *)malloc(sizeof(string_map_t));
+    string_map_init(map, NULL, NULL);
+    return map;
+}
+
+static void bench_string_map_insert(void *map, const std::string &key, void *value)
+{
+    string_map_insert((string_map_t *)map, (const unsigned char *)key.data(), (int)key.size(), value);
+}
+
+static void *bench_string_map_find(void *map, const std::string &key)
+{
+    return (void *)string_map_find((string_map_t *)map, (const unsigned char *)key.data(), (int)key.size());
+}
+
+static void bench_string_map_remove(void *map, const std::string &key)
+{
+    string_map_erase((string_map_t *)map, (const unsigned char *)key.data(), (int)key.size());
+}
+
+static void bench_string_map_destroy(void *map)
+{
+    string_map_release((string_map_t *)map);
+    free(map);
+}
+
+// the std containers find the longest prefix by probing every length
+template <class Map>
+struct bench_std
+{
+    static void *create()
+    {
+        return new Map();
+    }
+    static void insert(void *map, const std::string &key, void *value)
+    {
+        (*(Map *)map)[key] = value;
+    }
+    static void *find(void *map, const std::string &key)
+    {
+        typename Map::iterator it = ((Map *)map)->find(key);
+        return it == ((Map *)map)->end() ? NULL : it->second;
+    }
+    static void *prefix(void *map, const std::string &key)
+    {
+        std::string probe(key);
+        typename Map::iterator it;
+
+        for (;;)
+        {
+            it = ((Map *)map)->find(probe);
+            if (it != ((Map *)map)->end())
+            {
+                return it->second;
+            }
+            if (probe.empty())
+            {
+                return NULL;
+            }
+            probe.resize(probe.size() - 1);
+        }
+    }
+    static void remove(void *map, const std::string &key)
+    {
+        ((Map *)map)->erase(key);
+    }
+    static size_t bytes(void *map)
+    {
+        (void)map;
+        return bench_heap - bench_heap_base;
+    }
+    static void destroy(void *map)
+    {
+        delete (Map *)map;
+    }
+};
+
+typedef bench_std<std::map<std::string, void *> > bench_std_map;
+typedef bench_std<std::unordered_map<std::string, void *> > bench_std_hash;
+
+static const bench_target bench_targets[] =
+{
+    { "radix", bench_radix_create, bench_radix_insert, bench_radix_find, bench_radix_prefix, bench_radix_remove, NULL, bench_radix_destroy },
+    { "radix arena", bench_radix_arena_create, bench_radix_insert, bench_radix_find, bench_radix_prefix, bench_radix_remove, bench_radix_bytes, bench_radix_destroy },
+    { "bit stride 1", bench_bit1_create, bench_bit_insert, bench_bit_find, bench_bit_prefix, bench_bit_remove, bench_bit_bytes, bench_bit_destroy },
+    { "bit stride 4", bench_bit4_create, bench_bit_insert, bench_bit_find, bench_bit_prefix, bench_bit_remove, bench_bit_bytes, bench_bit_destroy },
+    { "string_map", bench_string_map_create, bench_string_map_insert, bench_string_map_find, NULL, bench_string_map_remove, NULL, bench_string_map_destroy },
+    { "std::map", bench_std_map::create, bench_std_map::insert, bench_std_map::find, bench_std_map::prefix, bench_std_map::remove, bench_std_map::bytes, bench_std_map::destroy },
+    { "unordered_map", bench_std_hash::create, bench_std_hash::insert, bench_std_hash::find, bench_std_hash::prefix, bench_std_hash::remove, bench_std_hash::bytes, bench_std_hash::destroy },
+};
+
+static unsigned int bench_random(unsigned int *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static void bench_urls(std::vector<std::string> &keys, unsigned int *x)
+{
+    static const char *hosts[] = { "www.example.com", "api.example.com", "cdn.static.net", "shop.example.org", "news.site.io", "m.example.com" };
+    static const char *words[] = { "user", "users", "profile", "settings", "api", "v1", "v2", "search", "item", "items",
+        "cart", "checkout", "images", "static", "js", "css", "blog", "post", "posts", "tag", "category", "help", "docs", "login" };
+    std::string url;
+    char id[16];
+    int depth;
+    int i;
+
+    while (keys.size() < BENCH_SUITE)
+    {
+        url = "https://";
+        url += hosts[bench_random(x) % (sizeof(hosts) / sizeof(hosts[0]))];
+        depth = 1 + bench_random(x) % 4;
+        for (i = 0; i < depth; i++)
+        {
+            url += '/';
+            url += words[bench_random(x) % (sizeof(words) / sizeof(words[0]))];
+        }
+        sprintf(id, "/%u", bench_random(x) % 100000);
+        url += id;
+        if (bench_random(x) % 4 == 0)
+        {
+            sprintf(id, "?page=%u", bench_random(x) % 50);
+            url += id;
+        }
+        keys.push_back(url);
+    }
+}
+
+static void bench_paths(std::vector<std::string> &keys, unsigned int *x)
+{
+    static const char *roots[] = { "/usr/lib", "/usr/share", "/home", "/var/log", "/opt", "/etc" };
+    static const char *dirs[] = { "src", "include", "lib", "bin", "doc", "test", "python3", "x86_64-linux-gnu", "locale",
+        "man", "cache", "build", "node_modules", "config", "data" };
+    static const char *exts[] = { ".c", ".h", ".so", ".txt", ".py", ".json", ".conf", "" };
+    std::string path;
+    char name[24];
+    int depth;
+    int i;
+
+    while (keys.size() < BENCH_SUITE)
+    {
+        path = roots[bench_random(x) % (sizeof(roots) / sizeof(roots[0]))];
+        depth = 1 + bench_random(x) % 6;
+        for (i = 0; i < depth; i++)
+        {
+            path += '/';
+            path += dirs[bench_random(x) % (sizeof(dirs) / sizeof(dirs[0]))];
+        }
+        sprintf(name, "/file%u", bench_random(x) % 5000);
+        path += name;
+        path += exts[bench_random(x) % (sizeof(exts) / sizeof(exts[0]))];
+        keys.push_back(path);
+    }
+}
+
+static void bench_binary(std::vector<std::string> &keys, unsigned int *x)
+{
+    unsigned char buf[16];
+    int i;
+
+    while (keys.size() < BENCH_SUITE)
+    {
+        for (i = 0; i < 16; i++)
+        {
+            buf[i] = (unsigned char)bench_random(x);
+        }
+        keys.push_back(std::string((const char *)buf, 16));
+    }
+}
+
+// whole bytes only, so every structure sees the same prefixes; mostly /24
+// the way routing tables are
+static void bench_ipv4(std::vector<std::string> &keys, unsigned int *x)
+{
+    unsigned char buf[4];
+    unsigned int r;
+    int len;
+
+    while (keys.size() < BENCH_SUITE)
+    {
+        r = bench_random(x) % 100;
+        len = r < 2 ? 1 : r < 20 ? 2 : r < 90 ? 3 : 4;
+        r = bench_random(x);
+        buf[0] = (unsigned char)(1 + (r >> 24) % 223);
+        buf[1] = (unsigned char)(r >> 16);
+        buf[2] = (unsigned char)(r >> 8);
+        buf[3] = (unsigned char)r;
+        keys.push_back(std::string((const char *)buf, len));
+    }
+}
+
+// big endian, so byte order is numeric order
+static void bench_dense(std::vector<std::string> &keys, unsigned int *x)
+{
+    unsigned char buf[8];
+    size_t n;
+    int i;
+
+    (void)x;
+    for (n = keys.size(); n < BENCH_SUITE; n++)
+    {
+        for (i = 0; i < 8; i++)
+        {
+            buf[i] = (unsigned char)((unsigned long long)n >> (56 - 8 * i));
+        }
+        keys.push_back(std::string((const char *)buf, 8));
+    }
+}
+
+static void bench_unique(std::vector<std::string> &keys)
+{
+    std::unordered_set<std::string> seen;
+    size_t n;
+    size_t i;
+
+    n = 0;
+    for (i = 0; i < keys.size(); i++)
+    {
+        if (seen.insert(keys[i]).second)
+        {
+            keys[n++] = keys[i];
+        }
+    }
+    keys.resize(n);
+}
+
+/* ranks drawn with probability proportional to 1 / rank^BENCH_ZIPF,
+   the ranks are spread over the keys so the hot ones are not neighbours */
+static void bench_zipf(std::vector<int> &queries, int n, unsigned int *x)
+{
+    std::vector<double> cdf(n);
+    std::vector<int> rank(n);
+    double total;
+    double u;
+    int i;
+    int j;
+
+    total = 0;
+    for (i = 0; i < n; i++)
+    {
+        total += 1.0 / pow(i + 1, BENCH_ZIPF);
+        cdf[i] = total;
+        rank[i] = i;
+    }
+    for (i = n - 1; i > 0; i--)
+    {
+        j = (int)(bench_random(x) % (unsigned int)(i + 1));
+        std::swap(rank[i], rank[j]);
+    }
+    for (i = 0; i < n; i++)
+    {
+        u = (double)bench_random(x) / 4294967296.0 * total;
+        queries[i] = rank[std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin()];
+    }
+}
+
+static double bench_percentile(std::vector<double> &ns, double p)
+{
+    size_t i = (size_t)(p * (double)(ns.size() - 1));
+    std::nth_element(ns.begin(), ns.begin() + i, ns.end());
+    return ns[i];
+}
+
+static void bench_report(const char *target, const char *op, std::vector<double> &ns, double seconds, const char *bytes)
+{
+    printf("%-14s %-8s %8.2f %8.0f %8.0f %8.0f %10s\n", target, op, ns.size() / seconds / 1e6,
+        bench_percentile(ns, 0.5), bench_percentile(ns, 0.99), bench_percentile(ns, 0.999), bytes);
+}
+
+enum { BENCH_INSERT, BENCH_FIND, BENCH_ZIPF_FIND, BENCH_PREFIX, BENCH_REMOVE };
+
+/* runs op over every key in order, timing each call on its own; the
+   clock reads add the same few ns to every structure */
+static double bench_pass(const bench_target *t, void *map, int op, const std::vector<std::string> &keys,
+    const std::vector<int> &order, std::vector<double> &ns, size_t *found)
+{
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point a;
+    std::chrono::steady_clock::time_point b;
+    const std::string *key;
+    void *value;
+    size_t i;
+
+    value = NULL;
+    start = std::chrono::steady_clock::now();
+    b = start;
+    for (i = 0; i < order.size(); i++)
+    {
+        key = &keys[order[i]];
+        a = b;
+        switch (op)
+        {
+        case BENCH_INSERT:
+            t->insert(map, *key, (void *)(size_t)(order[i] + 1));
+            break;
+        case BENCH_FIND:
+        case BENCH_ZIPF_FIND:
+            value = t->find(map, *key);
+            break;
+        case BENCH_PREFIX:
+            value = t->prefix(map, *key);
+            break;
+        default:
+            t->remove(map, *key);
+            break;
+        }
+        b = std::chrono::steady_clock::now();
+        ns[i] = std::chrono::duration<double, std::nano>(b - a).count();
+        *found += value != NULL;
+    }
+    return std::chrono::duration<double>(b - start).count();
+}
+
+// where the memory of a radix_tree_t over keys goes
+static void bench_shape(const std::vector<std::string> &keys)
+{
+    radix_tree_t *tree;
+    radix_tree_stats_t stats;
+    size_t i;
+
+    tree = radix_tree_create(0, NULL, NULL);
+    for (i = 0; i < keys.size(); i++)
+    {
+        radix_tree_insert(tree, (const unsigned char *)keys[i].data(), (int)keys[i].size(), (void *)(i + 1));
+    }
+    radix_tree_stats(tree, &stats);
+    printf("radix shape: %d nodes, max depth %d, tables 4/16/48/256 %d/%d/%d/%d, %.0f%% of child slots used\n",
+        (int)stats.nodes, stats.max_depth, (int)stats.tables[RADIX_TABLE_4], (int)stats.tables[RADIX_TABLE_16],
+        (int)stats.tables[RADIX_TABLE_48], (int)stats.tables[RADIX_TABLE_256], 100.0 * stats.children / stats.slots);
+    printf("radix bytes/key: nodes %.1f, tables %.1f, labels %.1f\n", (double)stats.node_bytes / keys.size(),
+        (double)stats.table_bytes / keys.size(), (double)stats.label_bytes / keys.size());
+    radix_tree_destroy(tree);
+}
+
+static void bench_dataset(const char *name, void (*generate)(std::vector<std::string> &, unsigned int *))
+{
+    static const char *ops[] = { "insert", "find", "zipf", "prefix", "remove" };
+    std::vector<std::string> keys;
+    std::vector<std::string> probes;
+    std::vector<int> shuffled;
+    std::vector<int> zipf;
+    std::vector<double> ns;
+    const bench_target *t;
+    unsigned int x;
+    size_t total;
+    size_t found;
+    double seconds;
+    char column[16];
+    void *map;
+    int op;
+    int i;
+    int j;
+
+    x = 2463534242u;
+    while (keys.size() < BENCH_SUITE)
+    {
+        generate(keys, &x);
+        bench_unique(keys);
+    }
+    total = 0;
+    shuffled.resize(keys.size());
+    for (i = 0; i < (int)keys.size(); i++)
+    {
+        total += keys[i].size();
+        shuffled[i] = i;
+    }
+    for (i = (int)keys.size() - 1; i > 0; i--)
+    {
+        j = (int)(bench_random(&x) % (unsigned int)(i + 1));
+        std::swap(shuffled[i], shuffled[j]);
+    }
+    zipf.resize(keys.size());
+    bench_zipf(zipf, (int)keys.size(), &x);
+
+    // prefix queries run past the end of a stored key
+    probes = keys;
+    for (i = 0; i < (int)probes.size(); i++)
+    {
+        probes[i] += (char)bench_random(&x);
+        probes[i] += (char)bench_random(&x);
+    }
+
+    printf("\n%s: %d keys, %.1f bytes on average\n", name, (int)keys.size(), (double)total / keys.size());
+    bench_shape(keys);
+    printf("%-14s %-8s %8s %8s %8s %8s %10s\n", "structure", "op", "Mops", "p50 ns", "p99 ns", "p999 ns", "bytes/key");
+    ns.resize(keys.size());
+    for (t = bench_targets; t < bench_targets + sizeof(bench_targets) / sizeof(bench_targets[0]); t++)
+    {
+        bench_heap_base = bench_heap;
+        map = t->create();
+        found = 0;
+        for (op = BENCH_INSERT; op <= BENCH_REMOVE; op++)
+        {
+            if (op == BENCH_PREFIX && t->prefix == NULL)
+            {
+                continue;
+            }
+            seconds = bench_pass(t, map, op, op == BENCH_PREFIX ? probes : keys, op == BENCH_ZIPF_FIND ? zipf : shuffled, ns, &found);
+            column[0] = '\0';
+            if (op == BENCH_INSERT && t->bytes != NULL)
+            {
+                sprintf(column, "%.1f", (double)t->bytes(map) / keys.size());
+            }
+            bench_report(t->name, ops[op], ns, seconds, column);
+        }
+        if (found != keys.size() * (t->prefix != NULL ? 3 : 2))
+        {
+            printf("%s missed %d keys\n", t->name, (int)(keys.size() * (t->prefix != NULL ? 3 : 2) - found));
+        }
+        t->destroy(map);
+    }
+}
+
+/* deltas of random keys written into a loaded tree and taken out again,
+   key by key against the sorted write batches; keys are grouped by
+   tenant so that neighbours in a sorted delta share most of their path */
+static void bench_deltas()
+{
+    radix_tree_t *tree;
+    char *buf;
+    const unsigned char **keys;
+    int *lens;
+    void **values;
+    std::chrono::steady_clock::time_point start;
+    double single = 0;
+    double batched = 0;
+    unsigned int x;
+    int round;
+    int pass;
+    int i;
+    int j;
+
+    buf = (char *)malloc((size_t)BENCH_DELTA * 48);
+    keys = (const unsigned char **)malloc(BENCH_DELTA * sizeof(const unsigned char *));
+    lens = (int *)malloc(BENCH_DELTA * sizeof(int));
+    values = (void **)malloc(BENCH_DELTA * sizeof(void *));
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        tree = radix_tree_create(0, NULL, NULL);
+        for (i = 0; i < BENCH_KEYS; i++)
+        {
+            sprintf(buf, "/tenant/%04d/item/%08d", 2 * i % 500, 2 * i);
+            radix_tree_insert(tree, (const unsigned char *)buf, strlen(buf), (void *)(size_t)(i + 1));
+        }
+
+        x = 2463534242u;
+        for (round = 0; round < 20; round++)
+        {
+            for (i = 0; i < BENCH_DELTA; i++)
+            {
+                j = (int)(bench_random(&x) % (4 * BENCH_KEYS));
+                sprintf(buf + (size_t)i * 48, "/tenant/%04d/item/%08d", j % 500, j);
+                keys[i] = (const unsigned char *)buf + (size_t)i * 48;
+                lens[i] = strlen((const char *)keys[i]);
+                values[i] = (void *)(size_t)(i + 1);
+            }
+
+            start = std::chrono::steady_clock::now();
+            if (pass == 0)
+            {
+                for (i = 0; i < BENCH_DELTA; i++)
+                {
+                    radix_tree_insert(tree, keys[i], lens[i], values[i]);
+                }
+                for (i = 0; i < BENCH_DELTA; i++)
+                {
+                    radix_tree_erase(tree, keys[i], lens[i]);
+                }
+                single += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            else
+            {
+                radix_tree_insert_batch(tree, keys, lens, values, BENCH_DELTA);
+                radix_tree_erase_batch(tree, keys, lens, BENCH_DELTA);
+                batched += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+        radix_tree_destroy(tree);
+    }
+
+    printf("%8s %8s %16s %16s\n", "keys", "delta", "single ms", "batch ms");
+    printf("%8d %8d %16.2f %16.2f\n", BENCH_KEYS, BENCH_DELTA, single * 1000 / 20, batched * 1000 / 20);
+
+    free(values);
+    free(lens);
+    free(keys);
+    free(buf);
+}
+
+/* half of a loaded tree removed in random order, a remove at a time
+   from a tree that frees and merges nodes at once and from one that
+   leaves that to a radix_tree_compact step after every BENCH_BATCH
+   removes, as a thread of its own would. The keys end in a suffix, so
+   merged labels are mostly too long to live inside the node */
+static void bench_lazy_remove()
+{
+    radix_tree_t *trees[2];
+    std::vector<std::string> keys;
+    std::vector<double> ns[2];
+    std::vector<double> steps;
+    std::chrono::steady_clock::time_point a;
+    std::chrono::steady_clock::time_point b;
+    double seconds[2];
+    double compact;
+    char buf[64];
+    void *value;
+    unsigned int x;
+    int left;
+    int lazy;
+    int i;
+
+    x = 2463534242u;
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        sprintf(buf, "/tenant/%04d/item/%08d/attributes", i % 500, i);
+        keys.push_back(buf);
+    }
+    for (i = BENCH_KEYS - 1; i > 0; i--)
+    {
+        std::swap(keys[i], keys[bench_random(&x) % (unsigned int)(i + 1)]);
+    }
+
+    for (lazy = 0; lazy < 2; lazy++)
+    {
+        trees[lazy] = radix_tree_create(0, NULL, NULL);
+        for (i = 0; i < BENCH_KEYS; i++)
+        {
+            radix_tree_insert(trees[lazy], (const unsigned char *)keys[i].data(), (int)keys[i].size(), (void *)(size_t)(i + 1));
+        }
+        radix_tree_set_lazy_remove(trees[lazy], lazy);
+        ns[lazy].resize(BENCH_KEYS / 2);
+        seconds[lazy] = 0;
+    }
+
+    // the trees take turns, so neither runs on a warmer cache
+    compact = 0;
+    left = 0;
+    for (i = 0; i < BENCH_KEYS / 2 || left > 0; i++)
+    {
+        for (lazy = 0; lazy < 2 && i < BENCH_KEYS / 2; lazy++)
+        {
+            a = std::chrono::steady_clock::now();
+            radix_tree_remove(trees[lazy], (const unsigned char *)keys[i].data(), (int)keys[i].size(), &value);
+            b = std::chrono::steady_clock::now();
+            ns[lazy][i] = std::chrono::duration<double, std::nano>(b - a).count();
+            seconds[lazy] += ns[lazy][i] / 1e9;
+        }
+        if ((i + 1) % BENCH_BATCH == 0 || i >= BENCH_KEYS / 2)
+        {
+            a = std::chrono::steady_clock::now();
+            left = radix_tree_compact(trees[1], BENCH_BATCH);
+            b = std::chrono::steady_clock::now();
+            steps.push_back(std::chrono::duration<double, std::micro>(b - a).count());
+            compact += steps.back() / 1000;
+        }
+    }
+
+    printf("%-14s %8s %8s %8s %8s %10s %12s\n", "remove", "Mops", "p50 ns", "p99 ns", "p999 ns", "compact ms", "step p99 us");
+    for (lazy = 0; lazy < 2; lazy++)
+    {
+        printf("%-14s %8.2f %8.0f %8.0f %8.0f", lazy ? "lazy" : "eager", ns[lazy].size() / seconds[lazy] / 1e6,
+            bench_percentile(ns[lazy], 0.5), bench_percentile(ns[lazy], 0.99), bench_percentile(ns[lazy], 0.999));
+        if (lazy)
+        {
+            printf(" %10.2f %12.1f", compact, bench_percentile(steps, 0.99));
+        }
+        printf("\n");
+        radix_tree_destroy(trees[lazy]);
+    }
+}
+
+static void bench_suite()
+{
+    bench_dataset("urls", bench_urls);
+    bench_dataset("paths", bench_paths);
+    bench_dataset("binary", bench_binary);
+    bench_dataset("ipv4 prefixes", bench_ipv4);
+    bench_dataset("dense integers", bench_dense);
+}
+
+int main(int argc, char* argv[])
+{
+    int max_threads;
+
+    max_threads = argc > 1 ? atoi(argv[1]) : 8;
+    if (max_threads < 1 || max_threads > BENCH_THREADS)
+    {
+        max_threads = BENCH_THREADS;
+    }
+
+    bench_scaling(max_threads);
+    bench_lookup();
+    bench_bulk(max_threads);
+    bench_deltas();
+    bench_lazy_remove();
+    bench_lpm();
+    bench_stride();
+    bench_template();
+    bench_suite();
+    return 0;
+}
@@ -1,4 +1,8 @@
 #include "bit_radix_tree.h"
+#include "radix_key.h"
+#include "radix_arena.h"
+#include "radix_partition.h"
+#include "radix_thread.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,6 +27,13 @@ void set_bit(unsigned char *buf, int off, unsigned char bit_value)
     *buf |= (1 << bit_off);
 }
 
+/* the stride bits of buf from off, which never cross a byte since off is
+   a multiple of stride */
+static __inline unsigned char get_chunk(const unsigned char *buf, int off, int stride)
+{
+    return (unsigned char)((buf[off / OFFSET_UNIT] >> (off % OFFSET_UNIT)) & ((1 << stride) - 1));
+}
+
 static char *strndup(const char *s, size_t len)
 {
     char *result;
@@ -37,32 +48,52 @@ static char *strndup(const char *s, size_t len)
     return (char *)memcpy(result, s, len);
 }
 
-static unsigned char *merge_bitstr(const unsigned char *s1, 
-    int s1_off, 
-    int s1_len, 
-    const unsigned char *s2, 
-    int s2_off, 
-    int s2_len)
+static __inline void *bit_radix_tree_malloc(bit_radix_tree_t *tree, size_t size)
 {
-    char *dest;
-    int len;
-    int i;
+    if (tree->arena != NULL)
+    {
+        return radix_arena_alloc(tree->arena, size);
+    }
+    return malloc(size);
+}
 
-    len = s1_len + s2_len;
-    dest = malloc(len * sizeof(char) + 1);
-    if (dest)
+static __inline void bit_radix_tree_mfree(bit_radix_tree_t *tree, void *p, size_t size)
+{
+    if (tree->arena != NULL)
     {
-        memcpy(dest, s1, s1_len);
-        for (i = 0; i + s2_off < s2_len; i++)
-        {
-            set_bit(dest, s1_len + i, get_bit(s2, i + s2_off));
-        }
+        radix_arena_free(tree->arena, p, size);
     }
+    else
+    {
+        free(p);
+    }
+}
+
+/* bytes held by a label of keys_len bits, including the terminator */
+#define BIT_RADIX_KEYS_BYTES(keys_len) (((keys_len) + OFFSET_UNIT - 1) / OFFSET_UNIT + 1)
+
+// smallest child table, two slots take no more than one would from the arena
+#define BIT_RADIX_MIN_TABLE             2
 
-    return dest;
+#define BIT_RADIX_INNER(r, b)           ((1 << (r)) - 2 + (b))
+#define BIT_RADIX_INNER_SLOTS(stride)   ((1 << (stride)) - 2)
+
+/* length in bits of the common prefix of the node label and the key from off */
+static __inline int bit_radix_tree_match_label(bit_radix_tree_node_t *node,
+    const unsigned char *key,
+    int off,
+    int key_len)
+{
+    int len;
+    len = node->keys_len - node->keys_off;
+    if (key_len - off < len)
+    {
+        len = key_len - off;
+    }
+    return radix_key_mismatch_bits(key, off, node->keys, node->keys_off, len);
 }
 
-bit_radix_tree_node_t *new_bit_radix_tree_node(
+bit_radix_tree_node_t *new_bit_radix_tree_node(bit_radix_tree_t *tree,
     unsigned char key,
     const unsigned char *keys,
     int keys_off,
@@ -72,50 +103,159 @@ bit_radix_tree_node_t *new_bit_radix_tree_node(
     int byte_off;
     int bit_off;
     int byte_len;
-    node = (bit_radix_tree_node_t *)calloc(1, sizeof(bit_radix_tree_node_t));
+    node = (bit_radix_tree_node_t *)bit_radix_tree_malloc(tree, sizeof(bit_radix_tree_node_t));
     if (node != NULL)
     {
         node->key = key;
         byte_off = keys_off / OFFSET_UNIT;
         bit_off  =  keys_off % OFFSET_UNIT;
-        byte_len = keys_len / OFFSET_UNIT - byte_off;
-        node->keys = strndup(keys + byte_off, byte_len);
+        byte_len = (keys_len + OFFSET_UNIT - 1) / OFFSET_UNIT - byte_off;
+        node->keys = bit_radix_tree_malloc(tree, byte_len + 1);
+        if (node->keys != NULL)
+        {
+            if (byte_len > 0)
+            {
+                memcpy(node->keys, keys + byte_off, byte_len);
+            }
+            node->keys[byte_len] = '\0';
+        }
         node->keys_off = bit_off;
         node->keys_len = keys_len - byte_off * OFFSET_UNIT;
         node->next = NULL;
         node->table_items = 0;
+        node->table_size = 0;
         node->table = NULL;
         node->value = NULL;
+        node->inner = NULL;
+        node->inner_items = 0;
     }
     return node;
 }
 
-void free_bit_radix_tree_node(bit_radix_tree_t *tree, bit_radix_tree_node_t *node)
+static void bit_radix_tree_free_inner(bit_radix_tree_t *tree, bit_radix_tree_node_t *node)
+{
+    int i;
+
+    if (node->inner == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < BIT_RADIX_INNER_SLOTS(tree->stride); i++)
+    {
+        if (node->inner[i] != NULL && tree->delete_leaf != NULL)
+        {
+            tree->delete_leaf(node->inner[i]);
+        }
+    }
+    bit_radix_tree_mfree(tree, node->inner, BIT_RADIX_INNER_SLOTS(tree->stride) * sizeof(void *));
+    node->inner = NULL;
+    node->inner_items = 0;
+}
+
+/* where the value of a key ending key_len - end bits past node is kept,
+   or NULL when node has no inner slots yet */
+static __inline void **bit_radix_tree_slot(bit_radix_tree_node_t *node,
+    const unsigned char *key,
+    int end,
+    int key_len)
+{
+    if (key_len == end)
+    {
+        return &node->value;
+    }
+    if (node->inner == NULL)
+    {
+        return NULL;
+    }
+    return &node->inner[BIT_RADIX_INNER(key_len - end, get_chunk(key, end, key_len - end))];
+}
+
+/* child slot for chunk, tables are a power of two slots and at their
+   largest, 1 << stride, every chunk has a slot of its own */
+static __inline bit_radix_tree_node_t **bit_radix_tree_bucket(bit_radix_tree_node_t *node, unsigned char chunk)
+{
+    return &node->table[chunk & (node->table_size - 1)];
+}
+
+static void bit_radix_tree_free_table(bit_radix_tree_t *tree, bit_radix_tree_node_t *node)
 {
     if (node->table != NULL)
     {
-        int table_size = tree == NULL ? 0 : tree->table_size;
-        for (int i = 0; i < table_size; i++)
+        bit_radix_tree_mfree(tree, node->table, node->table_size * sizeof(bit_radix_tree_node_t *));
+    }
+    node->table = NULL;
+    node->table_size = 0;
+    node->table_items = 0;
+}
+
+/* moves the children of node into a table of table_size slots */
+static int bit_radix_tree_resize_table(bit_radix_tree_t *tree, bit_radix_tree_node_t *node, int table_size)
+{
+    bit_radix_tree_node_t **table;
+    bit_radix_tree_node_t *child;
+    bit_radix_tree_node_t *next;
+    int items;
+    int i;
+
+    table = (bit_radix_tree_node_t **)bit_radix_tree_malloc(tree, table_size * sizeof(bit_radix_tree_node_t *));
+    if (table == NULL)
+    {
+        return 0;
+    }
+    memset(table, 0, table_size * sizeof(bit_radix_tree_node_t *));
+    for (i = 0; i < node->table_size; i++)
+    {
+        for (child = node->table[i]; child != NULL; child = next)
         {
-            if (node->table[i] != NULL)
-            {
-                free_bit_radix_tree_node(tree, node->table[i]);
-                node->table[i] = NULL;
-                node->table_items--;
-            }
+            next = child->next;
+            child->next = table[child->key & (table_size - 1)];
+            table[child->key & (table_size - 1)] = child;
         }
+    }
+    items = node->table_items;
+    bit_radix_tree_free_table(tree, node);
+    node->table = table;
+    node->table_size = table_size;
+    node->table_items = items;
+    return 1;
+}
 
-        free(node->table);
+/* after a child was unlinked: the table goes with the last child and
+   halves once it is no more than a quarter full */
+static void bit_radix_tree_shrink_table(bit_radix_tree_t *tree, bit_radix_tree_node_t *node)
+{
+    if (node->table_items == 0)
+    {
+        bit_radix_tree_free_table(tree, node);
+    }
+    else if (node->table_items * 4 <= node->table_size && node->table_size > BIT_RADIX_MIN_TABLE)
+    {
+        bit_radix_tree_resize_table(tree, node, node->table_size / 2);
     }
+}
+
+void free_bit_radix_tree_node(bit_radix_tree_t *tree, bit_radix_tree_node_t *node)
+{
+    int i;
+
+    for (i = 0; i < node->table_size; i++)
+    {
+        if (node->table[i] != NULL)
+        {
+            free_bit_radix_tree_node(tree, node->table[i]);
+        }
+    }
+    bit_radix_tree_free_table(tree, node);
 
     if (node->value != NULL && tree->delete_leaf != NULL)
     {
         tree->delete_leaf(node->value);
     }
+    bit_radix_tree_free_inner(tree, node);
 
     if (node->keys != NULL)
     {
-        free(node->keys);
+        bit_radix_tree_mfree(tree, node->keys, BIT_RADIX_KEYS_BYTES(node->keys_len));
     }
 
     if (node->next != NULL)
@@ -123,52 +263,76 @@ void free_bit_radix_tree_node(bit_radix_tree_t *tree, bit_radix_tree_node_t *nod
         free_bit_radix_tree_node(tree, node->next);
     }
 
-    free(node);
+    bit_radix_tree_mfree(tree, node, sizeof(bit_radix_tree_node_t));
 }
 
-void bit_radix_tree_clear_children(bit_radix_tree_t *tree, bit_radix_tree_node_t *node)
+/* hands every value below and including node to delete_leaf without
+   freeing any memory, used before an arena is released in one go */
+static void bit_radix_tree_delete_values(bit_radix_tree_t *tree, bit_radix_tree_node_t *node)
 {
-    if (node->table != NULL)
+    int i;
+
+    for (; node != NULL; node = node->next)
     {
-        for (int i = 0; i < tree->table_size; i++)
+        for (i = 0; i < node->table_size; i++)
+        {
+            bit_radix_tree_delete_values(tree, node->table[i]);
+        }
+
+        if (node->value != NULL)
         {
-            if (node->table[i] != NULL)
+            tree->delete_leaf(node->value);
+        }
+        for (i = 0; node->inner != NULL && i < BIT_RADIX_INNER_SLOTS(tree->stride); i++)
+        {
+            if (node->inner[i] != NULL)
             {
-                free_bit_radix_tree_node(tree, node->table[i]);
-                node->table[i] = NULL;
-                node->table_items--;
+                tree->delete_leaf(node->inner[i]);
             }
         }
     }
 }
 
+void bit_radix_tree_clear_children(bit_radix_tree_t *tree, bit_radix_tree_node_t *node)
+{
+    int i;
+
+    bit_radix_tree_free_inner(tree, node);
+    for (i = 0; i < node->table_size; i++)
+    {
+        if (node->table[i] != NULL)
+        {
+            free_bit_radix_tree_node(tree, node->table[i]);
+        }
+    }
+    bit_radix_tree_free_table(tree, node);
+}
+
+/* links child under node, doubling the table first once it would hold
+   more children than slots */
 void bit_radix_tree_put_child_node(bit_radix_tree_t *tree,
     bit_radix_tree_node_t *node, 
     unsigned char key, 
     bit_radix_tree_node_t *child)
 {
     bit_radix_tree_node_t **p_node;
-    int idx;
-    int table_size;
-    table_size = tree->table_size;
-    if (node->table == NULL)
+    if (node->table_items == node->table_size && node->table_size < tree->table_size)
     {
-        node->table = malloc(table_size * sizeof(bit_radix_tree_node_t *));
-        if (node->table != NULL)
-        {
-            memset(node->table, 0, table_size * sizeof(bit_radix_tree_node_t *));
-        }
+        bit_radix_tree_resize_table(tree, node, node->table_size == 0 ? BIT_RADIX_MIN_TABLE : node->table_size * 2);
     }
-    idx = key % tree->table_size;
-    for (p_node = &node->table[idx]; *p_node != NULL; p_node = &((*p_node)->next))
+    if (node->table == NULL)
     {
-        assert(key != node->key);
+        return;
     }
+    p_node = bit_radix_tree_bucket(node, key);
+    child->next = *p_node;
     *p_node = child;
     node->table_items++;
 }
 
-void bit_radix_tree_insert(bit_radix_tree_t *tree,
+/* inserts like bit_radix_tree_insert but hands back the value that was
+   replaced, or NULL, instead of passing it to delete_leaf */
+void *bit_radix_tree_replace(bit_radix_tree_t *tree,
     const unsigned char *key,
     int key_len,
     void *value)
@@ -176,77 +340,78 @@ void bit_radix_tree_insert(bit_radix_tree_t *tree,
     bit_radix_tree_node_t **p_node;
     bit_radix_tree_node_t *node;
     bit_radix_tree_node_t *new_node;
+    void **slot;
+    void *old;
     int off = 0;
     int a_off = 0;
-    int idx;
-    int table_size;
-    int done_flag = 0;
-    table_size = tree->table_size;
+    int end;
+    int stride;
+    stride = tree->stride;
+    // nodes end on a multiple of stride, the bits past that pick an inner slot
+    end = key_len - key_len % stride;
     node = tree->root;
-    for (off = 0; off < key_len; )
+    for (off = 0; off < end; )
     {
-        if (node->table == NULL)
-        {
-            new_node = new_bit_radix_tree_node(get_bit(key, off),
-                key,
-                off,
-                key_len);
-            bit_radix_tree_put_child_node(tree, node, get_bit(key, off), new_node);
-            node = new_node;
-            break;
-        }
-
-        idx = get_bit(key, off) % table_size;
-        for (p_node = &node->table[idx]; 
-            *p_node != NULL; 
-            p_node = &(*p_node)->next)
+        p_node = NULL;
+        if (node->table != NULL)
         {
-            if (get_bit(key, off) == (*p_node)->key)
+            for (p_node = bit_radix_tree_bucket(node, get_chunk(key, off, stride));
+                *p_node != NULL;
+                p_node = &(*p_node)->next)
             {
-                break;
+                if (get_chunk(key, off, stride) == (*p_node)->key)
+                {
+                    break;
+                }
             }
         }
 
-        if (*p_node == NULL)
+        if (p_node == NULL || *p_node == NULL)
         {
-            *p_node = new_bit_radix_tree_node(get_bit(key, off), key, off, key_len);
-            node = *p_node;
+            new_node = new_bit_radix_tree_node(tree, get_chunk(key, off, stride),
+                key,
+                off,
+                end);
+            bit_radix_tree_put_child_node(tree, node, get_chunk(key, off, stride), new_node);
+            node = new_node;
             break;
         }
 
         node = *p_node;
 
-        a_off = 0;
-        while (off < key_len && a_off + node->keys_off < node->keys_len
-            && get_bit(key, off) == get_bit(node->keys, node->keys_off + a_off))
-        {
-            off++;
-            a_off++;
-        }
+        a_off = bit_radix_tree_match_label(node, key, off, end);
+        a_off -= a_off % stride;
+        off += a_off;
 
         if (a_off + node->keys_off < node->keys_len)
         {
             bit_radix_tree_node_t *rest;
-            rest = new_bit_radix_tree_node(get_bit(node->keys, node->keys_off + a_off),
+            rest = new_bit_radix_tree_node(tree, get_chunk(node->keys, node->keys_off + a_off, stride),
                 node->keys,
-                a_off,
+                node->keys_off + a_off,
                 node->keys_len);
             rest->table = node->table;
             rest->table_items = node->table_items;
+            rest->table_size = node->table_size;
             rest->value = node->value;
+            rest->inner = node->inner;
+            rest->inner_items = node->inner_items;
             node->table = NULL;
             node->table_items = 0;
+            node->table_size = 0;
             node->keys_len = node->keys_off + a_off;
             node->value = NULL;
-            bit_radix_tree_put_child_node(tree, node, get_bit(node->keys, node->keys_off + a_off), rest);
+            node->inner = NULL;
+            node->inner_items = 0;
+            bit_radix_tree_put_child_node(tree, node, rest->key, rest);
 
-            if (off < key_len)
+            if (off < end)
             {
-                new_node = new_bit_radix_tree_node(get_bit(key, off),
+                new_node = new_bit_radix_tree_node(tree, get_chunk(key, off, stride),
                     key,
                     off,
-                    key_len);
-                bit_radix_tree_put_child_node(tree, node, get_bit(key, off), new_node);
+                    end);
+                bit_radix_tree_put_child_node(tree, node, get_chunk(key, off, stride), new_node);
                 node = new_node;
             }
 
@@ -254,42 +419,71 @@ void bit_radix_tree_insert(bit_radix_tree_t *tree,
         }
     }
 
-    if (node != NULL)
+    if (node == NULL)
     {
-        if (node->value != NULL && tree->delete_leaf)
-        {
-            tree->delete_leaf(node->value);
-        }
+        return NULL;
+    }
 
-        if (tree->copy_leaf != NULL)
+    if (key_len > end && node->inner == NULL)
+    {
+        node->inner = (void **)bit_radix_tree_malloc(tree, BIT_RADIX_INNER_SLOTS(stride) * sizeof(void *));
+        if (node->inner == NULL)
         {
-            node->value = tree->copy_leaf(value);
+            return NULL;
         }
-        else
-        {
-            node->value = value;
-        } 
+        memset(node->inner, 0, BIT_RADIX_INNER_SLOTS(stride) * sizeof(void *));
+    }
+    slot = bit_radix_tree_slot(node, key, end, key_len);
+
+    old = *slot;
+    if (tree->copy_leaf != NULL)
+    {
+        *slot = tree->copy_leaf(value);
     }
+    else
+    {
+        *slot = value;
+    }
+    if (slot != &node->value)
+    {
+        node->inner_items += (*slot != NULL) - (old != NULL);
+    }
+    return old;
 }
 
-void *bit_radix_tree_exact_match(bit_radix_tree_t *tree, const unsigned char *key, int key_len)
+void bit_radix_tree_insert(bit_radix_tree_t *tree,
+    const unsigned char *key,
+    int key_len,
+    void *value)
+{
+    void *old;
+    old = bit_radix_tree_replace(tree, key, key_len, value);
+    if (old != NULL && tree->delete_leaf)
+    {
+        tree->delete_leaf(old);
+    }
+}
+
+/* node that ends exactly at key_len bits of key, with or without a value;
+   key_len has to be a multiple of the stride */
+static bit_radix_tree_node_t *bit_radix_tree_find_node(bit_radix_tree_t *tree, const unsigned char *key, int key_len)
 {
     bit_radix_tree_node_t *node;
+    unsigned char chunk;
     int off = 0;
     int a_off = 0;
-    int idx;
     node = tree->root;
     while (off < key_len)
     {
         if (node->table == NULL)
         {
-            break;
+            return NULL;
         }
 
-        idx = get_bit(key, off) % tree->table_size;
-        for (node = node->table[idx]; node != NULL; node = node->next)
+        chunk = get_chunk(key, off, tree->stride);
+        for (node = *bit_radix_tree_bucket(node, chunk); node != NULL; node = node->next)
         {
-            if (get_bit(key, off) == node->key)
+            if (chunk == node->key)
             {
                 break;
             }
@@ -297,33 +491,38 @@ void *bit_radix_tree_exact_match(bit_radix_tree_t *tree, const unsigned char *ke
 
         if (node == NULL)
         {
-            break;
+            return NULL;
         }
 
-        a_off = 0;
-        while (off < key_len && a_off + node->keys_off < node->keys_len
-            && get_bit(key, off) == get_bit(node->keys, node->keys_off + a_off))
-        {
-            off++;
-            a_off++;
-        }
+        a_off = bit_radix_tree_match_label(node, key, off, key_len);
+        off += a_off;
 
         if (a_off + node->keys_off < node->keys_len)
         {
-            node = NULL;
-            break;
+            return NULL;
         }
     }
 
-    if (off == key_len && node != NULL && node->value != NULL)
+    return node;
+}
+
+void *bit_radix_tree_exact_match(bit_radix_tree_t *tree, const unsigned char *key, int key_len)
+{
+    bit_radix_tree_node_t *node;
+    void **slot;
+    int end;
+    end = key_len - key_len % tree->stride;
+    node = bit_radix_tree_find_node(tree, key, end);
+    slot = node != NULL ? bit_radix_tree_slot(node, key, end, key_len) : NULL;
+    if (slot != NULL && *slot != NULL)
     {
         if (tree->copy_leaf != NULL)
         {
-            return tree->copy_leaf(node->value);
+            return tree->copy_leaf(*slot);
         }
         else
         {
-            return node->value;
+            return *slot;
         }
     }
     else
@@ -335,69 +534,71 @@ void *bit_radix_tree_exact_match(bit_radix_tree_t *tree, const unsigned char *ke
 int bit_radix_tree_prefix_match(bit_radix_tree_t *tree, const unsigned char *key, int key_len, void **value)
 {
     bit_radix_tree_node_t *node;
-    bit_radix_tree_node_t *last;
+    unsigned char chunk;
+    void *last;
+    void *v;
     int off = 0;
     int a_off = 0;
-    int idx;
+    int end;
     int nc = 0;
+    int r;
+    end = key_len - key_len % tree->stride;
     node = tree->root;
     last = NULL;
-    if (node->value != NULL)
+    for (;;)
     {
-        last = node;
-        nc++;
-    }
-    while (off < key_len)
-    {
-        if (node->table == NULL)
+        if (node->value != NULL)
         {
-            break;
+            last = node->value;
+            nc++;
         }
-
-        idx = get_bit(key, off) % tree->table_size;
-        for (node = node->table[idx]; node != NULL; node = node->next)
+        for (r = 1; node->inner != NULL && r < tree->stride && off + r <= key_len; r++)
         {
-            if (get_bit(key, off) == node->key)
+            v = node->inner[BIT_RADIX_INNER(r, get_chunk(key, off, r))];
+            if (v != NULL)
             {
-                break;
+                last = v;
+                nc++;
             }
         }
 
-        if (node == NULL)
+        if (off >= end || node->table == NULL)
         {
             break;
         }
 
-        a_off = 0;
-        while (off < key_len && a_off + node->keys_off < node->keys_len
-            && get_bit(key, off) == get_bit(node->keys, node->keys_off + a_off))
+        chunk = get_chunk(key, off, tree->stride);
+        for (node = *bit_radix_tree_bucket(node, chunk); node != NULL; node = node->next)
         {
-            off++;
-            a_off++;
+            if (chunk == node->key)
+            {
+                break;
+            }
         }
 
-        if (a_off + node->keys_off < node->keys_len)
+        if (node == NULL)
         {
-            node = NULL;
             break;
         }
 
-        if (node->value != NULL)
+        a_off = bit_radix_tree_match_label(node, key, off, end);
+        off += a_off;
+
+        if (a_off + node->keys_off < node->keys_len)
         {
-            last = node;
-            nc++;
+            break;
         }
     }
 
-    if (last != NULL && last->value != NULL)
+    if (last != NULL)
     {
         if (tree->copy_leaf != NULL)
         {
-            *value =  tree->copy_leaf(last->value);
+            *value =  tree->copy_leaf(last);
         }
         else
         {
-            *value = last->value;
+            *value = last;
         }
     }
     else
@@ -408,56 +609,61 @@ int bit_radix_tree_prefix_match(bit_radix_tree_t *tree, const unsigned char *key
     return nc;
 }
 
-void bit_radix_tree_merge_node(bit_radix_tree_node_t *node)
+/* folds the single child of a node that has neither a value nor inner
+   slots into it. Both labels end on a multiple of the stride, and the
+   child label starts in the byte the node label ends in, so the merged
+   label is the node bytes up to that one followed by the child bytes */
+static void bit_radix_tree_merge_node(bit_radix_tree_t *tree, bit_radix_tree_node_t *node)
 {
     bit_radix_tree_node_t *child = NULL;
-    char *keys;
+    unsigned char *keys;
+    unsigned char mask;
+    int head;
     int keys_len;
-    while (node->table_items == 1 && node->value != NULL)
+    int i;
+
+    if (node == tree->root || node->value != NULL || node->inner != NULL || node->table_items != 1)
     {
-        for (int i = 0; i < node->table_items; i++)
-        {
-            if (node->table[i] != NULL)
-            {
-                child = node->table[i];
-                break;
-            }
-        }
-        assert (child != NULL);
-        keys_len = node->keys_len + child->keys_len;
-        keys = merge_bitstr(node->keys, 
-            node->keys_off, 
-            node->keys_len, 
-            child->keys, 
-            child->keys_off,
-            child->keys_len);
-        node->keys = keys;
-        node->keys_len = keys_len;
-        free(node->table);
-        node->table_items = child->table_items;
-        node->table = child->table;
-        node->value = child->value;
-        child->table_items = 0;
-        child->table = NULL;
-        child->value = NULL;
-        free_bit_radix_tree_node(NULL, child);
+        return;
     }
-}
+    for (i = 0; i < node->table_size && child == NULL; i++)
+    {
+        child = node->table[i];
+    }
+    assert(child != NULL && child->next == NULL);
 
-void bit_radix_tree_unmap_node(bit_radix_tree_t *tree, bit_radix_tree_node_t *parent, bit_radix_tree_node_t *node)
-{
-    if (node->value != NULL)
+    head = node->keys_len / OFFSET_UNIT;
+    keys_len = node->keys_len + child->keys_len - child->keys_off;
+    keys = (unsigned char *)bit_radix_tree_malloc(tree, BIT_RADIX_KEYS_BYTES(keys_len));
+    if (keys == NULL)
     {
-        if (tree->delete_leaf != NULL)
-        {
-            tree->delete_leaf(node->value);
-        }
-        node->value = NULL;
+        return;
     }
-    if (parent != NULL)
+    memcpy(keys, node->keys, head);
+    memcpy(keys + head, child->keys, BIT_RADIX_KEYS_BYTES(child->keys_len));
+    if (node->keys_len % OFFSET_UNIT != 0)
     {
-        parent->table_items--;
+        mask = (unsigned char)((1 << (node->keys_len % OFFSET_UNIT)) - 1);
+        keys[head] = (unsigned char)((node->keys[head] & mask) | (child->keys[0] & ~mask));
     }
+
+    bit_radix_tree_mfree(tree, node->keys, BIT_RADIX_KEYS_BYTES(node->keys_len));
+    node->keys = keys;
+    node->keys_len = keys_len;
+    bit_radix_tree_free_table(tree, node);
+    node->table = child->table;
+    node->table_size = child->table_size;
+    node->table_items = child->table_items;
+    node->value = child->value;
+    node->inner = child->inner;
+    node->inner_items = child->inner_items;
+    child->table = NULL;
+    child->table_size = 0;
+    child->table_items = 0;
+    child->value = NULL;
+    child->inner = NULL;
+    child->inner_items = 0;
+    free_bit_radix_tree_node(tree, child);
 }
 
 void bit_radix_tree_remove(bit_radix_tree_t *tree, const unsigned char *key, int key_len, void **value)
@@ -465,45 +671,44 @@ void bit_radix_tree_remove(bit_radix_tree_t *tree, const unsigned char *key, int
     bit_radix_tree_node_t *parent = NULL;
     bit_radix_tree_node_t **p_node;
     bit_radix_tree_node_t *node;
+    unsigned char chunk;
+    void **slot;
     int off = 0;
     int a_off = 0;
-    int idx;
+    int end;
+    end = key_len - key_len % tree->stride;
     p_node = &tree->root;
     node = tree->root;
     parent = NULL;
-    while (off < key_len)
+    while (off < end)
     {
         parent = node;
 
         if (node->table == NULL)
         {
+            node = NULL;
             break;
         }
 
-        idx = get_bit(key, off) % tree->table_size;
-        for (p_node = &node->table[idx]; 
+        chunk = get_chunk(key, off, tree->stride);
+        for (p_node = bit_radix_tree_bucket(node, chunk);
             (*p_node) != NULL; 
-            (*p_node) = (*p_node)->next)
+            p_node = &(*p_node)->next)
         {
-            node = *p_node;
-            if (get_bit(key, off) == node->key)
+            if (chunk == (*p_node)->key)
             {
                 break;
             }
         }
 
+        node = *p_node;
         if (node == NULL)
         {
             break;
         }
 
-        a_off = 0;
-        while (off < key_len && a_off + node->keys_off < node->keys_len
-            && get_bit(key, off) == get_bit(node->keys, node->keys_off + a_off))
-        {
-            off++;
-            a_off++;
-        }
+        a_off = bit_radix_tree_match_label(node, key, off, end);
+        off += a_off;
 
         if (a_off + node->keys_off < node->keys_len)
         {
@@ -511,31 +716,35 @@ void bit_radix_tree_remove(bit_radix_tree_t *tree, const unsigned char *key, int
             break;
         }
     }
-    
-    if (node != NULL)
+
+    slot = node != NULL ? bit_radix_tree_slot(node, key, end, key_len) : NULL;
+    if (slot == NULL)
     {
-        *value = node->value;
-        node->value = NULL;
+        *value = NULL;
+        return;
+    }
 
-        if (node->table_items == 0)
-        {
-            (*p_node) = node->next;
-            node->next = NULL;
-            free_bit_radix_tree_node(tree, node);
-            parent->table_items--;
-        }
-        else
-        {
-            bit_radix_tree_unmap_node(tree, parent, node);
-            if (parent != NULL)
-            {
-                bit_radix_tree_merge_node(parent);
-            }
-        }
+    *value = *slot;
+    *slot = NULL;
+    if (slot != &node->value && *value != NULL && --node->inner_items == 0)
+    {
+        bit_radix_tree_free_inner(tree, node);
+    }
+
+    // an empty node goes, and a branch left with one child and nothing
+    // else is merged into it so the path stays compressed
+    if (parent != NULL && node->table_items == 0 && node->value == NULL && node->inner == NULL)
+    {
+        (*p_node) = node->next;
+        node->next = NULL;
+        free_bit_radix_tree_node(tree, node);
+        parent->table_items--;
+        bit_radix_tree_shrink_table(tree, parent);
+        bit_radix_tree_merge_node(tree, parent);
     }
     else
     {
-        *value = NULL;
+        bit_radix_tree_merge_node(tree, node);
     }
 }
 
@@ -551,7 +760,47 @@ void bit_radix_tree_erase(bit_radix_tree_t *tree, const unsigned char *key, int
 
 void bit_radix_tree_clear(bit_radix_tree_t *tree)
 {
-    bit_radix_tree_clear_children(tree, tree->root);
+    void *value;
+    int i;
+
+    if (tree->arena == NULL)
+    {
+        bit_radix_tree_clear_children(tree, tree->root);
+        return;
+    }
+
+    for (i = 0; tree->delete_leaf != NULL && i < tree->root->table_size; i++)
+    {
+        bit_radix_tree_delete_values(tree, tree->root->table[i]);
+    }
+    for (i = 0; tree->delete_leaf != NULL && tree->root->inner != NULL && i < BIT_RADIX_INNER_SLOTS(tree->stride); i++)
+    {
+        if (tree->root->inner[i] != NULL)
+        {
+            tree->delete_leaf(tree->root->inner[i]);
+        }
+    }
+
+    value = tree->root->value;
+    radix_arena_reset(tree->arena);
+    tree->root = new_bit_radix_tree_node(tree, 0, NULL, 0, 0);
+    if (tree->root != NULL)
+    {
+        tree->root->value = value;
+    }
+}
+
+static void bit_radix_tree_setup(bit_radix_tree_t *tree,
+    bit_radix_copy_fn copy_leaf,
+    bit_radix_destruct_fn delete_leaf,
+    radix_arena_t *arena)
+{
+    tree->copy_leaf = copy_leaf;
+    tree->delete_leaf = delete_leaf;
+    tree->table_size = 2;
+    tree->stride = 1;
+    tree->arena = arena;
+    tree->root = new_bit_radix_tree_node(tree, 0, NULL, 0, 0);
 }
 
 void bit_radix_tree_init(bit_radix_tree_t *tree, 
@@ -559,10 +808,25 @@ void bit_radix_tree_init(bit_radix_tree_t *tree,
     bit_radix_copy_fn copy_leaf, 
     bit_radix_destruct_fn delete_leaf)
 {
-    tree->copy_leaf = copy_leaf;
-    tree->delete_leaf = delete_leaf;
-    tree->table_size = table_size;
-    tree->root = new_bit_radix_tree_node(0, NULL, 0, 0);
+    bit_radix_tree_setup(tree, copy_leaf, delete_leaf, NULL);
+}
+
+/* branches on stride bits per level instead of one, with tables of up
+   to 2^stride slots: fewer levels for long keys at the cost of wider nodes.
+   stride is 1, 2, 4 or 8; only possible while every key is shorter
+   than a bit, returns -1 otherwise */
+int bit_radix_tree_set_stride(bit_radix_tree_t *tree, int stride)
+{
+    if ((stride != 1 && stride != 2 && stride != 4 && stride != 8)
+        || tree->root->table_items > 0 || tree->root->inner != NULL)
+    {
+        return -1;
+    }
+
+    bit_radix_tree_free_table(tree, tree->root);
+    tree->stride = stride;
+    tree->table_size = 1 << stride;
+    return 0;
 }
 
 bit_radix_tree_t *bit_radix_tree_create(int table_size, bit_radix_copy_fn copy_leaf, bit_radix_destruct_fn delete_leaf)
@@ -576,8 +840,223 @@ bit_radix_tree_t *bit_radix_tree_create(int table_size, bit_radix_copy_fn copy_l
     return tree;
 }
 
+bit_radix_tree_t *bit_radix_tree_create_arena(int table_size,
+    bit_radix_copy_fn copy_leaf,
+    bit_radix_destruct_fn delete_leaf,
+    int block_size)
+{
+    bit_radix_tree_t *tree;
+    radix_arena_t *arena;
+    tree = malloc(sizeof(bit_radix_tree_t));
+    if (tree != NULL)
+    {
+        arena = radix_arena_create(block_size > 0 ? (size_t)block_size : 0);
+        if (arena == NULL)
+        {
+            free(tree);
+            return NULL;
+        }
+        bit_radix_tree_setup(tree, copy_leaf, delete_leaf, arena);
+    }
+    return tree;
+}
+
+typedef struct
+{
+    bit_radix_tree_t *trees;    // one per leading byte
+    bit_radix_tree_t *tree;
+    radix_arena_t *arena;
+    const unsigned char **keys;
+    const int *lens;
+    void **values;
+    int n;
+} bit_radix_build_part_t;
+
+/* every leading byte gets a tree of its own, so the single child of its
+   root spans at least those 8 bits and never shares a path with another */
+static void *bit_radix_tree_build_part(void *arg)
+{
+    bit_radix_build_part_t *part = (bit_radix_build_part_t *)arg;
+    bit_radix_tree_t *tree;
+    int i;
+
+    for (i = 0; i < part->n; i++)
+    {
+        tree = &part->trees[part->keys[i][0]];
+        if (tree->root == NULL)
+        {
+            bit_radix_tree_setup(tree, part->tree->copy_leaf, part->tree->delete_leaf, part->arena);
+            tree->stride = part->tree->stride;
+            tree->table_size = part->tree->table_size;
+        }
+        if (tree->root != NULL)
+        {
+            bit_radix_tree_insert(tree, part->keys[i], part->lens[i], part->values[i]);
+        }
+    }
+    return NULL;
+}
+
+/* hangs the subtree below the root of from into tree: its path is
+   inserted with a placeholder value, which gives a new node ending where
+   the subtree starts, and that node then takes over table and value */
+static void bit_radix_tree_graft(bit_radix_tree_t *tree, bit_radix_tree_t *from)
+{
+    bit_radix_tree_node_t *top = NULL;
+    bit_radix_tree_node_t *node;
+    bit_radix_copy_fn copy_leaf;
+    int i;
+
+    for (i = 0; i < from->root->table_size && top == NULL; i++)
+    {
+        top = from->root->table[i];
+    }
+
+    if (top != NULL)
+    {
+        copy_leaf = tree->copy_leaf;
+        tree->copy_leaf = NULL;
+        bit_radix_tree_insert(tree, top->keys, top->keys_len, top);
+        tree->copy_leaf = copy_leaf;
+
+        node = bit_radix_tree_find_node(tree, top->keys, top->keys_len);
+        if (node != NULL && node->value == top && node->table == NULL && node->inner == NULL)
+        {
+            node->table = top->table;
+            node->table_items = top->table_items;
+            node->table_size = top->table_size;
+            node->value = top->value;
+            node->inner = top->inner;
+            node->inner_items = top->inner_items;
+            top->table = NULL;
+            top->table_items = 0;
+            top->table_size = 0;
+            top->value = NULL;
+            top->inner = NULL;
+            top->inner_items = 0;
+        }
+        else if (node != NULL && node->value == top)
+        {
+            node->value = NULL;
+        }
+    }
+
+    free_bit_radix_tree_node(from, from->root);
+    from->root = NULL;
+}
+
+/* builds the tree from keys split by their leading byte on up to threads
+   threads, keys shorter than a byte are inserted afterwards. The tree has
+   to be empty, otherwise the keys are inserted on the calling thread */
+void bit_radix_tree_parallel_load(bit_radix_tree_t *tree,
+    const unsigned char **keys,
+    const int *lens,
+    void **values,
+    int n,
+    int threads)
+{
+    radix_partition_t partition;
+    bit_radix_build_part_t *parts;
+    bit_radix_tree_t *trees;
+    radix_thread_t *handles;
+    int started;
+    int i;
+
+    parts = NULL;
+    handles = NULL;
+    trees = NULL;
+    if (threads > 1 && tree->root->table_items == 0
+        && radix_partition_init(&partition, keys, lens, values, n, OFFSET_UNIT, threads))
+    {
+        parts = (bit_radix_build_part_t *)calloc(partition.parts, sizeof(bit_radix_build_part_t));
+        handles = (radix_thread_t *)calloc(partition.parts, sizeof(radix_thread_t));
+        trees = (bit_radix_tree_t *)calloc(RADIX_PARTITION_MAX, sizeof(bit_radix_tree_t));
+        if (parts == NULL || handles == NULL || trees == NULL)
+        {
+            radix_partition_release(&partition);
+            free(parts);
+            parts = NULL;
+        }
+    }
+
+    if (parts == NULL)
+    {
+        free(handles);
+        free(trees);
+        for (i = 0; i < n; i++)
+        {
+            bit_radix_tree_insert(tree, keys[i], lens[i], values[i]);
+        }
+        return;
+    }
+
+    for (i = 0; i < partition.parts; i++)
+    {
+        parts[i].trees = trees;
+        parts[i].tree = tree;
+        parts[i].arena = tree->arena != NULL ? radix_arena_create(tree->arena->block_size) : NULL;
+        parts[i].keys = partition.keys + partition.bounds[i];
+        parts[i].lens = partition.lens + partition.bounds[i];
+        parts[i].values = partition.values + partition.bounds[i];
+        parts[i].n = partition.bounds[i + 1] - partition.bounds[i];
+    }
+
+    started = 1;
+    while (started < partition.parts
+        && radix_thread_create(&handles[started], bit_radix_tree_build_part, &parts[started]) == 0)
+    {
+        started++;
+    }
+    bit_radix_tree_build_part(&parts[0]);
+    for (i = started; i < partition.parts; i++)
+    {
+        bit_radix_tree_build_part(&parts[i]);
+    }
+    for (i = 1; i < started; i++)
+    {
+        radix_thread_join(handles[i]);
+    }
+
+    for (i = 0; i < RADIX_PARTITION_MAX; i++)
+    {
+        if (trees[i].root != NULL)
+        {
+            bit_radix_tree_graft(tree, &trees[i]);
+        }
+    }
+
+    for (i = 0; i < partition.parts; i++)
+    {
+        if (parts[i].arena != NULL)
+        {
+            radix_arena_merge(tree->arena, parts[i].arena);
+        }
+    }
+
+    for (i = partition.n; i < partition.n + partition.short_n; i++)
+    {
+        bit_radix_tree_insert(tree, partition.keys[i], partition.lens[i], partition.values[i]);
+    }
+
+    radix_partition_release(&partition);
+    free(parts);
+    free(handles);
+    free(trees);
+}
+
 void bit_radix_tree_destroy(bit_radix_tree_t *tree)
 {
+    if (tree->arena != NULL)
+    {
+        if (tree->delete_leaf != NULL && tree->root != NULL)
+        {
+            bit_radix_tree_delete_values(tree, tree->root);
+        }
+        radix_arena_destroy(tree->arena);
+        free(tree);
+        return;
+    }
+
     bit_radix_tree_clear(tree);
     if (tree->root)
     {
@@ -599,14 +1078,11 @@ void bit_radix_tree_dump_node(bit_radix_tree_t *tree,
     printf(" - %s => [%s]\n", keys, node->value ? (char *)node->value : "");
     free(keys);
 
-    if (node->table != NULL)
+    for (i = 0; i < node->table_size; i++)
     {
-        for (i = 0; i < tree->table_size; i++)
+        if (node->table[i] != NULL)
         {
-            if (node->table[i] != NULL)
-            {
-                bit_radix_tree_dump_node(tree, node->table[i], level + 1);
-            }
+            bit_radix_tree_dump_node(tree, node->table[i], level + 1);
         }
     }
 
@@ -1,6 +1,8 @@
 #ifndef BIT_RADIX_TREE_H
 #define BIT_RADIX_TREE_H
 
+#include "radix_arena.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif  /* __cplusplus */
@@ -9,11 +11,15 @@ typedef struct _bit_radix_tree_node
 {
     struct _bit_radix_tree_node *next; //sibling
     unsigned char key;
+    unsigned short table_size; // slots in table, a power of two
     unsigned char *keys;
     int keys_off;
     int keys_len;
     void *value;
-    // children
+    // keys ending 1 to stride - 1 bits past the node, r bits b at (1 << r) - 2 + b
+    void **inner;
+    int inner_items;
+    // children, chained by next
     int table_items;
     struct _bit_radix_tree_node **table;
 } bit_radix_tree_node_t;
@@ -24,14 +30,20 @@ typedef void (*bit_radix_destruct_fn)(void *);
 typedef struct
 {
     bit_radix_tree_node_t *root;
-    int table_size;
+    int table_size;       // largest child table, 1 << stride; tables are sized per node
+    int stride;           // key bits per level, every node ends on a multiple
     bit_radix_copy_fn copy_leaf;
     bit_radix_destruct_fn delete_leaf;
+    radix_arena_t *arena; // NULL when nodes come from malloc
 } bit_radix_tree_t;
 
 bit_radix_tree_t *bit_radix_tree_create(int table_size, bit_radix_copy_fn copy_leaf, bit_radix_destruct_fn delete_leaf);
+bit_radix_tree_t *bit_radix_tree_create_arena(int table_size, bit_radix_copy_fn copy_leaf, bit_radix_destruct_fn delete_leaf, int block_size);
 void bit_radix_tree_init(bit_radix_tree_t *tree, int table_size, bit_radix_copy_fn copy_leaf, bit_radix_destruct_fn delete_leaf);
+int bit_radix_tree_set_stride(bit_radix_tree_t *tree, int stride);
 void bit_radix_tree_insert(bit_radix_tree_t *tree, const unsigned char *key, int key_len, void *value);
+void *bit_radix_tree_replace(bit_radix_tree_t *tree, const unsigned char *key, int key_len, void *value);
+void bit_radix_tree_parallel_load(bit_radix_tree_t *tree, const unsigned char **keys, const int *lens, void **values, int n, int threads);
 void *bit_radix_tree_exact_match(bit_radix_tree_t *tree, const unsigned char *key, int key_len);
 int bit_radix_tree_prefix_match(bit_radix_tree_t *tree, const unsigned char *key, int key_len, void **value);
 void bit_radix_tree_remove(bit_radix_tree_t *tree, const unsigned char *key, int key_len, void **value);
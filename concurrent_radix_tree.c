@@ -0,0 +1,256 @@
+#include "concurrent_radix_tree.h"
+#include "radix_log.h"
+#include <stdlib.h>
+
+static concurrent_radix_tree_t *concurrent_radix_tree_setup(radix_copy_fn copy_leaf,
+    radix_destruct_fn delete_leaf,
+    int fine_grained)
+{
+    concurrent_radix_tree_t *tree;
+    tree = (concurrent_radix_tree_t *)malloc(sizeof(concurrent_radix_tree_t));
+    if (tree != NULL)
+    {
+        radix_tree_init(&tree->tree, 0, copy_leaf, delete_leaf);
+        if (tree->tree.root == NULL)
+        {
+            free(tree);
+            return NULL;
+        }
+        radix_epoch_init(&tree->epoch);
+        radix_mutex_init(&tree->write_lock);
+        tree->tree.epoch = &tree->epoch;
+        tree->fine_grained = fine_grained;
+    }
+    return tree;
+}
+
+concurrent_radix_tree_t *concurrent_radix_tree_create(radix_copy_fn copy_leaf, radix_destruct_fn delete_leaf)
+{
+    return concurrent_radix_tree_setup(copy_leaf, delete_leaf, 0);
+}
+
+/* for many writers on disjoint keys, the tree has to stay on malloc
+   since nodes are freed from whichever writer reclaims them */
+concurrent_radix_tree_t *concurrent_radix_tree_create_olc(radix_copy_fn copy_leaf, radix_destruct_fn delete_leaf)
+{
+    return concurrent_radix_tree_setup(copy_leaf, delete_leaf, 1);
+}
+
+void concurrent_radix_tree_insert(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len, void *value)
+{
+    int slot;
+
+    // a logged tree takes the write lock, so the log order is the order
+    // the mutations were applied in
+    if (tree->fine_grained && tree->tree.log == NULL)
+    {
+        // writers walk optimistically too and need the epoch as much as readers
+        slot = radix_epoch_enter(&tree->epoch);
+        radix_tree_insert_olc(&tree->tree, key, key_len, value);
+        radix_epoch_exit(&tree->epoch, slot);
+        return;
+    }
+
+    radix_mutex_lock(&tree->write_lock);
+    radix_tree_insert(&tree->tree, key, key_len, value);
+    radix_mutex_unlock(&tree->write_lock);
+}
+
+/* copy_leaf runs inside the read section, so a value that is being
+   replaced concurrently is still alive while it is copied */
+void *concurrent_radix_tree_exact_match(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len)
+{
+    void *value;
+    int slot;
+    slot = radix_epoch_enter(&tree->epoch);
+    value = radix_tree_exact_match(&tree->tree, key, key_len);
+    radix_epoch_exit(&tree->epoch, slot);
+    return value;
+}
+
+int concurrent_radix_tree_prefix_match(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len, void **value)
+{
+    int nc;
+    int slot;
+    slot = radix_epoch_enter(&tree->epoch);
+    nc = radix_tree_prefix_match(&tree->tree, key, key_len, value);
+    radix_epoch_exit(&tree->epoch, slot);
+    return nc;
+}
+
+/* opens a read section for the _borrow lookups, whose values stay valid
+   until the returned slot is passed to concurrent_radix_tree_read_exit */
+int concurrent_radix_tree_read_enter(concurrent_radix_tree_t *tree)
+{
+    return radix_epoch_enter(&tree->epoch);
+}
+
+void concurrent_radix_tree_read_exit(concurrent_radix_tree_t *tree, int slot)
+{
+    radix_epoch_exit(&tree->epoch, slot);
+}
+
+const void *concurrent_radix_tree_exact_match_borrow(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len)
+{
+    return radix_tree_exact_match_borrow(&tree->tree, key, key_len);
+}
+
+int concurrent_radix_tree_prefix_match_borrow(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len, const void **value)
+{
+    return radix_tree_prefix_match_borrow(&tree->tree, key, key_len, value);
+}
+
+void concurrent_radix_tree_exact_match_batch(concurrent_radix_tree_t *tree,
+    const unsigned char **keys,
+    const int *lens,
+    int n,
+    void **values)
+{
+    int slot;
+    slot = radix_epoch_enter(&tree->epoch);
+    radix_tree_exact_match_batch(&tree->tree, keys, lens, n, values);
+    radix_epoch_exit(&tree->epoch, slot);
+}
+
+void concurrent_radix_tree_prefix_match_batch(concurrent_radix_tree_t *tree,
+    const unsigned char **keys,
+    const int *lens,
+    int n,
+    void **values,
+    int *ncs)
+{
+    int slot;
+    slot = radix_epoch_enter(&tree->epoch);
+    radix_tree_prefix_match_batch(&tree->tree, keys, lens, n, values, ncs);
+    radix_epoch_exit(&tree->epoch, slot);
+}
+
+/* the value is handed back as is, callers that share it with readers
+   must wait for concurrent_radix_tree_synchronize before freeing it */
+void concurrent_radix_tree_remove(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len, void **value)
+{
+    int slot;
+
+    if (tree->fine_grained && tree->tree.log == NULL)
+    {
+        slot = radix_epoch_enter(&tree->epoch);
+        radix_tree_remove_olc(&tree->tree, key, key_len, value);
+        radix_epoch_exit(&tree->epoch, slot);
+        return;
+    }
+
+    radix_mutex_lock(&tree->write_lock);
+    radix_tree_remove(&tree->tree, key, key_len, value);
+    radix_mutex_unlock(&tree->write_lock);
+}
+
+void concurrent_radix_tree_erase(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len)
+{
+    int slot;
+
+    if (tree->fine_grained && tree->tree.log == NULL)
+    {
+        slot = radix_epoch_enter(&tree->epoch);
+        radix_tree_erase_olc(&tree->tree, key, key_len);
+        radix_epoch_exit(&tree->epoch, slot);
+        return;
+    }
+
+    radix_mutex_lock(&tree->write_lock);
+    radix_tree_erase(&tree->tree, key, key_len);
+    radix_mutex_unlock(&tree->write_lock);
+}
+
+void concurrent_radix_tree_clear(concurrent_radix_tree_t *tree)
+{
+    int slot;
+
+    if (tree->fine_grained && tree->tree.log == NULL)
+    {
+        slot = radix_epoch_enter(&tree->epoch);
+        radix_tree_clear_olc(&tree->tree);
+        radix_epoch_exit(&tree->epoch, slot);
+        return;
+    }
+
+    radix_mutex_lock(&tree->write_lock);
+    radix_tree_clear(&tree->tree);
+    radix_mutex_unlock(&tree->write_lock);
+}
+
+void concurrent_radix_tree_set_lazy_remove(concurrent_radix_tree_t *tree, int lazy)
+{
+    radix_mutex_lock(&tree->write_lock);
+    radix_tree_set_lazy_remove(&tree->tree, lazy);
+    radix_mutex_unlock(&tree->write_lock);
+}
+
+int concurrent_radix_tree_compact(concurrent_radix_tree_t *tree, int budget)
+{
+    int left;
+
+    radix_mutex_lock(&tree->write_lock);
+    left = radix_tree_compact(&tree->tree, budget);
+    radix_mutex_unlock(&tree->write_lock);
+    return left;
+}
+
+/* the nodes of a snapshot stay put until it is released, so its view is
+   read without entering the epoch */
+radix_snapshot_t *concurrent_radix_tree_snapshot(concurrent_radix_tree_t *tree)
+{
+    radix_snapshot_t *snapshot;
+
+    if (tree->fine_grained)
+    {
+        return NULL;
+    }
+
+    radix_mutex_lock(&tree->write_lock);
+    snapshot = radix_tree_snapshot(&tree->tree);
+    radix_mutex_unlock(&tree->write_lock);
+    return snapshot;
+}
+
+void concurrent_radix_tree_snapshot_release(concurrent_radix_tree_t *tree, radix_snapshot_t *snapshot)
+{
+    radix_mutex_lock(&tree->write_lock);
+    radix_tree_snapshot_release(snapshot);
+    radix_mutex_unlock(&tree->write_lock);
+}
+
+/* writes a checkpoint of a logged tree; writers wait for it, readers
+   carry on */
+int concurrent_radix_tree_checkpoint(concurrent_radix_tree_t *tree, const char *path)
+{
+    int result;
+
+    if (tree->tree.log == NULL)
+    {
+        return -1;
+    }
+
+    radix_mutex_lock(&tree->write_lock);
+    result = radix_log_checkpoint(tree->tree.log, &tree->tree, path);
+    radix_mutex_unlock(&tree->write_lock);
+    return result;
+}
+
+/* waits for the readers that are currently inside and frees whatever
+   the writers retired before them */
+void concurrent_radix_tree_synchronize(concurrent_radix_tree_t *tree)
+{
+    radix_mutex_lock(&tree->write_lock);
+    radix_epoch_synchronize(&tree->epoch);
+    radix_mutex_unlock(&tree->write_lock);
+}
+
+/* no reader may be inside any more */
+void concurrent_radix_tree_destroy(concurrent_radix_tree_t *tree)
+{
+    radix_epoch_destroy(&tree->epoch);
+    tree->tree.epoch = NULL;
+    radix_tree_release(&tree->tree);
+    radix_mutex_destroy(&tree->write_lock);
+    free(tree);
+}
@@ -0,0 +1,54 @@
+#ifndef CONCURRENT_RADIX_TREE_H
+#define CONCURRENT_RADIX_TREE_H
+
+#include "radix_tree.h"
+#include "radix_epoch.h"
+#include "radix_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+// readers walk the tree without taking a lock, writers are serialized on
+// write_lock and hand replaced nodes and tables to the epoch; with
+// fine_grained set writers skip write_lock and lock single nodes instead
+typedef struct
+{
+    radix_tree_t tree;
+    radix_epoch_t epoch;
+    radix_mutex_t write_lock;
+    int fine_grained;
+} concurrent_radix_tree_t;
+
+concurrent_radix_tree_t *concurrent_radix_tree_create(radix_copy_fn copy_leaf, radix_destruct_fn delete_leaf);
+concurrent_radix_tree_t *concurrent_radix_tree_create_olc(radix_copy_fn copy_leaf, radix_destruct_fn delete_leaf);
+void concurrent_radix_tree_insert(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len, void *value);
+void *concurrent_radix_tree_exact_match(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len);
+int concurrent_radix_tree_prefix_match(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len, void **value);
+// borrowed values, only between read_enter and read_exit on the same thread
+int concurrent_radix_tree_read_enter(concurrent_radix_tree_t *tree);
+void concurrent_radix_tree_read_exit(concurrent_radix_tree_t *tree, int slot);
+const void *concurrent_radix_tree_exact_match_borrow(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len);
+int concurrent_radix_tree_prefix_match_borrow(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len, const void **value);
+void concurrent_radix_tree_exact_match_batch(concurrent_radix_tree_t *tree, const unsigned char **keys, const int *lens, int n, void **values);
+void concurrent_radix_tree_prefix_match_batch(concurrent_radix_tree_t *tree, const unsigned char **keys, const int *lens, int n, void **values, int *ncs);
+void concurrent_radix_tree_remove(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len, void **value);
+void concurrent_radix_tree_erase(concurrent_radix_tree_t *tree, const unsigned char *key, int key_len);
+void concurrent_radix_tree_clear(concurrent_radix_tree_t *tree);
+// see radix_tree_set_lazy_remove; removes on the optimistic writers of
+// concurrent_radix_tree_create_olc always tidy up at once. compact holds
+// write_lock for one call, so a background thread may call it in a loop
+void concurrent_radix_tree_set_lazy_remove(concurrent_radix_tree_t *tree, int lazy);
+int concurrent_radix_tree_compact(concurrent_radix_tree_t *tree, int budget);
+// NULL for a tree made with concurrent_radix_tree_create_olc
+radix_snapshot_t *concurrent_radix_tree_snapshot(concurrent_radix_tree_t *tree);
+void concurrent_radix_tree_snapshot_release(concurrent_radix_tree_t *tree, radix_snapshot_t *snapshot);
+int concurrent_radix_tree_checkpoint(concurrent_radix_tree_t *tree, const char *path);
+void concurrent_radix_tree_synchronize(concurrent_radix_tree_t *tree);
+void concurrent_radix_tree_destroy(concurrent_radix_tree_t *tree);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
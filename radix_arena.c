@@ -0,0 +1,178 @@
+#include "radix_arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RADIX_ARENA_ROUND(n) (((n) + RADIX_ARENA_ALIGN - 1) & ~((size_t)RADIX_ARENA_ALIGN - 1))
+#define RADIX_ARENA_HEADER RADIX_ARENA_ROUND(sizeof(radix_arena_block_t))
+
+static radix_arena_block_t *radix_arena_new_block(radix_arena_t *arena, size_t size)
+{
+    radix_arena_block_t *block;
+    block = (radix_arena_block_t *)malloc(RADIX_ARENA_HEADER + size);
+    if (block != NULL)
+    {
+        block->size = size;
+        arena->reserved += RADIX_ARENA_HEADER + size;
+    }
+    return block;
+}
+
+radix_arena_t *radix_arena_create(size_t block_size)
+{
+    radix_arena_t *arena;
+    arena = (radix_arena_t *)calloc(1, sizeof(radix_arena_t));
+    if (arena != NULL)
+    {
+        if (block_size < RADIX_ARENA_CLASSES * RADIX_ARENA_ALIGN)
+        {
+            block_size = RADIX_ARENA_BLOCK_SIZE;
+        }
+        arena->block_size = RADIX_ARENA_ROUND(block_size);
+    }
+    return arena;
+}
+
+void *radix_arena_alloc(radix_arena_t *arena, size_t size)
+{
+    radix_arena_block_t *block;
+    size_t cls;
+    void *p;
+
+    size = size == 0 ? RADIX_ARENA_ALIGN : RADIX_ARENA_ROUND(size);
+    cls = size / RADIX_ARENA_ALIGN - 1;
+    if (cls < RADIX_ARENA_CLASSES)
+    {
+        p = arena->free_list[cls];
+        if (p != NULL)
+        {
+            arena->free_list[cls] = *(void **)p;
+            return p;
+        }
+    }
+    else
+    {
+        // oversized requests get a block of their own behind the current one
+        block = radix_arena_new_block(arena, size);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        if (arena->blocks != NULL)
+        {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        }
+        else
+        {
+            block->next = NULL;
+            arena->blocks = block;
+        }
+        return (unsigned char *)block + RADIX_ARENA_HEADER;
+    }
+
+    if ((size_t)(arena->end - arena->cur) < size)
+    {
+        block = radix_arena_new_block(arena, arena->block_size);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->cur = (unsigned char *)block + RADIX_ARENA_HEADER;
+        arena->end = arena->cur + arena->block_size;
+    }
+
+    p = arena->cur;
+    arena->cur += size;
+    return p;
+}
+
+/* size may be smaller than the size the chunk was allocated with,
+   the chunk is then recycled through the smaller class; oversized
+   chunks stay put until radix_arena_reset */
+void radix_arena_free(radix_arena_t *arena, void *p, size_t size)
+{
+    size_t cls;
+
+    if (p == NULL)
+    {
+        return;
+    }
+
+    size = size == 0 ? RADIX_ARENA_ALIGN : RADIX_ARENA_ROUND(size);
+    cls = size / RADIX_ARENA_ALIGN - 1;
+    if (cls < RADIX_ARENA_CLASSES)
+    {
+        *(void **)p = arena->free_list[cls];
+        arena->free_list[cls] = p;
+    }
+}
+
+void radix_arena_reset(radix_arena_t *arena)
+{
+    radix_arena_block_t *block;
+    radix_arena_block_t *next;
+
+    for (block = arena->blocks; block != NULL; block = next)
+    {
+        next = block->next;
+        free(block);
+    }
+
+    arena->blocks = NULL;
+    arena->cur = NULL;
+    arena->end = NULL;
+    arena->reserved = 0;
+    memset(arena->free_list, 0, sizeof(arena->free_list));
+}
+
+/* takes over every block and free chunk of from and destroys it, memory
+   allocated from it now belongs to arena */
+void radix_arena_merge(radix_arena_t *arena, radix_arena_t *from)
+{
+    radix_arena_block_t *tail;
+    void *p;
+    int i;
+
+    if (from->blocks != NULL)
+    {
+        for (tail = from->blocks; tail->next != NULL; tail = tail->next);
+        if (arena->blocks != NULL)
+        {
+            // arena keeps carving from its current block, the rest of
+            // the current block of from is given up
+            tail->next = arena->blocks->next;
+            arena->blocks->next = from->blocks;
+        }
+        else
+        {
+            arena->blocks = from->blocks;
+            arena->cur = from->cur;
+            arena->end = from->end;
+        }
+        arena->reserved += from->reserved;
+    }
+
+    for (i = 0; i < RADIX_ARENA_CLASSES; i++)
+    {
+        p = from->free_list[i];
+        if (p != NULL)
+        {
+            while (*(void **)p != NULL)
+            {
+                p = *(void **)p;
+            }
+            *(void **)p = arena->free_list[i];
+            arena->free_list[i] = from->free_list[i];
+        }
+    }
+
+    free(from);
+}
+
+void radix_arena_destroy(radix_arena_t *arena)
+{
+    radix_arena_reset(arena);
+    free(arena);
+}
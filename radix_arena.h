@@ -0,0 +1,41 @@
+#ifndef RADIX_ARENA_H
+#define RADIX_ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+#define RADIX_ARENA_ALIGN           16
+#define RADIX_ARENA_CLASSES         128     // size classes up to 2 KB
+#define RADIX_ARENA_BLOCK_SIZE      (256 * 1024)
+
+typedef struct _radix_arena_block
+{
+    struct _radix_arena_block *next;
+    size_t size;
+} radix_arena_block_t;
+
+typedef struct
+{
+    radix_arena_block_t *blocks;
+    unsigned char *cur;
+    unsigned char *end;
+    size_t block_size;
+    size_t reserved;    // bytes held in blocks
+    void *free_list[RADIX_ARENA_CLASSES];
+} radix_arena_t;
+
+radix_arena_t *radix_arena_create(size_t block_size);
+void *radix_arena_alloc(radix_arena_t *arena, size_t size);
+void radix_arena_free(radix_arena_t *arena, void *p, size_t size);
+void radix_arena_reset(radix_arena_t *arena);
+void radix_arena_merge(radix_arena_t *arena, radix_arena_t *from);
+void radix_arena_destroy(radix_arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
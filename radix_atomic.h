@@ -0,0 +1,140 @@
+#ifndef RADIX_ATOMIC_H
+#define RADIX_ATOMIC_H
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <emmintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+/* pointer loads acquire and pointer stores release, which is all a
+   lock-free reader needs to see a node or table that was fully built
+   before it was published */
+#ifdef _MSC_VER
+
+static __inline void *radix_atomic_load_ptr(void *volatile const *p)
+{
+    void *v = *p;
+    _ReadWriteBarrier();
+    return v;
+}
+
+static __inline void radix_atomic_store_ptr(void *volatile *p, void *v)
+{
+    _ReadWriteBarrier();
+    *p = v;
+}
+
+static __inline unsigned char radix_atomic_load_uchar(volatile const unsigned char *p)
+{
+    unsigned char v = *p;
+    _ReadWriteBarrier();
+    return v;
+}
+
+static __inline void radix_atomic_store_uchar(volatile unsigned char *p, unsigned char v)
+{
+    _ReadWriteBarrier();
+    *p = v;
+}
+
+static __inline long radix_atomic_load_long(volatile const long *p)
+{
+    long v = *p;
+    _ReadWriteBarrier();
+    return v;
+}
+
+static __inline void radix_atomic_store_long(volatile long *p, long v)
+{
+    _ReadWriteBarrier();
+    *p = v;
+}
+
+static __inline int radix_atomic_cas_long(volatile long *p, long expected, long desired)
+{
+    return _InterlockedCompareExchange(p, desired, expected) == expected;
+}
+
+static __inline long radix_atomic_add_long(volatile long *p, long v)
+{
+    return _InterlockedExchangeAdd(p, v) + v;
+}
+
+static __inline void radix_atomic_fence(void)
+{
+    _mm_mfence();
+}
+
+static __inline void radix_cpu_relax(void)
+{
+    _mm_pause();
+}
+
+#else
+
+static __inline void *radix_atomic_load_ptr(void *volatile const *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static __inline void radix_atomic_store_ptr(void *volatile *p, void *v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static __inline unsigned char radix_atomic_load_uchar(volatile const unsigned char *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static __inline void radix_atomic_store_uchar(volatile unsigned char *p, unsigned char v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static __inline long radix_atomic_load_long(volatile const long *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static __inline void radix_atomic_store_long(volatile long *p, long v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static __inline int radix_atomic_cas_long(volatile long *p, long expected, long desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static __inline long radix_atomic_add_long(volatile long *p, long v)
+{
+    return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST);
+}
+
+static __inline void radix_atomic_fence(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static __inline void radix_cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+#endif
+
+#define RADIX_LOAD_PTR(p)       radix_atomic_load_ptr((void *volatile const *)&(p))
+#define RADIX_STORE_PTR(p, v)   radix_atomic_store_ptr((void *volatile *)&(p), (void *)(v))
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
@@ -0,0 +1,212 @@
+#include "radix_epoch.h"
+#include "radix_atomic.h"
+#include <stdlib.h>
+#include <string.h>
+
+static RADIX_THREAD_LOCAL int radix_epoch_hint = -1;
+
+/* a is older than b, tolerating wrap around */
+static __inline int radix_epoch_before(long a, long b)
+{
+    return (long)((unsigned long)a - (unsigned long)b) < 0;
+}
+
+static long radix_epoch_advance(radix_epoch_t *epoch)
+{
+    long g;
+    g = radix_atomic_add_long(&epoch->global, 1);
+    if (g == 0)
+    {
+        g = radix_atomic_add_long(&epoch->global, 1);
+    }
+    return g;
+}
+
+void radix_epoch_init(radix_epoch_t *epoch)
+{
+    memset(epoch, 0, sizeof(radix_epoch_t));
+    epoch->global = 1;
+    radix_mutex_init(&epoch->lock);
+}
+
+void radix_epoch_destroy(radix_epoch_t *epoch)
+{
+    radix_retired_t *r;
+    radix_retired_t *next;
+
+    for (r = epoch->retired; r != NULL; r = next)
+    {
+        next = r->next;
+        r->reclaim(r->ctx, r->ptr, r->size);
+        free(r);
+    }
+    epoch->retired = NULL;
+    epoch->retired_count = 0;
+    radix_mutex_destroy(&epoch->lock);
+}
+
+int radix_epoch_enter(radix_epoch_t *epoch)
+{
+    long g;
+    int i;
+    int n;
+
+    i = radix_epoch_hint;
+    if (i < 0 || i >= RADIX_EPOCH_SLOTS)
+    {
+        i = (int)(((size_t)&radix_epoch_hint >> 6) % RADIX_EPOCH_SLOTS);
+    }
+
+    for (n = 0; ; n++)
+    {
+        g = radix_atomic_load_long(&epoch->global);
+        if (g != 0 && radix_atomic_load_long(&epoch->slots[i].epoch) == 0
+            && radix_atomic_cas_long(&epoch->slots[i].epoch, 0, g))
+        {
+            break;
+        }
+
+        i = (i + 1) % RADIX_EPOCH_SLOTS;
+        if (n % RADIX_EPOCH_SLOTS == RADIX_EPOCH_SLOTS - 1)
+        {
+            radix_thread_yield();
+        }
+    }
+
+    // pairs with the fence in reclaim: either the writer sees this slot
+    // or this reader sees everything unlinked before the writer looked
+    radix_atomic_fence();
+    radix_epoch_hint = i;
+    return i;
+}
+
+void radix_epoch_exit(radix_epoch_t *epoch, int slot)
+{
+    radix_atomic_store_long(&epoch->slots[slot].epoch, 0);
+}
+
+/* oldest epoch a reader is still in, or the current one when idle */
+static long radix_epoch_oldest(radix_epoch_t *epoch)
+{
+    long oldest;
+    long e;
+    int i;
+
+    oldest = radix_atomic_load_long(&epoch->global);
+    for (i = 0; i < RADIX_EPOCH_SLOTS; i++)
+    {
+        e = radix_atomic_load_long(&epoch->slots[i].epoch);
+        if (e != 0 && radix_epoch_before(e, oldest))
+        {
+            oldest = e;
+        }
+    }
+    return oldest;
+}
+
+void radix_epoch_reclaim(radix_epoch_t *epoch)
+{
+    radix_retired_t *r;
+    radix_retired_t *next;
+    radix_retired_t *done;
+    radix_retired_t **p;
+    long oldest;
+
+    radix_atomic_fence();
+    oldest = radix_epoch_oldest(epoch);
+
+    done = NULL;
+    radix_mutex_lock(&epoch->lock);
+    if (oldest == epoch->reclaimed)
+    {
+        // a reader is still holding the same epoch back, walking the
+        // list again would free nothing
+        radix_mutex_unlock(&epoch->lock);
+        return;
+    }
+    epoch->reclaimed = oldest;
+    for (p = &epoch->retired; *p != NULL; )
+    {
+        r = *p;
+        if (radix_epoch_before(r->epoch, oldest))
+        {
+            *p = r->next;
+            r->next = done;
+            done = r;
+            epoch->retired_count--;
+        }
+        else
+        {
+            p = &r->next;
+        }
+    }
+    radix_mutex_unlock(&epoch->lock);
+
+    for (r = done; r != NULL; r = next)
+    {
+        next = r->next;
+        r->reclaim(r->ctx, r->ptr, r->size);
+        free(r);
+    }
+}
+
+/* hands ptr to reclaim once no reader can still be looking at it,
+   the caller must already have unlinked it from the structure */
+void radix_epoch_retire(radix_epoch_t *epoch, radix_reclaim_fn reclaim, void *ctx, void *ptr, size_t size)
+{
+    radix_retired_t *r;
+    int count;
+
+    r = (radix_retired_t *)malloc(sizeof(radix_retired_t));
+    if (r == NULL)
+    {
+        // no way to defer, wait the readers out instead
+        radix_epoch_synchronize(epoch);
+        reclaim(ctx, ptr, size);
+        return;
+    }
+
+    r->reclaim = reclaim;
+    r->ctx = ctx;
+    r->ptr = ptr;
+    r->size = size;
+
+    // readers that pick up the new epoch are ordered after the unlink
+    r->epoch = radix_epoch_advance(epoch) - 1;
+
+    radix_mutex_lock(&epoch->lock);
+    r->next = epoch->retired;
+    epoch->retired = r;
+    count = ++epoch->retired_count;
+    radix_mutex_unlock(&epoch->lock);
+
+    if (count % RADIX_EPOCH_BATCH == 0)
+    {
+        radix_epoch_reclaim(epoch);
+    }
+}
+
+/* waits until every reader that entered before the call has left */
+void radix_epoch_synchronize(radix_epoch_t *epoch)
+{
+    long g;
+    long e;
+    int i;
+
+    g = radix_epoch_advance(epoch);
+    radix_atomic_fence();
+    for (i = 0; i < RADIX_EPOCH_SLOTS; i++)
+    {
+        for (;;)
+        {
+            e = radix_atomic_load_long(&epoch->slots[i].epoch);
+            if (e == 0 || !radix_epoch_before(e, g))
+            {
+                break;
+            }
+            radix_thread_yield();
+        }
+    }
+
+    radix_epoch_reclaim(epoch);
+}
@@ -0,0 +1,54 @@
+#ifndef RADIX_EPOCH_H
+#define RADIX_EPOCH_H
+
+#include <stddef.h>
+#include "radix_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+#define RADIX_EPOCH_SLOTS       128     // readers inside a critical section at once
+#define RADIX_EPOCH_BATCH       64      // retirements between reclaim passes
+
+typedef void (*radix_reclaim_fn)(void *ctx, void *ptr, size_t size);
+
+typedef struct
+{
+    volatile long epoch;    // 0 when the slot is free
+    char pad[64 - sizeof(long)];
+} radix_epoch_slot_t;
+
+typedef struct _radix_retired
+{
+    struct _radix_retired *next;
+    radix_reclaim_fn reclaim;
+    void *ctx;
+    void *ptr;
+    size_t size;
+    long epoch;
+} radix_retired_t;
+
+typedef struct
+{
+    volatile long global;
+    radix_epoch_slot_t slots[RADIX_EPOCH_SLOTS];
+    radix_mutex_t lock;     // guards the retired list
+    radix_retired_t *retired;
+    int retired_count;
+    long reclaimed;         // oldest epoch seen by the last reclaim pass
+} radix_epoch_t;
+
+void radix_epoch_init(radix_epoch_t *epoch);
+void radix_epoch_destroy(radix_epoch_t *epoch);
+int radix_epoch_enter(radix_epoch_t *epoch);
+void radix_epoch_exit(radix_epoch_t *epoch, int slot);
+void radix_epoch_retire(radix_epoch_t *epoch, radix_reclaim_fn reclaim, void *ctx, void *ptr, size_t size);
+void radix_epoch_reclaim(radix_epoch_t *epoch);
+void radix_epoch_synchronize(radix_epoch_t *epoch);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
@@ -0,0 +1,420 @@
+#include "radix_frozen.h"
+#include "radix_key.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* zeroed bits, returns 0 when out of memory */
+int radix_bits_init(radix_bits_t *b, size_t bits)
+{
+    b->bits = bits;
+    b->ones = 0;
+    b->ranks = NULL;
+    b->samples = NULL;
+    b->words = (unsigned long long *)calloc(bits / 64 + 1, sizeof(unsigned long long));
+    return b->words != NULL;
+}
+
+/* counts the ones once every bit is set, returns 0 when out of memory */
+int radix_bits_index(radix_bits_t *b)
+{
+    size_t blocks;
+    size_t words;
+    size_t ones;
+    size_t i;
+    size_t s;
+
+    words = b->bits / 64 + 1;
+    b->ranks = (unsigned int *)malloc((words / RADIX_BITS_BLOCK + 2) * sizeof(unsigned int));
+    if (b->ranks == NULL)
+    {
+        return 0;
+    }
+
+    ones = 0;
+    for (i = 0; i < words; i++)
+    {
+        if (i % RADIX_BITS_BLOCK == 0)
+        {
+            b->ranks[i / RADIX_BITS_BLOCK] = (unsigned int)ones;
+        }
+        ones += radix_popcount64(b->words[i]);
+    }
+    b->ranks[(words + RADIX_BITS_BLOCK - 1) / RADIX_BITS_BLOCK] = (unsigned int)ones;
+    b->ones = ones;
+
+    b->samples = (unsigned int *)malloc((ones / RADIX_BITS_SAMPLE + 2) * sizeof(unsigned int));
+    if (b->samples == NULL)
+    {
+        return 0;
+    }
+    blocks = (words + RADIX_BITS_BLOCK - 1) / RADIX_BITS_BLOCK;
+    for (i = 0, s = 0; i < blocks; i++)
+    {
+        while (s * RADIX_BITS_SAMPLE < b->ranks[i + 1])
+        {
+            b->samples[s++] = (unsigned int)i;
+        }
+    }
+    b->samples[s] = (unsigned int)blocks;
+    return 1;
+}
+
+/* ones before bit i */
+size_t radix_bits_rank(const radix_bits_t *b, size_t i)
+{
+    size_t r;
+    size_t w;
+    size_t j;
+
+    w = i >> 6;
+    r = b->ranks[w / RADIX_BITS_BLOCK];
+    for (j = w - w % RADIX_BITS_BLOCK; j < w; j++)
+    {
+        r += radix_popcount64(b->words[j]);
+    }
+    if ((i & 63) != 0)
+    {
+        r += radix_popcount64(b->words[w] & ((1ULL << (i & 63)) - 1));
+    }
+    return r;
+}
+
+/* position of the one with rank k, k < ones */
+size_t radix_bits_select(const radix_bits_t *b, size_t k)
+{
+    unsigned long long x;
+    size_t lo;
+    size_t hi;
+    size_t mid;
+    size_t r;
+    size_t w;
+    int c;
+
+    // last block that starts with at most k ones before it, between the
+    // samples around k
+    lo = b->samples[k / RADIX_BITS_SAMPLE];
+    hi = b->samples[k / RADIX_BITS_SAMPLE + 1] + 1;
+    if (hi > (b->bits / 64 + RADIX_BITS_BLOCK) / RADIX_BITS_BLOCK)
+    {
+        hi = (b->bits / 64 + RADIX_BITS_BLOCK) / RADIX_BITS_BLOCK;
+    }
+    while (hi - lo > 1)
+    {
+        mid = (lo + hi) / 2;
+        if (b->ranks[mid] <= k)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    r = b->ranks[lo];
+    for (w = lo * RADIX_BITS_BLOCK; ; w++)
+    {
+        c = radix_popcount64(b->words[w]);
+        if (r + c > k)
+        {
+            break;
+        }
+        r += c;
+    }
+
+    for (x = b->words[w]; r < k; r++)
+    {
+        x &= x - 1;
+    }
+    return w * 64 + radix_ctz64(x);
+}
+
+/* first one at or after bit i, or bits if there is none */
+size_t radix_bits_next(const radix_bits_t *b, size_t i)
+{
+    unsigned long long x;
+    size_t w;
+
+    if (i >= b->bits)
+    {
+        return b->bits;
+    }
+    w = i >> 6;
+    x = b->words[w] & (~0ULL << (i & 63));
+    while (x == 0)
+    {
+        if (++w > b->bits >> 6)
+        {
+            return b->bits;
+        }
+        x = b->words[w];
+    }
+    return w * 64 + radix_ctz64(x);
+}
+
+void radix_bits_release(radix_bits_t *b)
+{
+    free(b->words);
+    free(b->ranks);
+    free(b->samples);
+    b->words = NULL;
+    b->ranks = NULL;
+    b->samples = NULL;
+}
+
+static void radix_frozen_edges(radix_frozen_t *frozen, size_t node, size_t *start, size_t *end)
+{
+    size_t k;
+
+    k = radix_bits_rank(&frozen->has_child, node);
+    *start = radix_bits_select(&frozen->first_edge, k);
+    *end = radix_bits_next(&frozen->first_edge, *start + 1);
+}
+
+/* the label of node after its dispatch byte */
+static const unsigned char *radix_frozen_tail(radix_frozen_t *frozen, size_t node, size_t *len)
+{
+    size_t start;
+    size_t end;
+    size_t k;
+
+    if (!radix_bits_get(&frozen->has_tail, node))
+    {
+        *len = 0;
+        return NULL;
+    }
+
+    k = radix_bits_rank(&frozen->has_tail, node);
+    start = radix_bits_select(&frozen->tail_start, k);
+    end = radix_bits_next(&frozen->tail_start, start + 1);
+    *len = end - start;
+    return frozen->tails + start;
+}
+
+/* the child of node on byte key, or 0 since the root is nobody's child */
+static size_t radix_frozen_child(radix_frozen_t *frozen, size_t node, unsigned char key)
+{
+    const unsigned char *p;
+    size_t start;
+    size_t end;
+
+    if (!radix_bits_get(&frozen->has_child, node))
+    {
+        return 0;
+    }
+
+    radix_frozen_edges(frozen, node, &start, &end);
+    p = (const unsigned char *)memchr(frozen->edge_keys + start, key, end - start);
+    return p == NULL ? 0 : (size_t)(p - frozen->edge_keys) + 1;
+}
+
+/* follows key from the root as long as whole labels match, and returns
+   the node that ends at off or 0 */
+static size_t radix_frozen_step(radix_frozen_t *frozen, size_t node, const unsigned char *key, int *off, int key_len)
+{
+    const unsigned char *tail;
+    size_t len;
+
+    node = radix_frozen_child(frozen, node, key[*off]);
+    if (node == 0)
+    {
+        return 0;
+    }
+    (*off)++;
+
+    tail = radix_frozen_tail(frozen, node, &len);
+    if (len > 0)
+    {
+        if ((size_t)(key_len - *off) < len || radix_key_mismatch(key + *off, tail, (int)len) < (int)len)
+        {
+            return 0;
+        }
+        *off += (int)len;
+    }
+    return node;
+}
+
+static void *radix_frozen_value(radix_frozen_t *frozen, size_t node)
+{
+    void *value;
+
+    value = frozen->values[radix_bits_rank(&frozen->has_value, node)];
+    return frozen->copy_leaf != NULL ? frozen->copy_leaf(value) : value;
+}
+
+void *radix_frozen_exact_match(radix_frozen_t *frozen, const unsigned char *key, int key_len)
+{
+    size_t node = 0;
+    int off = 0;
+
+    while (off < key_len)
+    {
+        node = radix_frozen_step(frozen, node, key, &off, key_len);
+        if (node == 0)
+        {
+            return NULL;
+        }
+    }
+
+    return radix_bits_get(&frozen->has_value, node) ? radix_frozen_value(frozen, node) : NULL;
+}
+
+int radix_frozen_prefix_match(radix_frozen_t *frozen, const unsigned char *key, int key_len, void **value)
+{
+    size_t node = 0;
+    size_t last = 0;
+    int off = 0;
+    int nc = 0;
+
+    if (radix_bits_get(&frozen->has_value, 0))
+    {
+        nc++;
+    }
+    while (off < key_len)
+    {
+        node = radix_frozen_step(frozen, node, key, &off, key_len);
+        if (node == 0)
+        {
+            break;
+        }
+        if (radix_bits_get(&frozen->has_value, node))
+        {
+            last = node;
+            nc++;
+        }
+    }
+
+    *value = nc > 0 ? radix_frozen_value(frozen, last) : NULL;
+    return nc;
+}
+
+typedef struct
+{
+    size_t edge;
+    size_t end;
+    int key_len;
+} radix_frozen_frame_t;
+
+/* calls visit for every key in byte order, stops when visit returns
+   nonzero; returns the number of keys visited. Values are passed as
+   stored, without copy_leaf */
+int radix_frozen_walk(radix_frozen_t *frozen, radix_visit_fn visit, void *ctx)
+{
+    radix_frozen_frame_t *stack;
+    radix_frozen_frame_t *frame;
+    unsigned char *key;
+    const unsigned char *tail;
+    void *p;
+    size_t key_size;
+    size_t depth;
+    size_t size;
+    size_t node;
+    size_t len;
+    int count;
+    int key_len;
+
+    count = 0;
+    if (radix_bits_get(&frozen->has_value, 0))
+    {
+        count++;
+        if (visit(ctx, (const unsigned char *)"", 0, frozen->values[0]))
+        {
+            return count;
+        }
+    }
+    if (!radix_bits_get(&frozen->has_child, 0))
+    {
+        return count;
+    }
+
+    size = 16;
+    key_size = 64;
+    stack = (radix_frozen_frame_t *)malloc(size * sizeof(radix_frozen_frame_t));
+    key = (unsigned char *)malloc(key_size);
+    if (stack == NULL || key == NULL)
+    {
+        free(stack);
+        free(key);
+        return -1;
+    }
+
+    depth = 1;
+    radix_frozen_edges(frozen, 0, &stack[0].edge, &stack[0].end);
+    stack[0].key_len = 0;
+    while (depth > 0)
+    {
+        frame = &stack[depth - 1];
+        if (frame->edge == frame->end)
+        {
+            depth--;
+            continue;
+        }
+
+        node = frame->edge + 1;
+        key_len = frame->key_len;
+        frame->edge++;
+
+        tail = radix_frozen_tail(frozen, node, &len);
+        if (key_len + 1 + len > key_size)
+        {
+            key_size = (key_len + 1 + len) * 2;
+            p = realloc(key, key_size);
+            if (p == NULL)
+            {
+                count = -1;
+                break;
+            }
+            key = (unsigned char *)p;
+        }
+        key[key_len++] = frozen->edge_keys[node - 1];
+        if (len > 0)
+        {
+            memcpy(key + key_len, tail, len);
+            key_len += (int)len;
+        }
+
+        if (radix_bits_get(&frozen->has_value, node))
+        {
+            count++;
+            if (visit(ctx, key, key_len, frozen->values[radix_bits_rank(&frozen->has_value, node)]))
+            {
+                break;
+            }
+        }
+
+        if (radix_bits_get(&frozen->has_child, node))
+        {
+            if (depth == size)
+            {
+                size *= 2;
+                p = realloc(stack, size * sizeof(radix_frozen_frame_t));
+                if (p == NULL)
+                {
+                    count = -1;
+                    break;
+                }
+                stack = (radix_frozen_frame_t *)p;
+            }
+            frame = &stack[depth++];
+            radix_frozen_edges(frozen, node, &frame->edge, &frame->end);
+            frame->key_len = key_len;
+        }
+    }
+
+    free(stack);
+    free(key);
+    return count;
+}
+
+void radix_frozen_destroy(radix_frozen_t *frozen)
+{
+    radix_bits_release(&frozen->has_child);
+    radix_bits_release(&frozen->has_value);
+    radix_bits_release(&frozen->has_tail);
+    radix_bits_release(&frozen->first_edge);
+    radix_bits_release(&frozen->tail_start);
+    free(frozen->edge_keys);
+    free(frozen->tails);
+    free(frozen->values);
+    free(frozen);
+}
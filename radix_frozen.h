@@ -0,0 +1,79 @@
+#ifndef RADIX_FROZEN_H
+#define RADIX_FROZEN_H
+
+#include <stddef.h>
+#include "radix_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+#define RADIX_BITS_BLOCK    8   // words per rank block
+#define RADIX_BITS_SAMPLE   256 // ones per select sample
+
+// a bit vector with a popcount every 512 bits for rank and select
+typedef struct
+{
+    unsigned long long *words;
+    unsigned int *ranks;    // ones before every 512 bit block
+    unsigned int *samples;  // block of every 256th one
+    size_t bits;
+    size_t ones;
+} radix_bits_t;
+
+// an immutable copy of a tree in level order: node 0 is the root and the
+// child on edge e is node e + 1. The children of the k-th node that has
+// any are the edges from the k-th set bit of first_edge to the next one.
+// Every edge stores the dispatch byte of its child, the rest of a label
+// goes to tails
+typedef struct
+{
+    radix_bits_t has_child;     // per node
+    radix_bits_t has_value;     // per node
+    radix_bits_t has_tail;      // per node, label longer than the dispatch byte
+    radix_bits_t first_edge;    // per edge
+    radix_bits_t tail_start;    // per tail byte
+    unsigned char *edge_keys;   // per edge
+    unsigned char *tails;
+    void **values;              // per set bit of has_value
+    size_t nodes;
+    size_t edges;
+    size_t tail_len;
+    size_t bytes;               // memory held, for sizing
+    radix_copy_fn copy_leaf;
+} radix_frozen_t;
+
+static __inline int radix_bits_get(const radix_bits_t *b, size_t i)
+{
+    return (int)(b->words[i >> 6] >> (i & 63)) & 1;
+}
+
+static __inline void radix_bits_set(radix_bits_t *b, size_t i)
+{
+    b->words[i >> 6] |= 1ULL << (i & 63);
+}
+
+static __inline size_t radix_bits_bytes(const radix_bits_t *b)
+{
+    return (b->bits / 64 + 1) * sizeof(unsigned long long) + ((b->bits / 64 + 1) / RADIX_BITS_BLOCK + 2) * sizeof(unsigned int)
+        + (b->ones / RADIX_BITS_SAMPLE + 2) * sizeof(unsigned int);
+}
+
+int radix_bits_init(radix_bits_t *b, size_t bits);
+int radix_bits_index(radix_bits_t *b);
+size_t radix_bits_rank(const radix_bits_t *b, size_t i);
+size_t radix_bits_select(const radix_bits_t *b, size_t k);
+size_t radix_bits_next(const radix_bits_t *b, size_t i);
+void radix_bits_release(radix_bits_t *b);
+
+radix_frozen_t *radix_tree_freeze(radix_tree_t *tree);
+void *radix_frozen_exact_match(radix_frozen_t *frozen, const unsigned char *key, int key_len);
+int radix_frozen_prefix_match(radix_frozen_t *frozen, const unsigned char *key, int key_len, void **value);
+int radix_frozen_walk(radix_frozen_t *frozen, radix_visit_fn visit, void *ctx);
+void radix_frozen_destroy(radix_frozen_t *frozen);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
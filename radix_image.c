@@ -0,0 +1,337 @@
+#include "radix_image.h"
+#include "radix_key.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static __inline const radix_image_node_t *radix_image_node(radix_image_t *image, unsigned long long off)
+{
+    return (const radix_image_node_t *)(image->base + off);
+}
+
+static __inline const unsigned char *radix_image_label(const radix_image_node_t *node)
+{
+    return (const unsigned char *)(node + 1);
+}
+
+static const radix_image_node_t *radix_image_child(radix_image_t *image,
+    const radix_image_node_t *node,
+    unsigned char key)
+{
+    const unsigned char *table;
+    const unsigned char *p;
+    unsigned long long off;
+
+    table = radix_image_label(node) + RADIX_IMAGE_ALIGN(node->keys_len);
+    if (node->direct)
+    {
+        off = ((const unsigned long long *)table)[key];
+    }
+    else
+    {
+        p = (const unsigned char *)memchr(table, key, node->items);
+        if (p == NULL)
+        {
+            return NULL;
+        }
+        off = ((const unsigned long long *)(table + RADIX_IMAGE_ALIGN(node->items)))[p - table];
+    }
+    return off != 0 ? radix_image_node(image, off) : NULL;
+}
+
+/* length of the common prefix of the node label and the key from off */
+static __inline int radix_image_match_label(const radix_image_node_t *node,
+    const unsigned char *key,
+    int off,
+    int key_len)
+{
+    int len;
+    len = (int)node->keys_len;
+    if (key_len - off < len)
+    {
+        len = key_len - off;
+    }
+    return radix_key_mismatch(key + off, radix_image_label(node), len);
+}
+
+static int radix_image_check(radix_image_t *image)
+{
+    const radix_image_header_t *header;
+    const radix_image_trailer_t *trailer;
+
+    if (image->size < sizeof(radix_image_header_t) + sizeof(radix_image_node_t) + sizeof(radix_image_trailer_t))
+    {
+        return 0;
+    }
+
+    header = (const radix_image_header_t *)image->base;
+    trailer = (const radix_image_trailer_t *)(image->base + image->size - sizeof(radix_image_trailer_t));
+    if (memcmp(header->magic, RADIX_IMAGE_MAGIC, 8) != 0 || memcmp(trailer->magic, RADIX_IMAGE_MAGIC, 8) != 0
+        || header->order != RADIX_IMAGE_ORDER || header->word_size != sizeof(void *))
+    {
+        return 0;
+    }
+
+    if (trailer->root < sizeof(radix_image_header_t)
+        || trailer->root > image->size - sizeof(radix_image_trailer_t) - sizeof(radix_image_node_t))
+    {
+        return 0;
+    }
+
+    image->root = trailer->root;
+    image->nodes = trailer->nodes;
+    return 1;
+}
+
+#ifdef _WIN32
+
+radix_image_t *radix_tree_open_mmap(const char *path)
+{
+    radix_image_t *image;
+    LARGE_INTEGER size;
+
+    image = (radix_image_t *)calloc(1, sizeof(radix_image_t));
+    if (image == NULL)
+    {
+        return NULL;
+    }
+
+    image->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (image->file == INVALID_HANDLE_VALUE)
+    {
+        free(image);
+        return NULL;
+    }
+
+    if (GetFileSizeEx(image->file, &size) && size.QuadPart > 0 && (unsigned long long)size.QuadPart <= (size_t)-1)
+    {
+        image->size = (size_t)size.QuadPart;
+        image->mapping = CreateFileMappingA(image->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (image->mapping != NULL)
+        {
+            image->base = (const unsigned char *)MapViewOfFile(image->mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+
+    if (image->base == NULL || !radix_image_check(image))
+    {
+        radix_image_close(image);
+        return NULL;
+    }
+    return image;
+}
+
+void radix_image_close(radix_image_t *image)
+{
+    if (image->base != NULL)
+    {
+        UnmapViewOfFile(image->base);
+    }
+    if (image->mapping != NULL)
+    {
+        CloseHandle(image->mapping);
+    }
+    CloseHandle(image->file);
+    free(image);
+}
+
+#else
+
+/* maps the image shared and read-only, so every process that opens the
+   same file serves lookups from the same page cache pages */
+radix_image_t *radix_tree_open_mmap(const char *path)
+{
+    radix_image_t *image;
+    struct stat st;
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (unsigned long long)st.st_size <= (size_t)-1)
+    {
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    image = (radix_image_t *)calloc(1, sizeof(radix_image_t));
+    if (image == NULL)
+    {
+        munmap(base, (size_t)st.st_size);
+        return NULL;
+    }
+    image->base = (const unsigned char *)base;
+    image->size = (size_t)st.st_size;
+
+    if (!radix_image_check(image))
+    {
+        radix_image_close(image);
+        return NULL;
+    }
+    return image;
+}
+
+void radix_image_close(radix_image_t *image)
+{
+    munmap((void *)image->base, image->size);
+    free(image);
+}
+
+#endif
+
+void *radix_image_exact_match(radix_image_t *image, const unsigned char *key, int key_len)
+{
+    const radix_image_node_t *node;
+    int off = 0;
+    int a_off = 0;
+    node = radix_image_node(image, image->root);
+    while (off < key_len)
+    {
+        node = radix_image_child(image, node, key[off]);
+        if (node == NULL)
+        {
+            return NULL;
+        }
+
+        a_off = radix_image_match_label(node, key, off, key_len);
+        off += a_off;
+
+        if (a_off < (int)node->keys_len)
+        {
+            return NULL;
+        }
+    }
+
+    return (void *)(size_t)node->value;
+}
+
+int radix_image_prefix_match(radix_image_t *image, const unsigned char *key, int key_len, void **value)
+{
+    const radix_image_node_t *node;
+    unsigned long long last;
+    int off = 0;
+    int a_off = 0;
+    int nc = 0;
+    node = radix_image_node(image, image->root);
+    last = node->value;
+    if (last != 0)
+    {
+        nc++;
+    }
+    while (off < key_len)
+    {
+        node = radix_image_child(image, node, key[off]);
+        if (node == NULL)
+        {
+            break;
+        }
+
+        a_off = radix_image_match_label(node, key, off, key_len);
+        off += a_off;
+
+        if (a_off < (int)node->keys_len)
+        {
+            break;
+        }
+
+        if (node->value != 0)
+        {
+            last = node->value;
+            nc++;
+        }
+    }
+
+    *value = (void *)(size_t)last;
+    return nc;
+}
+
+typedef struct
+{
+    radix_image_t *image;
+    radix_tree_t *tree;
+    unsigned char *key;
+    size_t key_size;
+} radix_image_loader_t;
+
+static int radix_image_load_node(radix_image_loader_t *l, const radix_image_node_t *node, size_t key_len)
+{
+    const unsigned long long *offsets;
+    const unsigned char *table;
+    unsigned char *key;
+    size_t size;
+    int n;
+    int i;
+
+    if (key_len + node->keys_len > l->key_size)
+    {
+        size = (key_len + node->keys_len) * 2;
+        key = (unsigned char *)realloc(l->key, size);
+        if (key == NULL)
+        {
+            return -1;
+        }
+        l->key = key;
+        l->key_size = size;
+    }
+    if (node->keys_len > 0)
+    {
+        memcpy(l->key + key_len, radix_image_label(node), node->keys_len);
+        key_len += node->keys_len;
+    }
+
+    if (node->value != 0)
+    {
+        radix_tree_insert(l->tree, l->key, (int)key_len, (void *)(size_t)node->value);
+    }
+
+    table = radix_image_label(node) + RADIX_IMAGE_ALIGN(node->keys_len);
+    if (node->direct)
+    {
+        offsets = (const unsigned long long *)table;
+        n = 256;
+    }
+    else
+    {
+        offsets = (const unsigned long long *)(table + RADIX_IMAGE_ALIGN(node->items));
+        n = node->items;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (offsets[i] != 0 && radix_image_load_node(l, radix_image_node(l->image, offsets[i]), key_len) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* inserts every key of the image into tree, in key order; returns 0, or
+   -1 when out of memory */
+int radix_image_load(radix_image_t *image, radix_tree_t *tree)
+{
+    radix_image_loader_t l;
+    int result;
+
+    l.image = image;
+    l.tree = tree;
+    l.key = NULL;
+    l.key_size = 0;
+    result = radix_image_load_node(&l, radix_image_node(image, image->root), 0);
+    free(l.key);
+    return result;
+}
@@ -0,0 +1,72 @@
+#ifndef RADIX_IMAGE_H
+#define RADIX_IMAGE_H
+
+#include <stddef.h>
+#include "radix_tree.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+#define RADIX_IMAGE_MAGIC       "RDXIMG01"
+#define RADIX_IMAGE_ORDER       0x01020304  // written in host byte order
+#define RADIX_IMAGE_DIRECT      48          // more children than this get a full 256 slot table
+
+// records start on this boundary
+#define RADIX_IMAGE_ALIGN(n)    (((n) + 7) & ~(size_t)7)
+
+// an image is a header, the nodes children first and a trailer; every
+// reference is an offset from the start of the image, 0 meaning none
+typedef struct
+{
+    char magic[8];
+    unsigned int order;
+    unsigned int word_size;
+} radix_image_header_t;
+
+// followed by the label padded to 8 bytes, then either items child keys
+// padded to 8 bytes and items offsets, or 256 offsets indexed by byte
+typedef struct
+{
+    unsigned long long value;
+    unsigned int keys_len;
+    unsigned short items;
+    unsigned short direct;
+} radix_image_node_t;
+
+typedef struct
+{
+    unsigned long long root;
+    unsigned long long nodes;
+    char magic[8];
+} radix_image_trailer_t;
+
+// a read-only tree mapped from a file written by radix_tree_save; values
+// come back as the words that were saved
+typedef struct
+{
+    const unsigned char *base;
+    size_t size;
+    unsigned long long root;
+    unsigned long long nodes;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} radix_image_t;
+
+radix_image_t *radix_tree_open_mmap(const char *path);
+void *radix_image_exact_match(radix_image_t *image, const unsigned char *key, int key_len);
+int radix_image_prefix_match(radix_image_t *image, const unsigned char *key, int key_len, void **value);
+int radix_image_load(radix_image_t *image, radix_tree_t *tree);
+void radix_image_close(radix_image_t *image);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
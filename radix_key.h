@@ -0,0 +1,206 @@
+#ifndef RADIX_KEY_H
+#define RADIX_KEY_H
+
+#include <string.h>
+
+#if !defined(RADIX_TREE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define RADIX_KEY_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define RADIX_KEY_BIG_ENDIAN
+#endif
+
+typedef unsigned long long radix_word_t;
+
+#ifdef _MSC_VER
+#define RADIX_PREFETCH(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+#define RADIX_PREFETCH(p) __builtin_prefetch(p)
+#endif
+
+static __inline int radix_ctz32(unsigned int v)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, v);
+    return (int)idx;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+static __inline int radix_ctz64(radix_word_t v)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long idx;
+    _BitScanForward64(&idx, v);
+    return (int)idx;
+#elif defined(_MSC_VER)
+    if ((unsigned int)v != 0)
+    {
+        return radix_ctz32((unsigned int)v);
+    }
+    return 32 + radix_ctz32((unsigned int)(v >> 32));
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+static __inline int radix_clz64(radix_word_t v)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long idx;
+    _BitScanReverse64(&idx, v);
+    return 63 - (int)idx;
+#elif defined(_MSC_VER)
+    unsigned long idx;
+    if ((unsigned int)(v >> 32) != 0)
+    {
+        _BitScanReverse(&idx, (unsigned int)(v >> 32));
+        return 31 - (int)idx;
+    }
+    _BitScanReverse(&idx, (unsigned int)v);
+    return 63 - (int)idx;
+#else
+    return __builtin_clzll(v);
+#endif
+}
+
+static __inline int radix_popcount64(radix_word_t v)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return (int)__popcnt64(v);
+#elif defined(_MSC_VER)
+    return (int)(__popcnt((unsigned int)v) + __popcnt((unsigned int)(v >> 32)));
+#else
+    return __builtin_popcountll(v);
+#endif
+}
+
+/* index of the first byte where a and b differ, or len if the first
+   len bytes are equal; compares 16 bytes per step with SSE2, 8 otherwise */
+static __inline int radix_key_mismatch(const unsigned char *a, const unsigned char *b, int len)
+{
+    radix_word_t x;
+    radix_word_t y;
+    int i = 0;
+
+#ifdef RADIX_KEY_SSE2
+    unsigned int mask;
+    for (; i + 16 <= len; i += 16)
+    {
+        mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *)(a + i)),
+            _mm_loadu_si128((const __m128i *)(b + i))));
+        if (mask != 0xffff)
+        {
+            return i + radix_ctz32(~mask);
+        }
+    }
+#endif
+
+    for (; i + 8 <= len; i += 8)
+    {
+        memcpy(&x, a + i, sizeof(x));
+        memcpy(&y, b + i, sizeof(y));
+        if (x != y)
+        {
+#ifdef RADIX_KEY_BIG_ENDIAN
+            return i + (radix_clz64(x ^ y) >> 3);
+#else
+            return i + (radix_ctz64(x ^ y) >> 3);
+#endif
+        }
+    }
+
+    for (; i < len && a[i] == b[i]; i++);
+    return i;
+}
+
+/* number of equal leading bits of a starting at bit a_off and b starting
+   at bit b_off, at most len; bits are numbered from the least significant
+   bit of each byte like get_bit does */
+static __inline int radix_key_mismatch_bits(const unsigned char *a,
+    int a_off,
+    const unsigned char *b,
+    int b_off,
+    int len)
+{
+    unsigned int x;
+    int phase;
+    int bytes;
+    int n;
+    int i;
+
+    if (len <= 0)
+    {
+        return 0;
+    }
+
+    phase = a_off & 7;
+    if (phase != (b_off & 7))
+    {
+        for (i = 0; i < len; i++)
+        {
+            if (((a[(a_off + i) >> 3] >> ((a_off + i) & 7)) & 1)
+                != ((b[(b_off + i) >> 3] >> ((b_off + i) & 7)) & 1))
+            {
+                break;
+            }
+        }
+        return i;
+    }
+
+    a += a_off >> 3;
+    b += b_off >> 3;
+    i = 0;
+    if (phase != 0)
+    {
+        n = 8 - phase < len ? 8 - phase : len;
+        x = ((unsigned int)(a[0] ^ b[0]) >> phase) & ((1u << n) - 1);
+        if (x != 0)
+        {
+            return radix_ctz32(x);
+        }
+        i = n;
+        a++;
+        b++;
+    }
+
+    bytes = (len - i) >> 3;
+    n = radix_key_mismatch(a, b, bytes);
+    if (n < bytes)
+    {
+        return i + n * 8 + radix_ctz32((unsigned int)(a[n] ^ b[n]));
+    }
+    i += bytes * 8;
+
+    n = len - i;
+    if (n > 0)
+    {
+        x = (unsigned int)(a[bytes] ^ b[bytes]) & ((1u << n) - 1);
+        if (x != 0)
+        {
+            return i + radix_ctz32(x);
+        }
+    }
+
+    return len;
+}
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
@@ -0,0 +1,471 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L    // ftruncate and fsync under strict C
+#endif
+
+#include "radix_log.h"
+#include "radix_image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#define RADIX_OPEN(path, flags)     _open(path, (flags) | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define RADIX_O_RDONLY              _O_RDONLY
+#define RADIX_O_RDWR                _O_RDWR | _O_CREAT
+#define RADIX_O_TRUNC               _O_WRONLY | _O_CREAT | _O_TRUNC
+#define RADIX_READ(fd, p, n)        _read(fd, p, n)
+#define RADIX_WRITE(fd, p, n)       _write(fd, p, n)
+#define RADIX_SEEK(fd, off, whence) _lseeki64(fd, off, whence)
+#define RADIX_TRUNCATE(fd, size)    _chsize_s(fd, size)
+#define RADIX_SYNC(fd)              _commit(fd)
+#define RADIX_CLOSE(fd)             _close(fd)
+#define RADIX_RENAME(from, to)      (MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : -1)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define RADIX_OPEN(path, flags)     open(path, flags, 0644)
+#define RADIX_O_RDONLY              O_RDONLY
+#define RADIX_O_RDWR                O_RDWR | O_CREAT
+#define RADIX_O_TRUNC               O_WRONLY | O_CREAT | O_TRUNC
+#define RADIX_READ(fd, p, n)        (int)read(fd, p, n)
+#define RADIX_WRITE(fd, p, n)       (int)write(fd, p, n)
+#define RADIX_SEEK(fd, off, whence) lseek(fd, off, whence)
+#define RADIX_TRUNCATE(fd, size)    ftruncate(fd, size)
+#define RADIX_SYNC(fd)              fsync(fd)
+#define RADIX_CLOSE(fd)             close(fd)
+#define RADIX_RENAME(from, to)      rename(from, to)
+#endif
+
+static unsigned int radix_log_check(const radix_log_record_t *record, const unsigned char *key)
+{
+    const unsigned char *p;
+    unsigned int h = 2166136261u;
+    size_t i;
+
+    p = (const unsigned char *)record + sizeof(record->check);
+    for (i = 0; i < sizeof(radix_log_record_t) - sizeof(record->check); i++)
+    {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    for (i = 0; i < record->key_len; i++)
+    {
+        h = (h ^ key[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int radix_log_write_all(int fd, const unsigned char *p, size_t len)
+{
+    size_t done;
+    int n;
+
+    for (done = 0; done < len; done += n)
+    {
+        n = RADIX_WRITE(fd, p + done, (unsigned int)(len - done));
+        if (n <= 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* reads the whole file, NULL with *size 0 for an empty one */
+static unsigned char *radix_log_read(int fd, size_t *size)
+{
+    unsigned char *buf;
+    long long end;
+    size_t done;
+    int n;
+
+    *size = 0;
+    end = (long long)RADIX_SEEK(fd, 0, SEEK_END);
+    if (end <= 0 || (unsigned long long)end > (size_t)-1 || RADIX_SEEK(fd, 0, SEEK_SET) != 0)
+    {
+        return NULL;
+    }
+
+    buf = (unsigned char *)malloc((size_t)end);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+    for (done = 0; done < (size_t)end; done += n)
+    {
+        n = RADIX_READ(fd, buf + done, (unsigned int)((size_t)end - done));
+        if (n <= 0)
+        {
+            free(buf);
+            return NULL;
+        }
+    }
+    *size = (size_t)end;
+    return buf;
+}
+
+static int radix_log_valid_header(const unsigned char *buf, size_t size)
+{
+    const radix_log_header_t *header = (const radix_log_header_t *)buf;
+    return size >= sizeof(radix_log_header_t) && memcmp(header->magic, RADIX_LOG_MAGIC, 8) == 0
+        && header->order == RADIX_IMAGE_ORDER && header->word_size == sizeof(void *);
+}
+
+/* walks the records after the header and applies them to tree when it is
+   not NULL; returns the end of the last whole record */
+static size_t radix_log_scan(const unsigned char *buf, size_t size, radix_tree_t *tree, int *count)
+{
+    radix_log_record_t record;
+    const unsigned char *key;
+    size_t off;
+
+    *count = 0;
+    for (off = sizeof(radix_log_header_t); size - off >= sizeof(radix_log_record_t); )
+    {
+        memcpy(&record, buf + off, sizeof(record));
+        key = buf + off + sizeof(record);
+        if (record.key_len > size - off - sizeof(record) || record.check != radix_log_check(&record, key))
+        {
+            break;
+        }
+
+        if (tree != NULL)
+        {
+            switch (record.op)
+            {
+            case RADIX_LOG_INSERT:
+                radix_tree_insert(tree, key, record.key_len, (void *)(size_t)record.value);
+                break;
+            case RADIX_LOG_REMOVE:
+                radix_tree_erase(tree, key, record.key_len);
+                break;
+            case RADIX_LOG_ERASE_PREFIX:
+                radix_tree_erase_prefix(tree, key, record.key_len);
+                break;
+            default:
+                radix_tree_clear(tree);
+                break;
+            }
+        }
+        off += sizeof(record) + record.key_len;
+        (*count)++;
+    }
+    return off;
+}
+
+/* opens or creates the log at path for appending; a record torn by a
+   crash is cut off so new ones follow the last whole one. Recover from
+   the log first, opening it does not replay anything */
+radix_log_t *radix_log_open(const char *path)
+{
+    radix_log_header_t header;
+    radix_log_t *log;
+    unsigned char *buf;
+    size_t size;
+    size_t end;
+    int count;
+    int fd;
+
+    fd = RADIX_OPEN(path, RADIX_O_RDWR);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    buf = radix_log_read(fd, &size);
+    if (size == 0)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RADIX_LOG_MAGIC, 8);
+        header.order = RADIX_IMAGE_ORDER;
+        header.word_size = sizeof(void *);
+        end = sizeof(header);
+        if (RADIX_SEEK(fd, 0, SEEK_SET) != 0 || radix_log_write_all(fd, (unsigned char *)&header, end) != 0
+            || RADIX_SYNC(fd) != 0)
+        {
+            RADIX_CLOSE(fd);
+            return NULL;
+        }
+    }
+    else if (buf != NULL && radix_log_valid_header(buf, size))
+    {
+        end = radix_log_scan(buf, size, NULL, &count);
+        free(buf);
+        if ((end < size && RADIX_TRUNCATE(fd, end) != 0) || RADIX_SEEK(fd, end, SEEK_SET) != (long long)end)
+        {
+            RADIX_CLOSE(fd);
+            return NULL;
+        }
+    }
+    else
+    {
+        // not a log, or not one this build can read
+        free(buf);
+        RADIX_CLOSE(fd);
+        return NULL;
+    }
+
+    log = (radix_log_t *)calloc(1, sizeof(radix_log_t));
+    if (log == NULL)
+    {
+        RADIX_CLOSE(fd);
+        return NULL;
+    }
+    log->fd = fd;
+    log->size = end;
+    radix_mutex_init(&log->lock);
+    radix_mutex_init(&log->commit_lock);
+    return log;
+}
+
+static void radix_log_fail(radix_log_t *log)
+{
+    radix_mutex_lock(&log->lock);
+    log->failed = 1;
+    radix_mutex_unlock(&log->lock);
+}
+
+/* hands the buffered records to the file and syncs it if asked to, the
+   caller holds commit_lock */
+static void radix_log_write_out(radix_log_t *log, int sync)
+{
+    unsigned long long last;
+    int failed;
+    unsigned char *buf;
+    size_t cap;
+    size_t len;
+
+    radix_mutex_lock(&log->lock);
+    buf = log->buf;
+    cap = log->cap;
+    len = log->len;
+    log->buf = log->spare;
+    log->cap = log->spare_cap;
+    log->len = 0;
+    log->spare = buf;
+    log->spare_cap = cap;
+    last = log->appended;
+    failed = log->failed;
+    radix_mutex_unlock(&log->lock);
+
+    // appenders fill the other buffer meanwhile
+    if (failed)
+    {
+        return;
+    }
+    if (len > 0 && radix_log_write_all(log->fd, buf, len) != 0)
+    {
+        radix_log_fail(log);
+        return;
+    }
+    log->size += len;
+    log->written = last;
+
+    if (sync && log->durable < last)
+    {
+        if (RADIX_SYNC(log->fd) != 0)
+        {
+            radix_log_fail(log);
+            return;
+        }
+        log->durable = last;
+    }
+}
+
+/* buffers one mutation, called by the tree as it applies it */
+void radix_log_append(radix_log_t *log, int op, const unsigned char *key, int key_len, void *value)
+{
+    radix_log_record_t record;
+    unsigned char *buf;
+    size_t need;
+    size_t cap;
+    size_t len;
+
+    memset(&record, 0, sizeof(record));
+    record.key_len = key_len;
+    record.op = op;
+    record.value = (unsigned long long)(size_t)value;
+    record.check = radix_log_check(&record, key);
+    need = sizeof(record) + key_len;
+
+    radix_mutex_lock(&log->lock);
+    if (log->len + need > log->cap)
+    {
+        cap = log->cap > 0 ? log->cap : 4096;
+        while (cap < log->len + need)
+        {
+            cap *= 2;
+        }
+        buf = (unsigned char *)realloc(log->buf, cap);
+        if (buf == NULL)
+        {
+            log->failed = 1;
+            radix_mutex_unlock(&log->lock);
+            return;
+        }
+        log->buf = buf;
+        log->cap = cap;
+    }
+    memcpy(log->buf + log->len, &record, sizeof(record));
+    if (key_len > 0)
+    {
+        // a clear has no key at all
+        memcpy(log->buf + log->len + sizeof(record), key, key_len);
+    }
+    log->len += need;
+    log->appended++;
+    len = log->len;
+    radix_mutex_unlock(&log->lock);
+
+    if (len >= RADIX_LOG_FLUSH_BYTES)
+    {
+        radix_mutex_lock(&log->commit_lock);
+        radix_log_write_out(log, 0);
+        radix_mutex_unlock(&log->commit_lock);
+    }
+}
+
+/* returns once every record appended before the call is on disk. The
+   first caller writes and syncs for everyone queued behind it, who find
+   their records durable when they get the lock. Returns -1 once a write
+   failed, the log is unusable from then on */
+int radix_log_commit(radix_log_t *log)
+{
+    unsigned long long target;
+    int failed;
+
+    radix_mutex_lock(&log->lock);
+    target = log->appended;
+    radix_mutex_unlock(&log->lock);
+
+    radix_mutex_lock(&log->commit_lock);
+    if (log->durable < target)
+    {
+        radix_log_write_out(log, 1);
+    }
+    radix_mutex_lock(&log->lock);
+    failed = log->failed;
+    radix_mutex_unlock(&log->lock);
+    radix_mutex_unlock(&log->commit_lock);
+    return failed ? -1 : 0;
+}
+
+/* writes an image of tree to path and empties the log, which the image
+   now covers; the tree must not change meanwhile. Replaying the records
+   onto an image that already holds them gives the same tree, so a crash
+   between the rename and the truncate loses nothing */
+int radix_log_checkpoint(radix_log_t *log, radix_tree_t *tree, const char *path)
+{
+    char *tmp;
+    int result;
+    int fd;
+
+    tmp = (char *)malloc(strlen(path) + 5);
+    if (tmp == NULL)
+    {
+        return -1;
+    }
+    strcpy(tmp, path);
+    strcat(tmp, ".tmp");
+
+    result = -1;
+    fd = RADIX_OPEN(tmp, RADIX_O_TRUNC);
+    if (fd >= 0)
+    {
+        if (radix_tree_save(tree, fd) == 0 && RADIX_SYNC(fd) == 0)
+        {
+            result = 0;
+        }
+        RADIX_CLOSE(fd);
+    }
+    if (result == 0)
+    {
+        result = RADIX_RENAME(tmp, path);
+    }
+    free(tmp);
+    if (result != 0)
+    {
+        return -1;
+    }
+
+    radix_mutex_lock(&log->commit_lock);
+    radix_mutex_lock(&log->lock);
+    log->len = 0;
+    log->written = log->appended;
+    log->durable = log->appended;
+    radix_mutex_unlock(&log->lock);
+    result = 0;
+    if (RADIX_TRUNCATE(log->fd, sizeof(radix_log_header_t)) != 0
+        || RADIX_SEEK(log->fd, sizeof(radix_log_header_t), SEEK_SET) != (long long)sizeof(radix_log_header_t)
+        || RADIX_SYNC(log->fd) != 0)
+    {
+        radix_log_fail(log);
+        result = -1;
+    }
+    log->size = sizeof(radix_log_header_t);
+    radix_mutex_unlock(&log->commit_lock);
+    return result;
+}
+
+/* loads the image at checkpoint, if there is one, into the empty tree
+   and replays the log at path onto it. Returns the number of records
+   replayed, or -1 if the log cannot be read */
+int radix_log_recover(radix_tree_t *tree, const char *checkpoint, const char *path)
+{
+    radix_image_t *image;
+    radix_log_t *log;
+    unsigned char *buf;
+    size_t size;
+    int count;
+    int fd;
+
+    image = checkpoint != NULL ? radix_tree_open_mmap(checkpoint) : NULL;
+    if (image != NULL)
+    {
+        count = radix_image_load(image, tree);
+        radix_image_close(image);
+        if (count != 0)
+        {
+            return -1;
+        }
+    }
+
+    fd = RADIX_OPEN(path, RADIX_O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    buf = radix_log_read(fd, &size);
+    RADIX_CLOSE(fd);
+    if (size == 0)
+    {
+        return 0;
+    }
+    if (buf == NULL || !radix_log_valid_header(buf, size))
+    {
+        free(buf);
+        return -1;
+    }
+
+    // the replayed mutations are in the log already
+    log = tree->log;
+    tree->log = NULL;
+    radix_log_scan(buf, size, tree, &count);
+    tree->log = log;
+    free(buf);
+    return count;
+}
+
+/* commits what is buffered and closes the file */
+void radix_log_close(radix_log_t *log)
+{
+    radix_log_commit(log);
+    RADIX_CLOSE(log->fd);
+    radix_mutex_destroy(&log->lock);
+    radix_mutex_destroy(&log->commit_lock);
+    free(log->buf);
+    free(log->spare);
+    free(log);
+}
@@ -0,0 +1,71 @@
+#ifndef RADIX_LOG_H
+#define RADIX_LOG_H
+
+#include <stddef.h>
+#include "radix_thread.h"
+#include "radix_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+#define RADIX_LOG_MAGIC         "RDXLOG01"
+#define RADIX_LOG_FLUSH_BYTES   (1024 * 1024)   // buffered records written out without a commit
+
+// mutations as they are logged
+#define RADIX_LOG_INSERT        1
+#define RADIX_LOG_REMOVE        2
+#define RADIX_LOG_ERASE_PREFIX  3
+#define RADIX_LOG_CLEAR         4
+
+typedef struct
+{
+    char magic[8];
+    unsigned int order;
+    unsigned int word_size;
+} radix_log_header_t;
+
+// followed by key_len key bytes; check covers everything after itself,
+// so a record torn by a crash ends the log
+typedef struct
+{
+    unsigned int check;
+    unsigned int key_len;
+    unsigned int op;
+    unsigned int reserved;
+    unsigned long long value;
+} radix_log_record_t;
+
+// an append-only log of the mutations of one tree, attached as tree->log.
+// Records are buffered in memory and radix_log_commit makes them durable;
+// callers that commit at the same time share one write and one sync.
+// Values are logged as the words they are, like in an image
+typedef struct _radix_log
+{
+    int fd;
+    unsigned long long size;        // bytes in the file
+    radix_mutex_t lock;             // guards the buffer and appended
+    radix_mutex_t commit_lock;      // held by the thread writing the buffer out
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+    unsigned char *spare;           // buffer being written out
+    size_t spare_cap;
+    unsigned long long appended;    // records appended so far
+    unsigned long long written;     // of those, the ones handed to the file
+    unsigned long long durable;     // of those, the ones synced
+    int failed;
+} radix_log_t;
+
+radix_log_t *radix_log_open(const char *path);
+void radix_log_append(radix_log_t *log, int op, const unsigned char *key, int key_len, void *value);
+int radix_log_commit(radix_log_t *log);
+int radix_log_checkpoint(radix_log_t *log, radix_tree_t *tree, const char *path);
+int radix_log_recover(radix_tree_t *tree, const char *checkpoint, const char *path);
+void radix_log_close(radix_log_t *log);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
@@ -0,0 +1,404 @@
+#include "radix_lpm.h"
+#include "radix_tree.h"
+#include "radix_key.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RADIX_LPM_MAX_LEVELS    (1 + (128 - RADIX_LPM_ROOT_IPV6) / 8)
+
+radix_lpm_t *radix_lpm_create(int bits)
+{
+    radix_lpm_t *lpm;
+
+    if (bits != 32 && bits != 128)
+    {
+        return NULL;
+    }
+
+    lpm = (radix_lpm_t *)calloc(1, sizeof(radix_lpm_t));
+    if (lpm == NULL)
+    {
+        return NULL;
+    }
+    lpm->bits = bits;
+    lpm->root_bits = bits == 32 ? RADIX_LPM_ROOT_IPV4 : RADIX_LPM_ROOT_IPV6;
+    // untouched pages of the direct table stay unmapped
+    lpm->root = (unsigned int *)calloc((size_t)1 << lpm->root_bits, sizeof(unsigned int));
+    lpm->prefixes = bit_radix_tree_create(2, NULL, NULL);
+    if (lpm->root == NULL || lpm->prefixes == NULL)
+    {
+        radix_lpm_destroy(lpm);
+        return NULL;
+    }
+    return lpm;
+}
+
+void radix_lpm_destroy(radix_lpm_t *lpm)
+{
+    if (lpm->prefixes != NULL)
+    {
+        bit_radix_tree_destroy(lpm->prefixes);
+    }
+    free(lpm->root);
+    free(lpm->groups);
+    free(lpm->routes);
+    free(lpm);
+}
+
+/* the bit tree numbers bits from the least significant bit of each byte,
+   addresses from the most significant one */
+static void radix_lpm_key(const unsigned char *prefix, int depth, unsigned char *key)
+{
+    unsigned char b;
+    int i;
+
+    for (i = 0; i < (depth + 7) / 8; i++)
+    {
+        b = prefix[i];
+        b = (unsigned char)((b & 0xf0) >> 4 | (b & 0x0f) << 4);
+        b = (unsigned char)((b & 0xcc) >> 2 | (b & 0x33) << 2);
+        b = (unsigned char)((b & 0xaa) >> 1 | (b & 0x55) << 1);
+        key[i] = b;
+    }
+}
+
+/* n address bits from bit off, both multiples of 8 */
+static __inline unsigned int radix_lpm_bits(const unsigned char *addr, int off, int n)
+{
+    unsigned int v = 0;
+    int i;
+
+    for (i = off / 8; i < (off + n) / 8; i++)
+    {
+        v = v << 8 | addr[i];
+    }
+    return v;
+}
+
+static __inline unsigned int *radix_lpm_table(radix_lpm_t *lpm, int level, unsigned int group)
+{
+    return level == 0 ? lpm->root : lpm->groups + (size_t)group * RADIX_LPM_GROUP;
+}
+
+/* a group filled with e, or 0 with nothing left; group 0 is never used so
+   an extended entry can not look empty */
+static unsigned int radix_lpm_alloc_group(radix_lpm_t *lpm, unsigned int e)
+{
+    unsigned int *groups;
+    unsigned int cap;
+    unsigned int g;
+    int i;
+
+    if (lpm->free_group != 0)
+    {
+        g = lpm->free_group - 1;
+        lpm->free_group = lpm->groups[(size_t)g * RADIX_LPM_GROUP];
+    }
+    else
+    {
+        if (lpm->group_count == 0)
+        {
+            lpm->group_count = 1;
+        }
+        if (lpm->group_count >= lpm->group_cap)
+        {
+            cap = lpm->group_cap > 0 ? lpm->group_cap * 2 : 64;
+            if (cap > RADIX_LPM_INDEX_MASK)
+            {
+                return 0;
+            }
+            groups = (unsigned int *)realloc(lpm->groups, (size_t)cap * RADIX_LPM_GROUP * sizeof(unsigned int));
+            if (groups == NULL)
+            {
+                return 0;
+            }
+            lpm->groups = groups;
+            lpm->group_cap = cap;
+        }
+        g = lpm->group_count++;
+    }
+
+    for (i = 0; i < RADIX_LPM_GROUP; i++)
+    {
+        lpm->groups[(size_t)g * RADIX_LPM_GROUP + i] = e;
+    }
+    return g;
+}
+
+static void radix_lpm_free_group(radix_lpm_t *lpm, unsigned int g)
+{
+    lpm->groups[(size_t)g * RADIX_LPM_GROUP] = lpm->free_group;
+    lpm->free_group = g + 1;
+}
+
+/* writes the route entry into every slot below *slot that holds a
+   prefix no longer than depth */
+static void radix_lpm_spread(radix_lpm_t *lpm, unsigned int *slot, int depth, unsigned int e)
+{
+    unsigned int *table;
+    int i;
+
+    if (*slot & RADIX_LPM_EXT)
+    {
+        table = radix_lpm_table(lpm, 1, RADIX_LPM_INDEX(*slot));
+        for (i = 0; i < RADIX_LPM_GROUP; i++)
+        {
+            radix_lpm_spread(lpm, &table[i], depth, e);
+        }
+    }
+    else if ((int)RADIX_LPM_DEPTH(*slot) <= depth)
+    {
+        *slot = e;
+    }
+}
+
+/* turns the group behind *slot back into a single entry once all its
+   entries are the same route */
+static void radix_lpm_collapse(radix_lpm_t *lpm, unsigned int *slot)
+{
+    unsigned int *table;
+    unsigned int g;
+    int i;
+
+    g = RADIX_LPM_INDEX(*slot);
+    table = radix_lpm_table(lpm, 1, g);
+    if (table[0] & RADIX_LPM_EXT)
+    {
+        return;
+    }
+    for (i = 1; i < RADIX_LPM_GROUP; i++)
+    {
+        if (table[i] != table[0])
+        {
+            return;
+        }
+    }
+    *slot = table[0];
+    radix_lpm_free_group(lpm, g);
+}
+
+/* puts back old routes of exactly depth with e, the route that covered
+   them before */
+static void radix_lpm_restore(radix_lpm_t *lpm, unsigned int *slot, int depth, unsigned int e)
+{
+    unsigned int *table;
+    int i;
+
+    if (*slot & RADIX_LPM_EXT)
+    {
+        table = radix_lpm_table(lpm, 1, RADIX_LPM_INDEX(*slot));
+        for (i = 0; i < RADIX_LPM_GROUP; i++)
+        {
+            radix_lpm_restore(lpm, &table[i], depth, e);
+        }
+        radix_lpm_collapse(lpm, slot);
+    }
+    else if ((int)RADIX_LPM_DEPTH(*slot) == depth)
+    {
+        *slot = e;
+    }
+}
+
+/* walks down to the level the prefix ends in, creating groups on the
+   way when add is set, and applies the route entry to the slots the
+   prefix covers there; returns -1 when out of memory */
+static int radix_lpm_update(radix_lpm_t *lpm, const unsigned char *prefix, int depth, unsigned int e, int add)
+{
+    unsigned int *path[RADIX_LPM_MAX_LEVELS];
+    unsigned int *table;
+    unsigned int group;
+    unsigned int idx;
+    unsigned int span;
+    unsigned int g;
+    unsigned int i;
+    int stride;
+    int start;
+    int level;
+
+    group = 0;
+    start = 0;
+    for (level = 0; ; level++)
+    {
+        stride = level == 0 ? lpm->root_bits : 8;
+        table = radix_lpm_table(lpm, level, group);
+        idx = radix_lpm_bits(prefix, start, stride);
+        if (depth <= start + stride)
+        {
+            break;
+        }
+
+        if (!(table[idx] & RADIX_LPM_EXT))
+        {
+            if (!add)
+            {
+                // a group is only collapsed once no longer prefix is left in it
+                return 0;
+            }
+            g = radix_lpm_alloc_group(lpm, table[idx]);
+            if (g == 0)
+            {
+                return -1;
+            }
+            table = radix_lpm_table(lpm, level, group);
+            table[idx] = RADIX_LPM_EXT | g;
+        }
+        path[level] = &table[idx];
+        group = RADIX_LPM_INDEX(table[idx]);
+        start += stride;
+    }
+
+    span = 1u << (start + stride - depth);
+    idx &= ~(span - 1);
+    for (i = idx; i < idx + span; i++)
+    {
+        if (add)
+        {
+            radix_lpm_spread(lpm, &table[i], depth, e);
+        }
+        else
+        {
+            radix_lpm_restore(lpm, &table[i], depth, e);
+        }
+    }
+
+    if (!add)
+    {
+        while (level-- > 0 && (*path[level] & RADIX_LPM_EXT))
+        {
+            radix_lpm_collapse(lpm, path[level]);
+        }
+    }
+    return 0;
+}
+
+/* adds or replaces the route for the first depth bits of prefix;
+   returns 0, or -1 when out of memory or the depth is out of range */
+int radix_lpm_add(radix_lpm_t *lpm, const unsigned char *prefix, int depth, void *value)
+{
+    radix_lpm_route_t *routes;
+    unsigned char key[16];
+    unsigned int cap;
+    unsigned int r;
+    void *found;
+
+    if (depth < 0 || depth > lpm->bits)
+    {
+        return -1;
+    }
+
+    radix_lpm_key(prefix, depth, key);
+    found = bit_radix_tree_exact_match(lpm->prefixes, key, depth);
+    if (found != NULL)
+    {
+        lpm->routes[(size_t)found - 1].value = value;
+        return 0;
+    }
+
+    if (lpm->free_route != 0)
+    {
+        r = lpm->free_route - 1;
+        lpm->free_route = (unsigned int)lpm->routes[r].depth;
+    }
+    else
+    {
+        if (lpm->route_count == lpm->route_cap)
+        {
+            cap = lpm->route_cap > 0 ? lpm->route_cap * 2 : 64;
+            if (cap > RADIX_LPM_INDEX_MASK)
+            {
+                return -1;
+            }
+            routes = (radix_lpm_route_t *)realloc(lpm->routes, cap * sizeof(radix_lpm_route_t));
+            if (routes == NULL)
+            {
+                return -1;
+            }
+            lpm->routes = routes;
+            lpm->route_cap = cap;
+        }
+        r = lpm->route_count++;
+    }
+    lpm->routes[r].value = value;
+    lpm->routes[r].depth = depth;
+
+    if (radix_lpm_update(lpm, prefix, depth, RADIX_LPM_ENTRY(depth, r + 1), 1) != 0)
+    {
+        lpm->routes[r].depth = (int)lpm->free_route;
+        lpm->free_route = r + 1;
+        return -1;
+    }
+    bit_radix_tree_insert(lpm->prefixes, key, depth, (void *)(size_t)(r + 1));
+    return 0;
+}
+
+/* removes the route for exactly this prefix, addresses it covered fall
+   back to the next shorter one; returns -1 if there was none */
+int radix_lpm_delete(radix_lpm_t *lpm, const unsigned char *prefix, int depth)
+{
+    unsigned char key[16];
+    unsigned int e;
+    void *found;
+    void *cover;
+    size_t r;
+
+    if (depth < 0 || depth > lpm->bits)
+    {
+        return -1;
+    }
+
+    radix_lpm_key(prefix, depth, key);
+    bit_radix_tree_remove(lpm->prefixes, key, depth, &found);
+    if (found == NULL)
+    {
+        return -1;
+    }
+
+    e = 0;
+    if (depth > 0 && bit_radix_tree_prefix_match(lpm->prefixes, key, depth - 1, &cover) > 0)
+    {
+        r = (size_t)cover - 1;
+        e = RADIX_LPM_ENTRY(lpm->routes[r].depth, r + 1);
+    }
+    radix_lpm_update(lpm, prefix, depth, e, 0);
+
+    r = (size_t)found - 1;
+    lpm->routes[r].value = NULL;
+    lpm->routes[r].depth = (int)lpm->free_route;
+    lpm->free_route = (unsigned int)r + 1;
+    return 0;
+}
+
+void *radix_lpm_lookup(radix_lpm_t *lpm, const unsigned char *addr)
+{
+    unsigned int e;
+    int start;
+
+    e = lpm->root[radix_lpm_bits(addr, 0, lpm->root_bits)];
+    for (start = lpm->root_bits; e & RADIX_LPM_EXT; start += 8)
+    {
+        e = lpm->groups[(size_t)RADIX_LPM_INDEX(e) * RADIX_LPM_GROUP + addr[start / 8]];
+    }
+    return RADIX_LPM_INDEX(e) != 0 ? lpm->routes[RADIX_LPM_INDEX(e) - 1].value : NULL;
+}
+
+/* radix_lpm_lookup_ipv4 for a run of addresses, with the root entries
+   of a group of them prefetched before any is read */
+void radix_lpm_lookup_ipv4_batch(radix_lpm_t *lpm, const unsigned int *addrs, int n, void **values)
+{
+    int base;
+    int m;
+    int i;
+
+    for (base = 0; base < n; base += m)
+    {
+        m = n - base < RADIX_BATCH_GROUP ? n - base : RADIX_BATCH_GROUP;
+        for (i = 0; i < m; i++)
+        {
+            RADIX_PREFETCH(&lpm->root[addrs[base + i] >> 8]);
+        }
+        for (i = 0; i < m; i++)
+        {
+            values[base + i] = radix_lpm_lookup_ipv4(lpm, addrs[base + i]);
+        }
+    }
+}
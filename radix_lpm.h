@@ -0,0 +1,76 @@
+#ifndef RADIX_LPM_H
+#define RADIX_LPM_H
+
+#include "bit_radix_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+// the first level takes this many address bits, every level below 8
+#define RADIX_LPM_ROOT_IPV4     24
+#define RADIX_LPM_ROOT_IPV6     16
+#define RADIX_LPM_GROUP         256
+
+// a table entry is a route or, with RADIX_LPM_EXT set, the group of 256
+// entries for the next 8 bits; a route entry keeps the length of the
+// prefix it came from so shorter prefixes never overwrite it
+#define RADIX_LPM_EXT           0x80000000u
+#define RADIX_LPM_INDEX_MASK    0x7fffffu
+#define RADIX_LPM_DEPTH(e)      (((e) >> 23) & 0xff)
+#define RADIX_LPM_INDEX(e)      ((e) & RADIX_LPM_INDEX_MASK)
+#define RADIX_LPM_ENTRY(depth, index) (((unsigned int)(depth) << 23) | (unsigned int)(index))
+
+typedef struct
+{
+    void *value;
+    int depth;
+} radix_lpm_route_t;
+
+// longest prefix match over 32 or 128 bit addresses given in network
+// byte order: a direct table for the first 24 (IPv4) or 16 (IPv6) bits
+// and groups of 256 entries for each further byte, so an IPv4 lookup is
+// at most two table reads and the route. The prefixes themselves are kept
+// in a bit_radix_tree_t, which finds the route to fall back to when one
+// is deleted
+typedef struct
+{
+    int bits;
+    int root_bits;
+    unsigned int *root;
+    unsigned int *groups;
+    unsigned int group_count;
+    unsigned int group_cap;
+    unsigned int free_group;    // first free group + 1, chained through entry 0
+    radix_lpm_route_t *routes;  // entry index - 1
+    unsigned int route_count;
+    unsigned int route_cap;
+    unsigned int free_route;    // first free route + 1, chained through depth
+    bit_radix_tree_t *prefixes; // prefix -> route index + 1
+} radix_lpm_t;
+
+radix_lpm_t *radix_lpm_create(int bits);
+int radix_lpm_add(radix_lpm_t *lpm, const unsigned char *prefix, int depth, void *value);
+int radix_lpm_delete(radix_lpm_t *lpm, const unsigned char *prefix, int depth);
+void *radix_lpm_lookup(radix_lpm_t *lpm, const unsigned char *addr);
+void radix_lpm_lookup_ipv4_batch(radix_lpm_t *lpm, const unsigned int *addrs, int n, void **values);
+void radix_lpm_destroy(radix_lpm_t *lpm);
+
+/* addr in host byte order */
+static __inline void *radix_lpm_lookup_ipv4(radix_lpm_t *lpm, unsigned int addr)
+{
+    unsigned int e;
+
+    e = lpm->root[addr >> 8];
+    if (e & RADIX_LPM_EXT)
+    {
+        e = lpm->groups[(size_t)RADIX_LPM_INDEX(e) * RADIX_LPM_GROUP + (addr & 0xff)];
+    }
+    return RADIX_LPM_INDEX(e) != 0 ? lpm->routes[RADIX_LPM_INDEX(e) - 1].value : NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
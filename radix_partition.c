@@ -0,0 +1,96 @@
+#include "radix_partition.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* groups the keys by leading byte with a stable counting sort, keys
+   shorter than min_len have none and go to the end; then cuts the 256
+   groups into at most parts runs of similar size. Sorted input stays
+   sorted within every part. Returns 0 when out of memory */
+int radix_partition_init(radix_partition_t *partition,
+    const unsigned char **keys,
+    const int *lens,
+    void **values,
+    int n,
+    int min_len,
+    int parts)
+{
+    int count[RADIX_PARTITION_MAX + 1];
+    int pos[RADIX_PARTITION_MAX + 1];
+    int bucket;
+    int target;
+    int total;
+    int i;
+    int j;
+
+    memset(partition, 0, sizeof(radix_partition_t));
+    partition->keys = (const unsigned char **)malloc((n + 1) * sizeof(const unsigned char *));
+    partition->lens = (int *)malloc((n + 1) * sizeof(int));
+    partition->values = (void **)malloc((n + 1) * sizeof(void *));
+    if (partition->keys == NULL || partition->lens == NULL || partition->values == NULL)
+    {
+        radix_partition_release(partition);
+        return 0;
+    }
+
+    // bucket 256 holds the short keys
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++)
+    {
+        count[lens[i] < min_len ? RADIX_PARTITION_MAX : keys[i][0]]++;
+    }
+
+    for (i = 0, total = 0; i <= RADIX_PARTITION_MAX; i++)
+    {
+        pos[i] = total;
+        total += count[i];
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        bucket = lens[i] < min_len ? RADIX_PARTITION_MAX : keys[i][0];
+        j = pos[bucket]++;
+        partition->keys[j] = keys[i];
+        partition->lens[j] = lens[i];
+        partition->values[j] = values[i];
+    }
+
+    partition->short_n = count[RADIX_PARTITION_MAX];
+    partition->n = n - partition->short_n;
+
+    if (parts < 1)
+    {
+        parts = 1;
+    }
+    if (parts > RADIX_PARTITION_MAX)
+    {
+        parts = RADIX_PARTITION_MAX;
+    }
+
+    // close a part once it reaches its share of what is left
+    partition->bounds[0] = 0;
+    total = 0;
+    for (i = 0; i < RADIX_PARTITION_MAX && partition->parts < parts - 1; i++)
+    {
+        total += count[i];
+        target = (partition->n - partition->bounds[partition->parts]) / (parts - partition->parts);
+        if (total - partition->bounds[partition->parts] >= target && total > partition->bounds[partition->parts])
+        {
+            partition->bounds[++partition->parts] = total;
+        }
+    }
+    if (partition->bounds[partition->parts] < partition->n || partition->parts == 0)
+    {
+        partition->bounds[++partition->parts] = partition->n;
+    }
+    return 1;
+}
+
+void radix_partition_release(radix_partition_t *partition)
+{
+    free(partition->keys);
+    free(partition->lens);
+    free(partition->values);
+    partition->keys = NULL;
+    partition->lens = NULL;
+    partition->values = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef RADIX_PARTITION_H
+#define RADIX_PARTITION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+#define RADIX_PARTITION_MAX     256     // one part per leading byte at most
+
+// keys regrouped by their leading byte for the parallel builds; a group is
+// never split, so the parts hold disjoint subtrees of the root
+typedef struct
+{
+    const unsigned char **keys;
+    int *lens;
+    void **values;
+    int n;          // keys that have a leading byte, short ones follow them
+    int short_n;
+    int parts;
+    int bounds[RADIX_PARTITION_MAX + 1];    // part i is [bounds[i], bounds[i + 1])
+} radix_partition_t;
+
+int radix_partition_init(radix_partition_t *partition,
+    const unsigned char **keys,
+    const int *lens,
+    void **values,
+    int n,
+    int min_len,
+    int parts);
+void radix_partition_release(radix_partition_t *partition);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef RADIX_THREAD_H
+#define RADIX_THREAD_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+#ifdef _WIN32
+
+typedef CRITICAL_SECTION radix_mutex_t;
+typedef HANDLE radix_thread_t;
+#define RADIX_THREAD_LOCAL __declspec(thread)
+
+static __inline void radix_mutex_init(radix_mutex_t *m) { InitializeCriticalSection(m); }
+static __inline void radix_mutex_destroy(radix_mutex_t *m) { DeleteCriticalSection(m); }
+static __inline void radix_mutex_lock(radix_mutex_t *m) { EnterCriticalSection(m); }
+static __inline void radix_mutex_unlock(radix_mutex_t *m) { LeaveCriticalSection(m); }
+static __inline void radix_thread_yield(void) { SwitchToThread(); }
+
+typedef struct
+{
+    void *(*fn)(void *);
+    void *arg;
+} radix_thread_start_t;
+
+static DWORD WINAPI radix_thread_main(LPVOID p)
+{
+    radix_thread_start_t start = *(radix_thread_start_t *)p;
+    HeapFree(GetProcessHeap(), 0, p);
+    start.fn(start.arg);
+    return 0;
+}
+
+static __inline int radix_thread_create(radix_thread_t *thread, void *(*fn)(void *), void *arg)
+{
+    radix_thread_start_t *start;
+    start = (radix_thread_start_t *)HeapAlloc(GetProcessHeap(), 0, sizeof(radix_thread_start_t));
+    if (start == NULL)
+    {
+        return -1;
+    }
+    start->fn = fn;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, radix_thread_main, start, 0, NULL);
+    if (*thread == NULL)
+    {
+        HeapFree(GetProcessHeap(), 0, start);
+        return -1;
+    }
+    return 0;
+}
+
+static __inline void radix_thread_join(radix_thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+#else
+
+typedef pthread_mutex_t radix_mutex_t;
+typedef pthread_t radix_thread_t;
+#define RADIX_THREAD_LOCAL __thread
+
+static __inline void radix_mutex_init(radix_mutex_t *m) { pthread_mutex_init(m, NULL); }
+static __inline void radix_mutex_destroy(radix_mutex_t *m) { pthread_mutex_destroy(m); }
+static __inline void radix_mutex_lock(radix_mutex_t *m) { pthread_mutex_lock(m); }
+static __inline void radix_mutex_unlock(radix_mutex_t *m) { pthread_mutex_unlock(m); }
+static __inline void radix_thread_yield(void) { sched_yield(); }
+
+static __inline int radix_thread_create(radix_thread_t *thread, void *(*fn)(void *), void *arg)
+{
+    return pthread_create(thread, NULL, fn, arg) == 0 ? 0 : -1;
+}
+
+static __inline void radix_thread_join(radix_thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif
@@ -1,12 +1,61 @@
 #include "radix_tree.h"
+#include "radix_key.h"
+#include "radix_arena.h"
+#include "radix_atomic.h"
+#include "radix_partition.h"
+#include "radix_image.h"
+#include "radix_log.h"
+#include "radix_frozen.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
-#define OFFSET_UNIT 1
+#ifdef _WIN32
+#include <io.h>
+#define RADIX_WRITE(fd, p, n) _write(fd, p, n)
+#else
+#include <unistd.h>
+#define RADIX_WRITE(fd, p, n) (int)write(fd, p, n)
+#endif
+
 #define OFFSET_KEY(k, off) k[off]
 
+#ifdef RADIX_TREE_STATS
+#define RADIX_COUNT(tree, counter, n) ((tree)->counters.counter += (n))
+#else
+#define RADIX_COUNT(tree, counter, n) ((void)0)
+#endif
+
+typedef struct
+{
+    radix_table_t hdr;
+    unsigned char keys[4];
+    radix_tree_node_t *children[4];
+} radix_table4_t;
+
+typedef struct
+{
+    radix_table_t hdr;
+    unsigned char keys[16];
+    radix_tree_node_t *children[16];
+} radix_table16_t;
+
+typedef struct
+{
+    radix_table_t hdr;
+    unsigned char index[256]; // slot + 1, 0 means empty
+    radix_tree_node_t *children[48];
+} radix_table48_t;
+
+typedef struct
+{
+    radix_table_t hdr;
+    radix_tree_node_t *children[256];
+} radix_table256_t;
+
+static const int radix_table_capacity[] = { 4, 16, 48, 256 };
+
 static char *strndup(const char *s, size_t len)
 {
     char *result;
@@ -21,572 +70,4089 @@ static char *strndup(const char *s, size_t len)
     return (char *)memcpy(result, s, len);
 }
 
-static char *mergestr(const char *s1, int s1_len, const char *s2, int s2_len)
+static __inline void *radix_tree_malloc(radix_tree_t *tree, size_t size)
 {
-    char *str;
-    int len;
+    if (tree->arena != NULL)
+    {
+        return radix_arena_alloc(tree->arena, size);
+    }
+    return malloc(size);
+}
+
+static __inline void radix_tree_mfree(radix_tree_t *tree, void *p, size_t size)
+{
+    if (tree->arena != NULL)
+    {
+        radix_arena_free(tree->arena, p, size);
+    }
+    else
+    {
+        free(p);
+    }
+}
+
+static void radix_tree_free_keys(radix_tree_t *tree, radix_tree_node_t *node)
+{
+    if (node->keys_len > RADIX_INLINE_KEYS)
+    {
+        radix_tree_mfree(tree, node->keys.ptr, node->keys_len);
+    }
+    node->keys_len = 0;
+}
+
+/* appends len bytes to the node label, moving it out of the node once
+   it no longer fits inline */
+static int radix_tree_append_keys(radix_tree_t *tree,
+    radix_tree_node_t *node,
+    const unsigned char *keys,
+    int len)
+{
+    unsigned char *buf;
+    int keys_len;
 
-    len = s1_len + s2_len;
-    str = malloc(len * sizeof(char));
-    if (str)
+    keys_len = node->keys_len + len;
+    if (keys_len <= RADIX_INLINE_KEYS)
     {
-        memcpy(str, s1, s1_len);
-        memcpy(str + s1_len, s2, s2_len);
+        if (len > 0)
+        {
+            memcpy(node->keys.buf + node->keys_len, keys, len);
+        }
+        node->keys_len = keys_len;
+        return 1;
+    }
+
+    buf = (unsigned char *)radix_tree_malloc(tree, keys_len);
+    if (buf == NULL)
+    {
+        return 0;
+    }
+    memcpy(buf, RADIX_NODE_KEYS(node), node->keys_len);
+    memcpy(buf + node->keys_len, keys, len);
+    radix_tree_free_keys(tree, node);
+    node->keys.ptr = buf;
+    node->keys_len = keys_len;
+    return 1;
+}
+
+/* shortens the node label, moving it back inline once it fits */
+static void radix_tree_truncate_keys(radix_tree_t *tree, radix_tree_node_t *node, int len)
+{
+    unsigned char *ptr;
+
+    if (node->keys_len > RADIX_INLINE_KEYS && len <= RADIX_INLINE_KEYS)
+    {
+        ptr = node->keys.ptr;
+        memcpy(node->keys.buf, ptr, len);
+        radix_tree_mfree(tree, ptr, node->keys_len);
     }
+    node->keys_len = len;
+}
 
-    return str;
+static size_t radix_table_bytes(int table_type)
+{
+    switch (table_type)
+    {
+    case RADIX_TABLE_4:
+        return sizeof(radix_table4_t);
+    case RADIX_TABLE_16:
+        return sizeof(radix_table16_t);
+    case RADIX_TABLE_48:
+        return sizeof(radix_table48_t);
+    default:
+        return sizeof(radix_table256_t);
+    }
 }
 
-radix_tree_node_t *new_radix_tree_node(
+radix_tree_node_t *new_radix_tree_node(radix_tree_t *tree,
     unsigned char key,
     const unsigned char *keys,
     int keys_off,
     int keys_len)
 {
     radix_tree_node_t *node;
-    int byte_off;
-    int bit_off;
-    node = (radix_tree_node_t *)calloc(1, sizeof(radix_tree_node_t));
+    node = (radix_tree_node_t *)radix_tree_malloc(tree, sizeof(radix_tree_node_t));
     if (node != NULL)
     {
         node->key = key;
-        byte_off = keys_off / OFFSET_UNIT;
-        bit_off  =  keys_off % OFFSET_UNIT;
-        node->keys = strndup(keys + byte_off, keys_len - byte_off);
-        node->keys_off = bit_off;
-        node->keys_len = keys_len - byte_off;
-        node->next = NULL;
-        node->table_items = 0;
+        node->keys_len = 0;
+        node->version = tree->generation;
         node->table = NULL;
         node->value = NULL;
+        if (!radix_tree_append_keys(tree, node, keys + keys_off, keys_len - keys_off))
+        {
+            radix_tree_mfree(tree, node, sizeof(radix_tree_node_t));
+            return NULL;
+        }
     }
     return node;
 }
 
-void free_radix_tree_node(radix_tree_t *tree, radix_tree_node_t *node)
+static void radix_tree_reclaim(void *ctx, void *ptr, size_t size)
+{
+    radix_tree_mfree((radix_tree_t *)ctx, ptr, size);
+}
+
+static void radix_tree_reclaim_node(void *ctx, void *ptr, size_t size)
+{
+    radix_tree_free_keys((radix_tree_t *)ctx, (radix_tree_node_t *)ptr);
+    radix_tree_mfree((radix_tree_t *)ctx, ptr, size);
+}
+
+static void radix_tree_reclaim_value(void *ctx, void *ptr, size_t size)
+{
+    ((radix_tree_t *)ctx)->delete_leaf(ptr);
+}
+
+/* a node some snapshot may still reach after the live tree replaced it:
+   its label and its own table go with it, the children live on */
+static void radix_tree_reclaim_version(void *ctx, void *ptr, size_t size)
 {
+    radix_tree_node_t *node;
+
+    node = (radix_tree_node_t *)ptr;
     if (node->table != NULL)
     {
-        int table_size = tree == NULL ? 0 : tree->table_size;
-        for (int i = 0; i < table_size; i++)
+        radix_tree_mfree((radix_tree_t *)ctx, node->table, radix_table_bytes(node->table->type));
+    }
+    radix_tree_reclaim_node(ctx, ptr, size);
+}
+
+typedef struct _radix_deferred
+{
+    struct _radix_deferred *next;
+    radix_reclaim_fn reclaim;
+    void *ptr;
+    size_t size;
+    long generation;    // of the tree when the memory was unlinked
+} radix_deferred_t;
+
+/* nodes made before the last snapshot belong to the snapshots as well */
+static __inline int radix_tree_shared(radix_tree_t *tree, radix_tree_node_t *node)
+{
+    return tree->snapshots != NULL && node->version != tree->generation;
+}
+
+/* holds on to unlinked memory until every snapshot that may reach it is
+   released; should the list entry not fit the memory is leaked instead */
+static void radix_tree_defer(radix_tree_t *tree, radix_reclaim_fn reclaim, void *ptr, size_t size)
+{
+    radix_deferred_t *deferred;
+
+    deferred = (radix_deferred_t *)malloc(sizeof(radix_deferred_t));
+    if (deferred == NULL)
+    {
+        return;
+    }
+    deferred->next = NULL;
+    deferred->reclaim = reclaim;
+    deferred->ptr = ptr;
+    deferred->size = size;
+    deferred->generation = tree->generation;
+    if (tree->deferred_tail != NULL)
+    {
+        tree->deferred_tail->next = deferred;
+    }
+    else
+    {
+        tree->deferred = deferred;
+    }
+    tree->deferred_tail = deferred;
+}
+
+/* frees what was deferred up to and including generation */
+static void radix_tree_reclaim_deferred(radix_tree_t *tree, long generation)
+{
+    radix_deferred_t *deferred;
+
+    while ((deferred = tree->deferred) != NULL && deferred->generation <= generation)
+    {
+        tree->deferred = deferred->next;
+        if (tree->epoch != NULL)
+        {
+            radix_epoch_retire(tree->epoch, deferred->reclaim, tree, deferred->ptr, deferred->size);
+        }
+        else
+        {
+            deferred->reclaim(tree, deferred->ptr, deferred->size);
+        }
+        free(deferred);
+    }
+    if (tree->deferred == NULL)
+    {
+        tree->deferred_tail = NULL;
+    }
+}
+
+/* frees memory that has just been unlinked, or hands it to the epoch
+   when lock-free readers may still be looking at it */
+static void radix_tree_retire(radix_tree_t *tree, void *ptr, size_t size)
+{
+    if (tree->epoch != NULL)
+    {
+        radix_epoch_retire(tree->epoch, radix_tree_reclaim, tree, ptr, size);
+    }
+    else
+    {
+        radix_tree_mfree(tree, ptr, size);
+    }
+}
+
+/* same for a node shell and its label, the table and value are left alone
+   unless a snapshot keeps the node and with it the table */
+static void radix_tree_retire_node(radix_tree_t *tree, radix_tree_node_t *node)
+{
+    if (radix_tree_shared(tree, node))
+    {
+        radix_tree_defer(tree, radix_tree_reclaim_version, node, sizeof(radix_tree_node_t));
+    }
+    else if (tree->epoch != NULL)
+    {
+        radix_epoch_retire(tree->epoch, radix_tree_reclaim_node, tree, node, sizeof(radix_tree_node_t));
+    }
+    else
+    {
+        radix_tree_reclaim_node(tree, node, sizeof(radix_tree_node_t));
+    }
+}
+
+static void radix_tree_retire_value(radix_tree_t *tree, void *value)
+{
+    if (value == NULL || tree->delete_leaf == NULL)
+    {
+        return;
+    }
+
+    if (tree->snapshots != NULL)
+    {
+        radix_tree_defer(tree, radix_tree_reclaim_value, value, 0);
+    }
+    else if (tree->epoch != NULL)
+    {
+        radix_epoch_retire(tree->epoch, radix_tree_reclaim_value, tree, value, 0);
+    }
+    else
+    {
+        tree->delete_leaf(value);
+    }
+}
+
+#ifdef RADIX_KEY_SSE2
+/* one compare over all 16 keys, slots past n are masked off */
+static __inline int radix_table16_find(const radix_table16_t *table, int n, unsigned char key)
+{
+    __m128i cmp;
+    unsigned int mask;
+    cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)key),
+        _mm_loadu_si128((const __m128i *)table->keys));
+    mask = (unsigned int)_mm_movemask_epi8(cmp) & ((1u << n) - 1);
+    return mask == 0 ? -1 : radix_ctz32(mask);
+}
+#else
+static __inline int radix_table16_find(const radix_table16_t *table, int n, unsigned char key)
+{
+    int i;
+    for (i = 0; i < n && table->keys[i] <= key; i++)
+    {
+        if (table->keys[i] == key)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+#endif
+
+/* length of the common prefix of the node label and the key from off */
+static __inline int radix_tree_match_label(radix_tree_t *tree,
+    radix_tree_node_t *node,
+    const unsigned char *key,
+    int off,
+    int key_len)
+{
+    int len;
+    len = node->keys_len;
+    if (key_len - off < len)
+    {
+        len = key_len - off;
+    }
+    RADIX_COUNT(tree, probes, 1);
+    RADIX_COUNT(tree, compare_bytes, len);
+    return radix_key_mismatch(key + off, RADIX_NODE_KEYS(node), len);
+}
+
+static radix_tree_node_t *radix_table_get(radix_table_t *table, unsigned char key)
+{
+    radix_table4_t *table4;
+    radix_table48_t *table48;
+    int i;
+
+    switch (table->type)
+    {
+    case RADIX_TABLE_4:
+        table4 = (radix_table4_t *)table;
+        for (i = 0; i < table->items; i++)
         {
-            if (node->table[i] != NULL)
+            if (table4->keys[i] == key)
             {
-                free_radix_tree_node(tree, node->table[i]);
-                node->table[i] = NULL;
-                node->table_items--;
+                return (radix_tree_node_t *)RADIX_LOAD_PTR(table4->children[i]);
             }
         }
+        return NULL;
+    case RADIX_TABLE_16:
+        i = radix_table16_find((radix_table16_t *)table, table->items, key);
+        return i < 0 ? NULL : (radix_tree_node_t *)RADIX_LOAD_PTR(((radix_table16_t *)table)->children[i]);
+    case RADIX_TABLE_48:
+        table48 = (radix_table48_t *)table;
+        i = radix_atomic_load_uchar(&table48->index[key]);
+        return i == 0 ? NULL : (radix_tree_node_t *)RADIX_LOAD_PTR(table48->children[i - 1]);
+    default:
+        return (radix_tree_node_t *)RADIX_LOAD_PTR(((radix_table256_t *)table)->children[key]);
+    }
+}
+
+radix_tree_node_t *radix_tree_get_child_node(radix_tree_node_t *node, unsigned char key)
+{
+    radix_table_t *table;
 
-        free(node->table);
+    table = (radix_table_t *)RADIX_LOAD_PTR(node->table);
+    if (table == NULL)
+    {
+        return NULL;
     }
 
-    if (node->value != NULL && tree->delete_leaf != NULL)
+    return radix_table_get(table, key);
+}
+
+static radix_tree_node_t *radix_table_next(radix_table_t *table, int *key)
+{
+    radix_table48_t *table48;
+    radix_tree_node_t *child;
+    int i;
+    int n;
+    unsigned char *keys;
+    radix_tree_node_t **children;
+
+    switch (table->type)
     {
-        tree->delete_leaf(node->value);
+    case RADIX_TABLE_4:
+        keys = ((radix_table4_t *)table)->keys;
+        children = ((radix_table4_t *)table)->children;
+        break;
+    case RADIX_TABLE_16:
+        keys = ((radix_table16_t *)table)->keys;
+        children = ((radix_table16_t *)table)->children;
+        break;
+    case RADIX_TABLE_48:
+        table48 = (radix_table48_t *)table;
+        for (i = *key + 1; i < 256; i++)
+        {
+            n = radix_atomic_load_uchar(&table48->index[i]);
+            if (n != 0)
+            {
+                child = (radix_tree_node_t *)RADIX_LOAD_PTR(table48->children[n - 1]);
+                if (child != NULL)
+                {
+                    *key = i;
+                    return child;
+                }
+            }
+        }
+        return NULL;
+    default:
+        for (i = *key + 1; i < 256; i++)
+        {
+            child = (radix_tree_node_t *)RADIX_LOAD_PTR(((radix_table256_t *)table)->children[i]);
+            if (child != NULL)
+            {
+                *key = i;
+                return child;
+            }
+        }
+        return NULL;
     }
 
-    if (node->keys != NULL)
+    n = table->items;
+    for (i = 0; i < n; i++)
     {
-        free(node->keys);
+        if (keys[i] > *key)
+        {
+            *key = keys[i];
+            return (radix_tree_node_t *)RADIX_LOAD_PTR(children[i]);
+        }
     }
 
-    if (node->next != NULL)
+    return NULL;
+}
+
+/* returns the child with the smallest key greater than *key and stores
+   its key back, start with *key = -1 to walk the children in order */
+radix_tree_node_t *radix_tree_next_child_node(radix_tree_node_t *node, int *key)
+{
+    radix_table_t *table;
+
+    table = (radix_table_t *)RADIX_LOAD_PTR(node->table);
+    if (table == NULL)
     {
-        free_radix_tree_node(tree, node->next);
+        return NULL;
     }
 
-    free(node);
+    return radix_table_next(table, key);
 }
 
-void radix_tree_clear_children(radix_tree_t *tree, radix_tree_node_t *node)
+static radix_tree_node_t *radix_table_prev(radix_table_t *table, int *key)
 {
-    if (node->table != NULL)
+    radix_table48_t *table48;
+    radix_tree_node_t *child;
+    int i;
+    int n;
+    unsigned char *keys;
+    radix_tree_node_t **children;
+
+    switch (table->type)
     {
-        for (int i = 0; i < tree->table_size; i++)
+    case RADIX_TABLE_4:
+        keys = ((radix_table4_t *)table)->keys;
+        children = ((radix_table4_t *)table)->children;
+        break;
+    case RADIX_TABLE_16:
+        keys = ((radix_table16_t *)table)->keys;
+        children = ((radix_table16_t *)table)->children;
+        break;
+    case RADIX_TABLE_48:
+        table48 = (radix_table48_t *)table;
+        for (i = *key - 1; i >= 0; i--)
+        {
+            n = radix_atomic_load_uchar(&table48->index[i]);
+            if (n != 0)
+            {
+                child = (radix_tree_node_t *)RADIX_LOAD_PTR(table48->children[n - 1]);
+                if (child != NULL)
+                {
+                    *key = i;
+                    return child;
+                }
+            }
+        }
+        return NULL;
+    default:
+        for (i = *key - 1; i >= 0; i--)
         {
-            if (node->table[i] != NULL)
+            child = (radix_tree_node_t *)RADIX_LOAD_PTR(((radix_table256_t *)table)->children[i]);
+            if (child != NULL)
             {
-                free_radix_tree_node(tree, node->table[i]);
-                node->table[i] = NULL;
-                node->table_items--;
+                *key = i;
+                return child;
             }
         }
+        return NULL;
+    }
+
+    for (i = table->items - 1; i >= 0; i--)
+    {
+        if (keys[i] < *key)
+        {
+            *key = keys[i];
+            return (radix_tree_node_t *)RADIX_LOAD_PTR(children[i]);
+        }
     }
+
+    return NULL;
 }
 
-void radix_tree_put_child_node(radix_tree_t *tree,
-    radix_tree_node_t *node, 
-    unsigned char key, 
+/* the mirror of radix_tree_next_child_node, start with *key = 256 */
+radix_tree_node_t *radix_tree_prev_child_node(radix_tree_node_t *node, int *key)
+{
+    radix_table_t *table;
+
+    table = (radix_table_t *)RADIX_LOAD_PTR(node->table);
+    if (table == NULL)
+    {
+        return NULL;
+    }
+
+    return radix_table_prev(table, key);
+}
+
+static radix_table_t *radix_tree_alloc_table(radix_tree_t *tree, int table_type)
+{
+    radix_table_t *table;
+    table = (radix_table_t *)radix_tree_malloc(tree, radix_table_bytes(table_type));
+    if (table != NULL)
+    {
+        memset(table, 0, radix_table_bytes(table_type));
+        table->type = (unsigned char)table_type;
+    }
+    return table;
+}
+
+static void radix_sorted_insert(unsigned char *keys,
+    radix_tree_node_t **children,
+    int n,
+    unsigned char key,
     radix_tree_node_t *child)
 {
-    radix_tree_node_t **p_node;
-    int idx;
-    int table_size;
-    table_size = tree->table_size;
-    if (node->table == NULL)
+    int i;
+    for (i = n; i > 0 && keys[i - 1] > key; i--)
     {
-        node->table = malloc(table_size * sizeof(radix_tree_node_t *));
-        if (node->table != NULL)
-        {
-            memset(node->table, 0, table_size * sizeof(radix_tree_node_t *));
-        }
+        keys[i] = keys[i - 1];
+        children[i] = children[i - 1];
+    }
+    keys[i] = key;
+    children[i] = child;
+}
+
+static void radix_sorted_remove(unsigned char *keys,
+    radix_tree_node_t **children,
+    int n,
+    unsigned char key)
+{
+    int i;
+    for (i = 0; i < n && keys[i] != key; i++);
+    for (; i + 1 < n; i++)
+    {
+        keys[i] = keys[i + 1];
+        children[i] = children[i + 1];
+    }
+}
+
+/* in place; only the 48 and 256 layouts are safe to change under readers */
+static void radix_table_insert(radix_table_t *table, unsigned char key, radix_tree_node_t *child)
+{
+    radix_table48_t *table48;
+    int i;
+
+    switch (table->type)
+    {
+    case RADIX_TABLE_4:
+        radix_sorted_insert(((radix_table4_t *)table)->keys,
+            ((radix_table4_t *)table)->children,
+            table->items,
+            key,
+            child);
+        break;
+    case RADIX_TABLE_16:
+        radix_sorted_insert(((radix_table16_t *)table)->keys,
+            ((radix_table16_t *)table)->children,
+            table->items,
+            key,
+            child);
+        break;
+    case RADIX_TABLE_48:
+        table48 = (radix_table48_t *)table;
+        for (i = 0; table48->children[i] != NULL; i++);
+        RADIX_STORE_PTR(table48->children[i], child);
+        radix_atomic_store_uchar(&table48->index[key], (unsigned char)(i + 1));
+        break;
+    default:
+        RADIX_STORE_PTR(((radix_table256_t *)table)->children[key], child);
+        break;
+    }
+    table->items++;
+}
+
+static void radix_table_remove(radix_table_t *table, unsigned char key)
+{
+    radix_table48_t *table48;
+    int i;
+
+    switch (table->type)
+    {
+    case RADIX_TABLE_4:
+        radix_sorted_remove(((radix_table4_t *)table)->keys,
+            ((radix_table4_t *)table)->children,
+            table->items,
+            key);
+        break;
+    case RADIX_TABLE_16:
+        radix_sorted_remove(((radix_table16_t *)table)->keys,
+            ((radix_table16_t *)table)->children,
+            table->items,
+            key);
+        break;
+    case RADIX_TABLE_48:
+        table48 = (radix_table48_t *)table;
+        i = table48->index[key];
+        radix_atomic_store_uchar(&table48->index[key], 0);
+        RADIX_STORE_PTR(table48->children[i - 1], NULL);
+        break;
+    default:
+        RADIX_STORE_PTR(((radix_table256_t *)table)->children[key], NULL);
+        break;
+    }
+    table->items--;
+}
+
+/* swaps the child stored under key, a single pointer store */
+static void radix_table_replace(radix_table_t *table, unsigned char key, radix_tree_node_t *child)
+{
+    radix_table4_t *table4;
+    radix_table48_t *table48;
+    int i;
+
+    switch (table->type)
+    {
+    case RADIX_TABLE_4:
+        table4 = (radix_table4_t *)table;
+        for (i = 0; table4->keys[i] != key; i++);
+        RADIX_STORE_PTR(table4->children[i], child);
+        break;
+    case RADIX_TABLE_16:
+        i = radix_table16_find((radix_table16_t *)table, table->items, key);
+        RADIX_STORE_PTR(((radix_table16_t *)table)->children[i], child);
+        break;
+    case RADIX_TABLE_48:
+        table48 = (radix_table48_t *)table;
+        RADIX_STORE_PTR(table48->children[table48->index[key] - 1], child);
+        break;
+    default:
+        RADIX_STORE_PTR(((radix_table256_t *)table)->children[key], child);
+        break;
+    }
+}
+
+/* copies all children of table into a freshly allocated table of the given type */
+static radix_table_t *radix_tree_copy_table(radix_tree_t *tree, radix_table_t *table, int table_type)
+{
+    radix_table_t *copy;
+    radix_tree_node_t *child;
+    int key;
+
+    copy = radix_tree_alloc_table(tree, table_type);
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    key = -1;
+    while ((child = radix_table_next(table, &key)) != NULL)
+    {
+        radix_table_insert(copy, (unsigned char)key, child);
     }
-    idx = key % tree->table_size;
-    for (p_node = &node->table[idx]; *p_node != NULL; p_node = &((*p_node)->next))
+
+    return copy;
+}
+
+/* the node the live tree may change in place of node: a node the
+   snapshots share is copied with a copy of its table and swapped in
+   under parent, or for the root */
+static radix_tree_node_t *radix_tree_own(radix_tree_t *tree, radix_tree_node_t *parent, radix_tree_node_t *node)
+{
+    radix_tree_node_t *copy;
+
+    if (node == NULL || !radix_tree_shared(tree, node))
     {
-        assert(key != node->key);
+        return node;
     }
-    *p_node = child;
-    node->table_items++;
+
+    copy = new_radix_tree_node(tree, node->key, RADIX_NODE_KEYS(node), 0, node->keys_len);
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+    if (node->table != NULL)
+    {
+        copy->table = radix_tree_copy_table(tree, node->table, node->table->type);
+        if (copy->table == NULL)
+        {
+            radix_tree_reclaim_node(tree, copy, sizeof(radix_tree_node_t));
+            return NULL;
+        }
+    }
+    copy->value = node->value;
+
+    if (parent == NULL)
+    {
+        RADIX_STORE_PTR(tree->root, copy);
+    }
+    else
+    {
+        radix_table_replace(parent->table, node->key, copy);
+    }
+    radix_tree_retire_node(tree, node);
+    return copy;
+}
+
+/* owns every node on the way down a key that is known to be in the
+   tree, returns the last one and sets the two above it */
+static radix_tree_node_t *radix_tree_own_path(radix_tree_t *tree,
+    const unsigned char *key,
+    int key_len,
+    radix_tree_node_t **parent,
+    radix_tree_node_t **grand)
+{
+    radix_tree_node_t *node;
+    int off;
+
+    *parent = NULL;
+    *grand = NULL;
+    node = radix_tree_own(tree, NULL, tree->root);
+    off = 0;
+    while (node != NULL && off < key_len)
+    {
+        *grand = *parent;
+        *parent = node;
+        node = radix_tree_own(tree, node, radix_tree_get_child_node(node, OFFSET_KEY(key, off)));
+        if (node != NULL)
+        {
+            off += node->keys_len;
+        }
+    }
+    return node;
+}
+
+void radix_tree_put_child_node(radix_tree_t *tree,
+    radix_tree_node_t *node,
+    unsigned char key,
+    radix_tree_node_t *child)
+{
+    radix_table_t *table;
+    radix_table_t *copy;
+    int table_type;
+
+    assert(radix_tree_get_child_node(node, key) == NULL);
+
+    table = node->table;
+    if (table == NULL)
+    {
+        copy = radix_tree_alloc_table(tree, RADIX_TABLE_4);
+        if (copy != NULL)
+        {
+            radix_table_insert(copy, key, child);
+            RADIX_STORE_PTR(node->table, copy);
+        }
+        return;
+    }
+
+    table_type = table->type;
+    if (table->items == radix_table_capacity[table_type])
+    {
+        table_type++;
+    }
+    else if (tree->epoch == NULL || table_type >= RADIX_TABLE_48)
+    {
+        radix_table_insert(table, key, child);
+        return;
+    }
+
+    // readers never see a sorted table being shifted, they either get
+    // the old copy or the new one
+    copy = radix_tree_copy_table(tree, table, table_type);
+    if (copy == NULL)
+    {
+        return;
+    }
+    radix_table_insert(copy, key, child);
+    RADIX_STORE_PTR(node->table, copy);
+    radix_tree_retire(tree, table, radix_table_bytes(table->type));
+}
+
+void radix_tree_del_child_node(radix_tree_t *tree,
+    radix_tree_node_t *node,
+    unsigned char key)
+{
+    radix_table_t *table;
+    radix_table_t *copy;
+    int table_type;
+
+    table = node->table;
+    if (table->items == 1)
+    {
+        RADIX_STORE_PTR(node->table, NULL);
+        radix_tree_retire(tree, table, radix_table_bytes(table->type));
+        return;
+    }
+
+    // shrink a little below the smaller capacity so that a node
+    // sitting on the boundary does not flip between layouts
+    table_type = table->type;
+    if (table_type != RADIX_TABLE_4
+        && table->items - 1 <= radix_table_capacity[table_type - 1] * 3 / 4)
+    {
+        table_type--;
+    }
+    else if (tree->epoch == NULL || table_type >= RADIX_TABLE_48)
+    {
+        radix_table_remove(table, key);
+        return;
+    }
+
+    copy = radix_tree_copy_table(tree, table, table_type);
+    if (copy == NULL)
+    {
+        radix_table_remove(table, key);
+        return;
+    }
+    radix_table_remove(copy, key);
+    RADIX_STORE_PTR(node->table, copy);
+    radix_tree_retire(tree, table, radix_table_bytes(table->type));
+}
+
+void free_radix_tree_node(radix_tree_t *tree, radix_tree_node_t *node)
+{
+    radix_tree_node_t *child;
+    int key;
+
+    if (node->table != NULL)
+    {
+        key = -1;
+        while ((child = radix_tree_next_child_node(node, &key)) != NULL)
+        {
+            free_radix_tree_node(tree, child);
+        }
+
+        radix_tree_mfree(tree, node->table, radix_table_bytes(node->table->type));
+    }
+
+    if (node->value != NULL && tree->delete_leaf != NULL)
+    {
+        tree->delete_leaf(node->value);
+    }
+
+    radix_tree_free_keys(tree, node);
+    radix_tree_mfree(tree, node, sizeof(radix_tree_node_t));
+}
+
+/* hands every value below and including node to delete_leaf without
+   freeing any memory, used before an arena is released in one go */
+static void radix_tree_delete_values(radix_tree_t *tree, radix_tree_node_t *node)
+{
+    radix_tree_node_t *child;
+    int key;
+
+    key = -1;
+    while ((child = radix_tree_next_child_node(node, &key)) != NULL)
+    {
+        radix_tree_delete_values(tree, child);
+    }
+
+    if (node->value != NULL)
+    {
+        tree->delete_leaf(node->value);
+    }
+}
+
+static void radix_tree_free_table(radix_tree_t *tree, radix_table_t *table)
+{
+    radix_tree_node_t *child;
+    int key;
+
+    key = -1;
+    while ((child = radix_table_next(table, &key)) != NULL)
+    {
+        free_radix_tree_node(tree, child);
+    }
+
+    radix_tree_mfree(tree, table, radix_table_bytes(table->type));
+}
+
+static void radix_tree_reclaim_table(void *ctx, void *ptr, size_t size)
+{
+    radix_tree_free_table((radix_tree_t *)ctx, (radix_table_t *)ptr);
+}
+
+void radix_tree_clear_children(radix_tree_t *tree, radix_tree_node_t *node)
+{
+    radix_table_t *table;
+
+    table = node->table;
+    if (table != NULL)
+    {
+        RADIX_STORE_PTR(node->table, NULL);
+        if (tree->snapshots != NULL)
+        {
+            radix_tree_defer(tree, radix_tree_reclaim_table, table, 0);
+        }
+        else if (tree->epoch != NULL)
+        {
+            radix_epoch_retire(tree->epoch, radix_tree_reclaim_table, tree, table, 0);
+        }
+        else
+        {
+            radix_tree_free_table(tree, table);
+        }
+    }
+}
+
+/* splits node after the first a_off bytes of its label and returns the
+   node that now ends there; readers keep seeing either the old node or
+   the new pair */
+static radix_tree_node_t *radix_tree_split_node(radix_tree_t *tree,
+    radix_tree_node_t *parent,
+    radix_tree_node_t *node,
+    int a_off)
+{
+    radix_tree_node_t *rest;
+    radix_tree_node_t *mid;
+
+    rest = new_radix_tree_node(tree, OFFSET_KEY(RADIX_NODE_KEYS(node), a_off),
+        RADIX_NODE_KEYS(node),
+        a_off,
+        node->keys_len);
+    if (rest == NULL)
+    {
+        return NULL;
+    }
+    rest->table = node->table;
+    rest->value = node->value;
+
+    if (tree->epoch == NULL)
+    {
+        node->table = NULL;
+        node->value = NULL;
+        radix_tree_truncate_keys(tree, node, a_off);
+        radix_tree_put_child_node(tree, node, rest->key, rest);
+        RADIX_COUNT(tree, splits, 1);
+        return node;
+    }
+
+    mid = new_radix_tree_node(tree, node->key, RADIX_NODE_KEYS(node), 0, a_off);
+    if (mid == NULL)
+    {
+        radix_tree_retire_node(tree, rest);
+        return NULL;
+    }
+    radix_tree_put_child_node(tree, mid, rest->key, rest);
+    radix_table_replace(parent->table, node->key, mid);
+    radix_tree_retire_node(tree, node);
+    RADIX_COUNT(tree, splits, 1);
+    return mid;
+}
+
+/* inserts like radix_tree_insert but hands back the value that was
+   replaced, or NULL, instead of passing it to delete_leaf */
+void *radix_tree_replace(radix_tree_t *tree,
+    const unsigned char *key,
+    int key_len,
+    void *value)
+{
+    radix_tree_node_t *parent;
+    radix_tree_node_t *node;
+    radix_tree_node_t *child;
+    radix_tree_node_t *new_node;
+    void *old;
+    int off = 0;
+    int a_off = 0;
+    if (tree->log != NULL)
+    {
+        radix_log_append(tree->log, RADIX_LOG_INSERT, key, key_len, value);
+    }
+    RADIX_COUNT(tree, inserts, 1);
+    node = radix_tree_own(tree, NULL, tree->root);
+    for (off = 0; node != NULL && off < key_len; )
+    {
+        child = radix_tree_get_child_node(node, OFFSET_KEY(key, off));
+        if (child == NULL)
+        {
+            new_node = new_radix_tree_node(tree, OFFSET_KEY(key, off),
+                key,
+                off,
+                key_len);
+            if (new_node == NULL)
+            {
+                return NULL;
+            }
+            radix_tree_put_child_node(tree, node, OFFSET_KEY(key, off), new_node);
+            node = new_node;
+            break;
+        }
+
+        parent = node;
+        node = radix_tree_own(tree, parent, child);
+        if (node == NULL)
+        {
+            return NULL;
+        }
+
+        a_off = radix_tree_match_label(tree, node, key, off, key_len);
+        off += a_off;
+
+        if (a_off < node->keys_len)
+        {
+            node = radix_tree_split_node(tree, parent, node, a_off);
+            if (node == NULL)
+            {
+                return NULL;
+            }
+
+            if (off < key_len)
+            {
+                new_node = new_radix_tree_node(tree, OFFSET_KEY(key, off),
+                    key,
+                    off,
+                    key_len);
+                if (new_node == NULL)
+                {
+                    return NULL;
+                }
+                radix_tree_put_child_node(tree, node, OFFSET_KEY(key, off), new_node);
+                node = new_node;
+            }
+
+            break;
+        }
+    }
+
+    if (node == NULL)
+    {
+        return NULL;
+    }
+
+    old = node->value;
+    if (tree->copy_leaf != NULL)
+    {
+        RADIX_STORE_PTR(node->value, tree->copy_leaf(value));
+    }
+    else
+    {
+        RADIX_STORE_PTR(node->value, value);
+    }
+    return old;
+}
+
+void radix_tree_insert(radix_tree_t *tree,
+    const unsigned char *key,
+    int key_len,
+    void *value)
+{
+    radix_tree_retire_value(tree, radix_tree_replace(tree, key, key_len, value));
+}
+
+/* the value stored for key as it is, without copy_leaf; it stays valid
+   until the key is replaced or removed, and with an epoch until the
+   reader leaves it */
+const void *radix_tree_exact_match_borrow(radix_tree_t *tree, const unsigned char *key, int key_len)
+{
+    radix_tree_node_t *node;
+    void *value;
+    int off = 0;
+    int a_off = 0;
+    RADIX_COUNT(tree, lookups, 1);
+    node = (radix_tree_node_t *)RADIX_LOAD_PTR(tree->root);
+    while (off < key_len)
+    {
+        node = radix_tree_get_child_node(node, OFFSET_KEY(key, off));
+        if (node == NULL)
+        {
+            break;
+        }
+
+        a_off = radix_tree_match_label(tree, node, key, off, key_len);
+        off += a_off;
+
+        if (a_off < node->keys_len)
+        {
+            node = NULL;
+            break;
+        }
+    }
+
+    value = node != NULL ? RADIX_LOAD_PTR(node->value) : NULL;
+    return off == key_len ? value : NULL;
+}
+
+void *radix_tree_exact_match(radix_tree_t *tree, const unsigned char *key, int key_len)
+{
+    void *value;
+    value = (void *)radix_tree_exact_match_borrow(tree, key, key_len);
+    if (value != NULL && tree->copy_leaf != NULL)
+    {
+        return tree->copy_leaf(value);
+    }
+    return value;
+}
+
+/* radix_tree_prefix_match without copy_leaf, see
+   radix_tree_exact_match_borrow */
+int radix_tree_prefix_match_borrow(radix_tree_t *tree, const unsigned char *key, int key_len, const void **value)
+{
+    radix_tree_node_t *node;
+    void *last;
+    void *v;
+    int off = 0;
+    int a_off = 0;
+    int nc = 0;
+    RADIX_COUNT(tree, lookups, 1);
+    node = (radix_tree_node_t *)RADIX_LOAD_PTR(tree->root);
+    last = RADIX_LOAD_PTR(node->value);
+    if (last != NULL)
+    {
+        nc++;
+    }
+    while (off < key_len)
+    {
+        node = radix_tree_get_child_node(node, OFFSET_KEY(key, off));
+        if (node == NULL)
+        {
+            break;
+        }
+
+        a_off = radix_tree_match_label(tree, node, key, off, key_len);
+        off += a_off;
+
+        if (a_off < node->keys_len)
+        {
+            node = NULL;
+            break;
+        }
+
+        v = RADIX_LOAD_PTR(node->value);
+        if (v != NULL)
+        {
+            last = v;
+            nc++;
+        }
+    }
+
+    *value = last;
+    return nc;
+}
+
+int radix_tree_prefix_match(radix_tree_t *tree, const unsigned char *key, int key_len, void **value)
+{
+    const void *last;
+    int nc;
+    nc = radix_tree_prefix_match_borrow(tree, key, key_len, &last);
+    if (last != NULL && tree->copy_leaf != NULL)
+    {
+        *value = tree->copy_leaf((void *)last);
+    }
+    else
+    {
+        *value = (void *)last;
+    }
+    return nc;
+}
+
+typedef struct
+{
+    radix_tree_node_t *node;
+    radix_table_t *table;   // prefetched, the child in it is looked up next
+    void *last;
+    int off;
+    int nc;
+} radix_batch_t;
+
+/* walks a group of keys level by level: while one key waits for its
+   table or node to arrive the others are worked on, so the misses of
+   the whole group overlap instead of being paid one after another */
+static void radix_tree_match_group(radix_tree_t *tree,
+    const unsigned char **keys,
+    const int *lens,
+    int n,
+    radix_batch_t *batch,
+    int prefix)
+{
+    radix_batch_t *b;
+    radix_tree_node_t *child;
+    void *value;
+    int active;
+    int a_off;
+    int i;
+
+    RADIX_COUNT(tree, lookups, n);
+    active = 0;
+    for (i = 0; i < n; i++)
+    {
+        b = &batch[i];
+        b->node = (radix_tree_node_t *)RADIX_LOAD_PTR(tree->root);
+        b->off = 0;
+        b->last = prefix ? RADIX_LOAD_PTR(b->node->value) : NULL;
+        b->nc = b->last != NULL;
+        b->table = lens[i] > 0 ? (radix_table_t *)RADIX_LOAD_PTR(b->node->table) : NULL;
+        if (b->table != NULL)
+        {
+            RADIX_PREFETCH(b->table);
+            active++;
+        }
+    }
+
+    while (active > 0)
+    {
+        for (i = 0; i < n; i++)
+        {
+            b = &batch[i];
+            if (b->table != NULL)
+            {
+                child = radix_table_get(b->table, OFFSET_KEY(keys[i], b->off));
+                if (child == NULL)
+                {
+                    b->node = NULL;
+                    b->table = NULL;
+                    active--;
+                    continue;
+                }
+                RADIX_PREFETCH(child);
+                b->node = child;
+            }
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            b = &batch[i];
+            if (b->table == NULL)
+            {
+                continue;
+            }
+
+            a_off = radix_tree_match_label(tree, b->node, keys[i], b->off, lens[i]);
+            b->off += a_off;
+            if (a_off < b->node->keys_len)
+            {
+                b->node = NULL;
+                b->table = NULL;
+                active--;
+                continue;
+            }
+
+            if (prefix)
+            {
+                value = RADIX_LOAD_PTR(b->node->value);
+                if (value != NULL)
+                {
+                    b->last = value;
+                    b->nc++;
+                }
+            }
+
+            b->table = b->off < lens[i] ? (radix_table_t *)RADIX_LOAD_PTR(b->node->table) : NULL;
+            if (b->table != NULL)
+            {
+                RADIX_PREFETCH(b->table);
+            }
+            else
+            {
+                active--;
+            }
+        }
+    }
+}
+
+/* values[i] gets what radix_tree_exact_match would return for keys[i] */
+void radix_tree_exact_match_batch(radix_tree_t *tree,
+    const unsigned char **keys,
+    const int *lens,
+    int n,
+    void **values)
+{
+    radix_batch_t batch[RADIX_BATCH_GROUP];
+    void *value;
+    int m;
+    int i;
+
+    for (; n > 0; n -= m, keys += m, lens += m, values += m)
+    {
+        m = n < RADIX_BATCH_GROUP ? n : RADIX_BATCH_GROUP;
+        radix_tree_match_group(tree, keys, lens, m, batch, 0);
+        for (i = 0; i < m; i++)
+        {
+            value = batch[i].node != NULL && batch[i].off == lens[i]
+                ? RADIX_LOAD_PTR(batch[i].node->value) : NULL;
+            if (value != NULL && tree->copy_leaf != NULL)
+            {
+                value = tree->copy_leaf(value);
+            }
+            values[i] = value;
+        }
+    }
+}
+
+/* values[i] and ncs[i] get what radix_tree_prefix_match would give for
+   keys[i], ncs may be NULL */
+void radix_tree_prefix_match_batch(radix_tree_t *tree,
+    const unsigned char **keys,
+    const int *lens,
+    int n,
+    void **values,
+    int *ncs)
+{
+    radix_batch_t batch[RADIX_BATCH_GROUP];
+    void *value;
+    int m;
+    int i;
+
+    for (; n > 0; n -= m, keys += m, lens += m, values += m)
+    {
+        m = n < RADIX_BATCH_GROUP ? n : RADIX_BATCH_GROUP;
+        radix_tree_match_group(tree, keys, lens, m, batch, 1);
+        for (i = 0; i < m; i++)
+        {
+            value = batch[i].last;
+            if (value != NULL && tree->copy_leaf != NULL)
+            {
+                value = tree->copy_leaf(value);
+            }
+            values[i] = value;
+            if (ncs != NULL)
+            {
+                ncs[i] = batch[i].nc;
+            }
+        }
+        if (ncs != NULL)
+        {
+            ncs += m;
+        }
+    }
+}
+
+/* folds a valueless node with a single child into that child, returns
+   nonzero when node was replaced */
+int radix_tree_merge_node(radix_tree_t *tree, radix_tree_node_t *parent, radix_tree_node_t *node)
+{
+    radix_tree_node_t *child;
+    radix_tree_node_t *merged;
+    radix_table_t *table;
+    radix_table_t *children;
+    int key;
+
+    if (node == tree->root || node->value != NULL || RADIX_NODE_ITEMS(node) != 1)
+    {
+        return 0;
+    }
+
+    key = -1;
+    child = radix_tree_next_child_node(node, &key);
+    assert (child != NULL);
+    table = node->table;
+
+    // a child the snapshots share keeps its table, node gets a copy
+    children = child->table;
+    if (children != NULL && radix_tree_shared(tree, child))
+    {
+        children = radix_tree_copy_table(tree, children, children->type);
+        if (children == NULL)
+        {
+            return 0;
+        }
+    }
+
+    if (tree->epoch == NULL)
+    {
+        if (!radix_tree_append_keys(tree, node, RADIX_NODE_KEYS(child), child->keys_len))
+        {
+            if (children != child->table)
+            {
+                radix_tree_mfree(tree, children, radix_table_bytes(children->type));
+            }
+            return 0;
+        }
+        node->table = children;
+        node->value = child->value;
+    }
+    else
+    {
+        merged = new_radix_tree_node(tree, node->key, RADIX_NODE_KEYS(node), 0, node->keys_len);
+        if (merged == NULL
+            || !radix_tree_append_keys(tree, merged, RADIX_NODE_KEYS(child), child->keys_len))
+        {
+            if (merged != NULL)
+            {
+                radix_tree_retire_node(tree, merged);
+            }
+            if (children != child->table)
+            {
+                radix_tree_mfree(tree, children, radix_table_bytes(children->type));
+            }
+            return 0;
+        }
+        merged->table = children;
+        merged->value = child->value;
+        radix_table_replace(parent->table, node->key, merged);
+        radix_tree_retire_node(tree, node);
+    }
+
+    radix_tree_retire(tree, table, radix_table_bytes(table->type));
+    radix_tree_retire_node(tree, child);
+    RADIX_COUNT(tree, merges, 1);
+    return 1;
+}
+
+// bytes of a block of lazily removed keys, longer keys get one of their own
+#define RADIX_TOMBSTONE_BLOCK   4096
+
+typedef struct _radix_tombstone_block
+{
+    struct _radix_tombstone_block *next;
+    size_t len;
+    size_t size;
+    unsigned char buf[1];
+} radix_tombstone_block_t;
+
+/* keys removed lazily, each after its length, in blocks that are never
+   moved so that neither side copies what is already queued */
+typedef struct _radix_tombstones
+{
+    radix_tombstone_block_t *head;
+    radix_tombstone_block_t *tail;
+    size_t off;     // first byte of head radix_tree_compact has not taken
+    int keys;
+    radix_tombstone_block_t *spare; // an emptied block, kept for the next one
+} radix_tombstones_t;
+
+static void radix_tombstones_recycle(radix_tombstones_t *tombstones, radix_tombstone_block_t *block)
+{
+    if (tombstones->spare == NULL && block->size == RADIX_TOMBSTONE_BLOCK)
+    {
+        tombstones->spare = block;
+    }
+    else
+    {
+        free(block);
+    }
+}
+
+static void radix_tree_drop_tombstones(radix_tree_t *tree)
+{
+    radix_tombstone_block_t *block;
+
+    while ((block = tree->tombstones->head) != NULL)
+    {
+        tree->tombstones->head = block->next;
+        radix_tombstones_recycle(tree->tombstones, block);
+    }
+    tree->tombstones->tail = NULL;
+    tree->tombstones->off = 0;
+    tree->tombstones->keys = 0;
+}
+
+/* queues key for radix_tree_compact, returns 0 when out of memory */
+static int radix_tree_tombstone(radix_tree_t *tree, const unsigned char *key, int key_len)
+{
+    radix_tombstones_t *tombstones;
+    radix_tombstone_block_t *block;
+    size_t size;
+
+    tombstones = tree->tombstones;
+    if (tombstones == NULL)
+    {
+        tombstones = (radix_tombstones_t *)calloc(1, sizeof(radix_tombstones_t));
+        if (tombstones == NULL)
+        {
+            return 0;
+        }
+        tree->tombstones = tombstones;
+    }
+
+    block = tombstones->tail;
+    if (block == NULL || block->len + sizeof(int) + key_len > block->size)
+    {
+        if (tombstones->spare != NULL && sizeof(int) + key_len <= RADIX_TOMBSTONE_BLOCK)
+        {
+            block = tombstones->spare;
+            tombstones->spare = NULL;
+        }
+        else
+        {
+            size = sizeof(int) + key_len > RADIX_TOMBSTONE_BLOCK ? sizeof(int) + key_len : RADIX_TOMBSTONE_BLOCK;
+            block = (radix_tombstone_block_t *)malloc(sizeof(radix_tombstone_block_t) + size);
+            if (block == NULL)
+            {
+                return 0;
+            }
+            block->size = size;
+        }
+        block->next = NULL;
+        block->len = 0;
+        if (tombstones->tail != NULL)
+        {
+            tombstones->tail->next = block;
+        }
+        else
+        {
+            tombstones->head = block;
+        }
+        tombstones->tail = block;
+    }
+    memcpy(block->buf + block->len, &key_len, sizeof(int));
+    memcpy(block->buf + block->len + sizeof(int), key, key_len);
+    block->len += sizeof(int) + key_len;
+    tombstones->keys++;
+    return 1;
+}
+
+void radix_tree_set_lazy_remove(radix_tree_t *tree, int lazy)
+{
+    tree->lazy_remove = lazy;
+}
+
+void radix_tree_remove(radix_tree_t *tree, const unsigned char *key, int key_len, void **value)
+{
+    radix_tree_node_t *grand = NULL;
+    radix_tree_node_t *parent = NULL;
+    radix_tree_node_t *node;
+    int off = 0;
+    int a_off = 0;
+    RADIX_COUNT(tree, removes, 1);
+    node = tree->root;
+    while (off < key_len)
+    {
+        grand = parent;
+        parent = node;
+
+        node = radix_tree_get_child_node(node, OFFSET_KEY(key, off));
+        if (node == NULL)
+        {
+            break;
+        }
+
+        a_off = radix_tree_match_label(tree, node, key, off, key_len);
+        off += a_off;
+
+        if (a_off < node->keys_len)
+        {
+            node = NULL;
+            break;
+        }
+    }
+
+    if (node != NULL && node->value == NULL)
+    {
+        // only a branch point, there is nothing to log or copy
+        node = NULL;
+    }
+
+    if (node != NULL && tree->snapshots != NULL)
+    {
+        node = radix_tree_own_path(tree, key, key_len, &parent, &grand);
+    }
+
+    if (node != NULL)
+    {
+        if (tree->log != NULL)
+        {
+            radix_log_append(tree->log, RADIX_LOG_REMOVE, key, key_len, NULL);
+        }
+        *value = node->value;
+        RADIX_STORE_PTR(node->value, NULL);
+
+        if (parent == NULL || RADIX_NODE_ITEMS(node) > 1)
+        {
+            // nothing to free or merge
+        }
+        else if (tree->lazy_remove && radix_tree_tombstone(tree, key, key_len))
+        {
+            // left for radix_tree_compact
+        }
+        else if (node->table == NULL)
+        {
+            radix_tree_del_child_node(tree, parent, node->key);
+            radix_tree_retire_node(tree, node);
+            radix_tree_merge_node(tree, grand, parent);
+        }
+        else
+        {
+            radix_tree_merge_node(tree, parent, node);
+        }
+    }
+    else
+    {
+        *value = NULL;
+    }
+}
+
+void radix_tree_erase(radix_tree_t *tree, const unsigned char *key, int key_len)
+{
+    void *value;
+    radix_tree_remove(tree, key, key_len, &value);
+    radix_tree_retire_value(tree, value);
+}
+
+/* optimistic lock coupling: bit 1 of the version is the write lock,
+   bit 0 marks a node that was unlinked, and every unlock bumps the count
+   so a writer can tell whether a node changed since it read it */
+#define RADIX_NODE_OBSOLETE     1
+#define RADIX_NODE_LOCKED       2
+
+static __inline int radix_node_read_lock(radix_tree_node_t *node, long *version)
+{
+    *version = radix_atomic_load_long(&node->version);
+    return (*version & (RADIX_NODE_LOCKED | RADIX_NODE_OBSOLETE)) == 0;
+}
+
+static __inline int radix_node_validate(radix_tree_node_t *node, long version)
+{
+    return radix_atomic_load_long(&node->version) == version;
+}
+
+static __inline int radix_node_upgrade(radix_tree_node_t *node, long version)
+{
+    return radix_atomic_cas_long(&node->version, version, version + RADIX_NODE_LOCKED);
+}
+
+static __inline void radix_node_unlock(radix_tree_node_t *node)
+{
+    radix_atomic_add_long(&node->version, RADIX_NODE_LOCKED);
+}
+
+static __inline void radix_node_unlock_obsolete(radix_tree_node_t *node)
+{
+    radix_atomic_add_long(&node->version, RADIX_NODE_LOCKED + RADIX_NODE_OBSOLETE);
+}
+
+/* spins a little, then gives the core away in case the lock holder
+   was preempted */
+static __inline void radix_node_backoff(int attempt)
+{
+    if (attempt % 64 == 63)
+    {
+        radix_thread_yield();
+    }
+    else
+    {
+        radix_cpu_relax();
+    }
+}
+
+/* waits for the lock on parent as long as it is still the parent of
+   node; only ever used going up the tree so two writers cannot wait
+   on each other */
+static int radix_node_lock_parent(radix_tree_node_t *parent, radix_tree_node_t *node)
+{
+    long version;
+    int attempt;
+
+    for (attempt = 0; ; attempt++)
+    {
+        version = radix_atomic_load_long(&parent->version);
+        if (version & RADIX_NODE_OBSOLETE)
+        {
+            return 0;
+        }
+
+        if ((version & RADIX_NODE_LOCKED) == 0)
+        {
+            if (radix_tree_get_child_node(parent, node->key) != node)
+            {
+                return 0;
+            }
+            if (radix_node_upgrade(parent, version))
+            {
+                return 1;
+            }
+        }
+        radix_node_backoff(attempt);
+    }
+}
+
+/* merges node into its only child with parent and node write locked,
+   the child is only tried once since waiting downwards could deadlock;
+   a node that stays unmerged is harmless and goes on the next remove */
+static int radix_tree_merge_olc(radix_tree_t *tree, radix_tree_node_t *parent, radix_tree_node_t *node)
+{
+    radix_tree_node_t *child;
+    long version;
+    int key;
+
+    if (node->value != NULL || RADIX_NODE_ITEMS(node) != 1)
+    {
+        return 0;
+    }
+
+    key = -1;
+    child = radix_tree_next_child_node(node, &key);
+    if (!radix_node_read_lock(child, &version) || !radix_node_upgrade(child, version))
+    {
+        return 0;
+    }
+
+    if (!radix_tree_merge_node(tree, parent, node))
+    {
+        radix_node_unlock(child);
+        return 0;
+    }
+
+    radix_node_unlock_obsolete(child);
+    return 1;
+}
+
+static radix_tree_node_t *radix_tree_new_leaf(radix_tree_t *tree,
+    const unsigned char *key,
+    int off,
+    int key_len,
+    void *value)
+{
+    radix_tree_node_t *node;
+    node = new_radix_tree_node(tree, OFFSET_KEY(key, off), key, off, key_len);
+    if (node != NULL)
+    {
+        node->value = tree->copy_leaf != NULL ? tree->copy_leaf(value) : value;
+    }
+    return node;
+}
+
+/* same result as radix_tree_insert, but only the node that changes is
+   locked, plus its parent when a label has to be split */
+void radix_tree_insert_olc(radix_tree_t *tree,
+    const unsigned char *key,
+    int key_len,
+    void *value)
+{
+    radix_tree_node_t *node;
+    radix_tree_node_t *child;
+    radix_tree_node_t *new_node;
+    long version;
+    long child_version;
+    void *old;
+    int off;
+    int a_off;
+    int attempt;
+
+    assert(tree->epoch != NULL);
+    RADIX_COUNT(tree, inserts, 1);
+
+    attempt = 0;
+
+restart:
+    if (attempt++ > 0)
+    {
+        radix_node_backoff(attempt);
+    }
+    node = tree->root;
+    if (!radix_node_read_lock(node, &version))
+    {
+        goto restart;
+    }
+
+    for (off = 0; off < key_len; off += a_off)
+    {
+        child = radix_tree_get_child_node(node, OFFSET_KEY(key, off));
+        if (child == NULL)
+        {
+            if (!radix_node_upgrade(node, version))
+            {
+                goto restart;
+            }
+            new_node = radix_tree_new_leaf(tree, key, off, key_len, value);
+            if (new_node != NULL)
+            {
+                radix_tree_put_child_node(tree, node, OFFSET_KEY(key, off), new_node);
+            }
+            radix_node_unlock(node);
+            return;
+        }
+
+        if (!radix_node_validate(node, version)
+            || !radix_node_read_lock(child, &child_version))
+        {
+            goto restart;
+        }
+
+        a_off = radix_tree_match_label(tree, child, key, off, key_len);
+        if (a_off < child->keys_len)
+        {
+            if (!radix_node_upgrade(node, version))
+            {
+                goto restart;
+            }
+            if (!radix_node_upgrade(child, child_version))
+            {
+                radix_node_unlock(node);
+                goto restart;
+            }
+
+            // the new middle node is reachable before it is complete, but
+            // other writers only get to it through node, which stays locked
+            new_node = radix_tree_split_node(tree, node, child, a_off);
+            if (new_node == NULL)
+            {
+                radix_node_unlock(child);
+                radix_node_unlock(node);
+                return;
+            }
+            radix_node_unlock_obsolete(child);
+
+            off += a_off;
+            if (off < key_len)
+            {
+                child = radix_tree_new_leaf(tree, key, off, key_len, value);
+                if (child != NULL)
+                {
+                    radix_tree_put_child_node(tree, new_node, OFFSET_KEY(key, off), child);
+                }
+            }
+            else
+            {
+                RADIX_STORE_PTR(new_node->value, tree->copy_leaf != NULL ? tree->copy_leaf(value) : value);
+            }
+            radix_node_unlock(node);
+            return;
+        }
+
+        node = child;
+        version = child_version;
+    }
+
+    if (!radix_node_upgrade(node, version))
+    {
+        goto restart;
+    }
+    old = node->value;
+    RADIX_STORE_PTR(node->value, tree->copy_leaf != NULL ? tree->copy_leaf(value) : value);
+    radix_node_unlock(node);
+    radix_tree_retire_value(tree, old);
+}
+
+void radix_tree_remove_olc(radix_tree_t *tree, const unsigned char *key, int key_len, void **value)
+{
+    radix_tree_node_t *grand;
+    radix_tree_node_t *parent;
+    radix_tree_node_t *node;
+    radix_tree_node_t *child;
+    long parent_version;
+    long version;
+    long child_version;
+    int off;
+    int a_off;
+    int attempt;
+
+    assert(tree->epoch != NULL);
+    RADIX_COUNT(tree, removes, 1);
+
+    attempt = 0;
+
+restart:
+    if (attempt++ > 0)
+    {
+        radix_node_backoff(attempt);
+    }
+    grand = NULL;
+    parent = NULL;
+    parent_version = 0;
+    node = tree->root;
+    if (!radix_node_read_lock(node, &version))
+    {
+        goto restart;
+    }
+
+    for (off = 0; off < key_len; off += a_off)
+    {
+        child = radix_tree_get_child_node(node, OFFSET_KEY(key, off));
+        if (!radix_node_validate(node, version))
+        {
+            goto restart;
+        }
+        if (child == NULL)
+        {
+            *value = NULL;
+            return;
+        }
+        if (!radix_node_read_lock(child, &child_version))
+        {
+            goto restart;
+        }
+
+        a_off = radix_tree_match_label(tree, child, key, off, key_len);
+        if (a_off < child->keys_len)
+        {
+            *value = NULL;
+            return;
+        }
+
+        grand = parent;
+        parent = node;
+        parent_version = version;
+        node = child;
+        version = child_version;
+    }
+
+    if (node->table == NULL && parent != NULL)
+    {
+        // a leaf goes away entirely, which changes its parent
+        if (!radix_node_upgrade(parent, parent_version))
+        {
+            goto restart;
+        }
+        if (!radix_node_upgrade(node, version))
+        {
+            radix_node_unlock(parent);
+            goto restart;
+        }
+
+        *value = node->value;
+        radix_tree_del_child_node(tree, parent, node->key);
+        radix_node_unlock_obsolete(node);
+        radix_tree_retire_node(tree, node);
+
+        if (grand != NULL && parent->value == NULL && RADIX_NODE_ITEMS(parent) == 1
+            && radix_node_lock_parent(grand, parent))
+        {
+            if (radix_tree_merge_olc(tree, grand, parent))
+            {
+                radix_node_unlock(grand);
+                radix_node_unlock_obsolete(parent);
+                return;
+            }
+            radix_node_unlock(grand);
+        }
+        radix_node_unlock(parent);
+        return;
+    }
+
+    if (!radix_node_upgrade(node, version))
+    {
+        goto restart;
+    }
+
+    *value = node->value;
+    RADIX_STORE_PTR(node->value, NULL);
+
+    if (parent != NULL && RADIX_NODE_ITEMS(node) == 1
+        && radix_node_lock_parent(parent, node))
+    {
+        if (radix_tree_merge_olc(tree, parent, node))
+        {
+            radix_node_unlock(parent);
+            radix_node_unlock_obsolete(node);
+            return;
+        }
+        radix_node_unlock(parent);
+    }
+    radix_node_unlock(node);
+}
+
+void radix_tree_erase_olc(radix_tree_t *tree, const unsigned char *key, int key_len)
+{
+    void *value;
+    radix_tree_remove_olc(tree, key, key_len, &value);
+    radix_tree_retire_value(tree, value);
+}
+
+void radix_tree_clear_olc(radix_tree_t *tree)
+{
+    long version;
+    int attempt;
+
+    for (attempt = 0; !radix_node_read_lock(tree->root, &version)
+        || !radix_node_upgrade(tree->root, version); attempt++)
+    {
+        radix_node_backoff(attempt);
+    }
+    radix_tree_clear_children(tree, tree->root);
+    radix_node_unlock(tree->root);
+}
+
+static int radix_tree_count_values(radix_tree_node_t *node)
+{
+    radix_tree_node_t *child;
+    int key;
+    int n;
+
+    n = node->value != NULL;
+    key = -1;
+    while ((child = radix_tree_next_child_node(node, &key)) != NULL)
+    {
+        n += radix_tree_count_values(child);
+    }
+    return n;
+}
+
+static void radix_tree_reclaim_subtree(void *ctx, void *ptr, size_t size)
+{
+    free_radix_tree_node((radix_tree_t *)ctx, (radix_tree_node_t *)ptr);
+}
+
+static void radix_tree_empty(radix_tree_t *tree);
+
+/* removes every key that starts with prefix by cutting off the subtree
+   they share, returns the number of keys removed */
+int radix_tree_erase_prefix(radix_tree_t *tree, const unsigned char *prefix, int prefix_len)
+{
+    radix_tree_node_t *grand = NULL;
+    radix_tree_node_t *parent = NULL;
+    radix_tree_node_t *node;
+    radix_tree_node_t *above;
+    int start = 0;
+    int off;
+    int a_off;
+    int n;
+
+    node = tree->root;
+    for (off = 0; off < prefix_len; off += a_off)
+    {
+        grand = parent;
+        parent = node;
+        start = off;
+        node = radix_tree_get_child_node(node, OFFSET_KEY(prefix, off));
+        if (node == NULL)
+        {
+            return 0;
+        }
+
+        a_off = radix_tree_match_label(tree, node, prefix, off, prefix_len);
+        if (a_off < node->keys_len && off + a_off < prefix_len)
+        {
+            return 0;
+        }
+    }
+
+    if (tree->log != NULL)
+    {
+        radix_log_append(tree->log, RADIX_LOG_ERASE_PREFIX, prefix, prefix_len, NULL);
+    }
+    n = radix_tree_count_values(node);
+    if (parent == NULL)
+    {
+        node = radix_tree_own(tree, NULL, node);
+        if (node == NULL)
+        {
+            return 0;
+        }
+        radix_tree_retire_value(tree, node->value);
+        RADIX_STORE_PTR(node->value, NULL);
+        radix_tree_empty(tree);
+        return n;
+    }
+
+    // node goes as a whole, only the path above it changes
+    if (tree->snapshots != NULL)
+    {
+        parent = radix_tree_own_path(tree, prefix, start, &grand, &above);
+        if (parent == NULL)
+        {
+            return 0;
+        }
+    }
+
+    radix_tree_del_child_node(tree, parent, node->key);
+    if (tree->snapshots != NULL)
+    {
+        radix_tree_defer(tree, radix_tree_reclaim_subtree, node, 0);
+    }
+    else if (tree->epoch != NULL)
+    {
+        radix_epoch_retire(tree->epoch, radix_tree_reclaim_subtree, tree, node, 0);
+    }
+    else
+    {
+        free_radix_tree_node(tree, node);
+    }
+    radix_tree_merge_node(tree, grand, parent);
+    return n;
+}
+
+typedef struct
+{
+    int depth;      // key length at the end of the node label
+    int key;        // index of a key that runs through the node
+    void *value;
+    int children;   // where the node's children start on the child stack
+} radix_bulk_frame_t;
+
+/* builds the node for a finished frame below a parent that ends at depth,
+   its children are the top of the child stack */
+static radix_tree_node_t *radix_tree_bulk_node(radix_tree_t *tree,
+    const radix_bulk_frame_t *frame,
+    const unsigned char *key,
+    int depth,
+    radix_tree_node_t **stack,
+    int top)
+{
+    radix_tree_node_t *node;
+    radix_table_t *table;
+    int n;
+    int i;
+
+    n = top - frame->children;
+    node = new_radix_tree_node(tree, OFFSET_KEY(key, depth), key, depth, frame->depth);
+    table = NULL;
+    if (node != NULL && n > 0)
+    {
+        table = radix_tree_alloc_table(tree, n <= 4 ? RADIX_TABLE_4
+            : n <= 16 ? RADIX_TABLE_16 : n <= 48 ? RADIX_TABLE_48 : RADIX_TABLE_256);
+    }
+
+    if (node == NULL || (n > 0 && table == NULL))
+    {
+        for (i = frame->children; i < top; i++)
+        {
+            free_radix_tree_node(tree, stack[i]);
+        }
+        if (node != NULL)
+        {
+            radix_tree_free_keys(tree, node);
+            radix_tree_mfree(tree, node, sizeof(radix_tree_node_t));
+        }
+        return NULL;
+    }
+
+    // children arrive in key order, so the sorted tables only append
+    for (i = frame->children; i < top; i++)
+    {
+        radix_table_insert(table, stack[i]->key, stack[i]);
+    }
+    node->table = table;
+    node->value = frame->value;
+    return node;
+}
+
+static int radix_tree_bulk_sorted(const unsigned char **keys, const int *lens, int n, int *max_len)
+{
+    int lcp;
+    int len;
+    int i;
+
+    *max_len = n > 0 ? lens[0] : 0;
+    for (i = 1; i < n; i++)
+    {
+        len = lens[i - 1] < lens[i] ? lens[i - 1] : lens[i];
+        lcp = radix_key_mismatch(keys[i - 1], keys[i], len);
+        if (lcp < len ? keys[i - 1][lcp] > keys[i][lcp] : lens[i - 1] > lens[i])
+        {
+            return 0;
+        }
+        if (lens[i] > *max_len)
+        {
+            *max_len = lens[i];
+        }
+    }
+    return 1;
+}
+
+/* records keys that bypass radix_tree_insert */
+static void radix_tree_log_inserts(radix_tree_t *tree,
+    const unsigned char **keys,
+    const int *lens,
+    void **values,
+    int n)
+{
+    int i;
+
+    if (tree->log != NULL)
+    {
+        for (i = 0; i < n; i++)
+        {
+            radix_log_append(tree->log, RADIX_LOG_INSERT, keys[i], lens[i], values[i]);
+        }
+    }
+}
+
+/* loads keys sorted in byte order into an empty tree in one pass: the
+   common prefix of each key with the one before it says how many of the
+   open nodes on the right edge are finished, and those are built bottom
+   up with their final label and table, so nothing is split or walked
+   again. Equal keys keep the last value; unsorted input or a tree that
+   already holds keys falls back to radix_tree_insert */
+void radix_tree_bulk_load(radix_tree_t *tree,
+    const unsigned char **keys,
+    const int *lens,
+    void **values,
+    int n)
+{
+    radix_bulk_frame_t *frames;
+    radix_tree_node_t **stack;
+    radix_tree_node_t *node;
+    radix_table_t *table;
+    radix_bulk_frame_t frame;
+    int depth = 0;
+    int top = 0;
+    int max_len;
+    int lcp;
+    int len;
+    int i;
+
+    frames = NULL;
+    stack = NULL;
+    if (tree->root->table == NULL && tree->root->value == NULL && tree->snapshots == NULL
+        && radix_tree_bulk_sorted(keys, lens, n, &max_len))
+    {
+        frames = (radix_bulk_frame_t *)malloc((max_len + 2) * sizeof(radix_bulk_frame_t));
+        stack = (radix_tree_node_t **)malloc((n + 1) * sizeof(radix_tree_node_t *));
+    }
+
+    if (frames == NULL || stack == NULL)
+    {
+        free(frames);
+        free(stack);
+        for (i = 0; i < n; i++)
+        {
+            radix_tree_insert(tree, keys[i], lens[i], values[i]);
+        }
+        return;
+    }
+
+    radix_tree_log_inserts(tree, keys, lens, values, n);
+    frames[0].depth = 0;
+    frames[0].key = 0;
+    frames[0].value = NULL;
+    frames[0].children = 0;
+
+    for (i = 0; i <= n; i++)
+    {
+        if (i < n && i > 0)
+        {
+            len = lens[i - 1] < lens[i] ? lens[i - 1] : lens[i];
+            lcp = radix_key_mismatch(keys[i - 1], keys[i], len);
+        }
+        else
+        {
+            lcp = 0;
+        }
+
+        // close every open node that ends below the shared prefix
+        while (frames[depth].depth > lcp)
+        {
+            frame = frames[depth--];
+            if (frames[depth].depth < lcp)
+            {
+                // the key branches off inside the label, so the two
+                // share a new node ending at lcp
+                depth++;
+                frames[depth].depth = lcp;
+                frames[depth].key = frame.key;
+                frames[depth].value = NULL;
+                frames[depth].children = frame.children;
+            }
+
+            node = radix_tree_bulk_node(tree, &frame, keys[frame.key], frames[depth].depth, stack, top);
+            top = frame.children;
+            if (node != NULL)
+            {
+                stack[top++] = node;
+            }
+        }
+
+        if (i == n)
+        {
+            break;
+        }
+
+        if (lens[i] == lcp)
+        {
+            // the same key again, or the empty key on the root
+            if (frames[depth].value != NULL && tree->delete_leaf != NULL)
+            {
+                tree->delete_leaf(frames[depth].value);
+            }
+            frames[depth].value = tree->copy_leaf != NULL ? tree->copy_leaf(values[i]) : values[i];
+            continue;
+        }
+
+        depth++;
+        frames[depth].depth = lens[i];
+        frames[depth].key = i;
+        frames[depth].value = tree->copy_leaf != NULL ? tree->copy_leaf(values[i]) : values[i];
+        frames[depth].children = top;
+    }
+
+    if (top > 0)
+    {
+        table = radix_tree_alloc_table(tree, top <= 4 ? RADIX_TABLE_4
+            : top <= 16 ? RADIX_TABLE_16 : top <= 48 ? RADIX_TABLE_48 : RADIX_TABLE_256);
+        if (table != NULL)
+        {
+            for (i = 0; i < top; i++)
+            {
+                radix_table_insert(table, stack[i]->key, stack[i]);
+            }
+        }
+        else
+        {
+            for (i = 0; i < top; i++)
+            {
+                free_radix_tree_node(tree, stack[i]);
+            }
+        }
+        RADIX_STORE_PTR(tree->root->table, table);
+    }
+    RADIX_STORE_PTR(tree->root->value, frames[0].value);
+
+    free(frames);
+    free(stack);
+}
+
+static void radix_tree_empty(radix_tree_t *tree)
+{
+    radix_tree_node_t *child;
+    void *value;
+    int key;
+
+    if (tree->tombstones != NULL)
+    {
+        radix_tree_drop_tombstones(tree);
+    }
+
+    if (tree->arena == NULL || tree->epoch != NULL || tree->snapshots != NULL)
+    {
+        child = radix_tree_own(tree, NULL, tree->root);
+        if (child != NULL)
+        {
+            radix_tree_clear_children(tree, child);
+        }
+        return;
+    }
+
+    if (tree->delete_leaf != NULL)
+    {
+        key = -1;
+        while ((child = radix_tree_next_child_node(tree->root, &key)) != NULL)
+        {
+            radix_tree_delete_values(tree, child);
+        }
+    }
+
+    value = tree->root->value;
+    radix_arena_reset(tree->arena);
+    tree->root = new_radix_tree_node(tree, 0, NULL, 0, 0);
+    if (tree->root != NULL)
+    {
+        tree->root->value = value;
+    }
+}
+
+/* removes every key but the empty one */
+void radix_tree_clear(radix_tree_t *tree)
+{
+    if (tree->log != NULL)
+    {
+        radix_log_append(tree->log, RADIX_LOG_CLEAR, NULL, 0, NULL);
+    }
+    radix_tree_empty(tree);
+}
+
+static void radix_tree_setup(radix_tree_t *tree,
+    int table_size,
+    radix_copy_fn copy_leaf,
+    radix_destruct_fn delete_leaf,
+    radix_arena_t *arena)
+{
+    tree->copy_leaf = copy_leaf;
+    tree->delete_leaf = delete_leaf;
+    tree->table_size = table_size;
+    tree->arena = arena;
+    tree->epoch = NULL;
+    tree->log = NULL;
+    memset(&tree->counters, 0, sizeof(tree->counters));
+    tree->generation = 0;
+    tree->snapshots = NULL;
+    tree->deferred = NULL;
+    tree->deferred_tail = NULL;
+    tree->lazy_remove = 0;
+    tree->tombstones = NULL;
+    tree->root = new_radix_tree_node(tree, 0, NULL, 0, 0);
+}
+
+void radix_tree_init(radix_tree_t *tree,
+    int table_size,
+    radix_copy_fn copy_leaf,
+    radix_destruct_fn delete_leaf)
+{
+    radix_tree_setup(tree, table_size, copy_leaf, delete_leaf, NULL);
+}
+
+radix_tree_t *radix_tree_create(int table_size, radix_copy_fn copy_leaf, radix_destruct_fn delete_leaf)
+{
+    radix_tree_t *tree;
+    tree = malloc(sizeof(radix_tree_t));
+    if (tree != NULL)
+    {
+        radix_tree_init(tree, table_size, copy_leaf, delete_leaf);
+    }
+    return tree;
+}
+
+radix_tree_t *radix_tree_create_arena(radix_copy_fn copy_leaf,
+    radix_destruct_fn delete_leaf,
+    int block_size)
+{
+    radix_tree_t *tree;
+    radix_arena_t *arena;
+    tree = malloc(sizeof(radix_tree_t));
+    if (tree != NULL)
+    {
+        arena = radix_arena_create(block_size > 0 ? (size_t)block_size : 0);
+        if (arena == NULL)
+        {
+            free(tree);
+            return NULL;
+        }
+        radix_tree_setup(tree, 0, copy_leaf, delete_leaf, arena);
+    }
+    return tree;
+}
+
+typedef struct
+{
+    radix_tree_t tree;  // holds the subtrees of one part under its root
+    const unsigned char **keys;
+    const int *lens;
+    void **values;
+    int n;
+} radix_build_part_t;
+
+static void *radix_tree_build_part(void *arg)
+{
+    radix_build_part_t *part = (radix_build_part_t *)arg;
+    radix_tree_bulk_load(&part->tree, part->keys, part->lens, part->values, part->n);
+    return NULL;
+}
+
+/* like radix_tree_bulk_load, but the keys are split by leading byte and
+   the subtrees of the root are built on up to threads threads; unsorted
+   input is fine, each thread then inserts its keys one by one. The tree
+   has to be empty, otherwise everything is loaded on the calling thread */
+void radix_tree_parallel_load(radix_tree_t *tree,
+    const unsigned char **keys,
+    const int *lens,
+    void **values,
+    int n,
+    int threads)
+{
+    radix_partition_t partition;
+    radix_build_part_t *parts;
+    radix_thread_t *handles;
+    radix_tree_node_t *child;
+    radix_arena_t *arena;
+    int started;
+    int key;
+    int i;
+
+    parts = NULL;
+    handles = NULL;
+    if (threads > 1 && tree->root->table == NULL && tree->snapshots == NULL
+        && radix_partition_init(&partition, keys, lens, values, n, 1, threads))
+    {
+        parts = (radix_build_part_t *)calloc(partition.parts, sizeof(radix_build_part_t));
+        handles = (radix_thread_t *)calloc(partition.parts, sizeof(radix_thread_t));
+        if (parts == NULL || handles == NULL)
+        {
+            radix_partition_release(&partition);
+        }
+    }
+
+    if (parts == NULL || handles == NULL)
+    {
+        free(parts);
+        free(handles);
+        radix_tree_bulk_load(tree, keys, lens, values, n);
+        return;
+    }
+
+    radix_tree_log_inserts(tree, partition.keys, partition.lens, partition.values, partition.n);
+
+    // every part allocates from its own arena, they are merged afterwards
+    for (i = 0; i < partition.parts; i++)
+    {
+        arena = tree->arena != NULL ? radix_arena_create(tree->arena->block_size) : NULL;
+        radix_tree_setup(&parts[i].tree, tree->table_size, tree->copy_leaf, tree->delete_leaf, arena);
+        parts[i].keys = partition.keys + partition.bounds[i];
+        parts[i].lens = partition.lens + partition.bounds[i];
+        parts[i].values = partition.values + partition.bounds[i];
+        parts[i].n = partition.bounds[i + 1] - partition.bounds[i];
+    }
+
+    // the calling thread builds the first part itself
+    started = 1;
+    while (started < partition.parts
+        && radix_thread_create(&handles[started], radix_tree_build_part, &parts[started]) == 0)
+    {
+        started++;
+    }
+    radix_tree_build_part(&parts[0]);
+    for (i = started; i < partition.parts; i++)
+    {
+        radix_tree_build_part(&parts[i]);
+    }
+    for (i = 1; i < started; i++)
+    {
+        radix_thread_join(handles[i]);
+    }
+
+    // the parts cover disjoint leading bytes, so their root children
+    // move over unchanged
+    for (i = 0; i < partition.parts; i++)
+    {
+        if (parts[i].tree.root != NULL)
+        {
+            key = -1;
+            while ((child = radix_tree_next_child_node(parts[i].tree.root, &key)) != NULL)
+            {
+                radix_tree_put_child_node(tree, tree->root, (unsigned char)key, child);
+            }
+            if (parts[i].tree.root->table != NULL)
+            {
+                radix_tree_mfree(&parts[i].tree, parts[i].tree.root->table, radix_table_bytes(parts[i].tree.root->table->type));
+            }
+            radix_tree_mfree(&parts[i].tree, parts[i].tree.root, sizeof(radix_tree_node_t));
+        }
+        if (parts[i].tree.arena != NULL)
+        {
+            radix_arena_merge(tree->arena, parts[i].tree.arena);
+        }
+    }
+
+    for (i = partition.n; i < partition.n + partition.short_n; i++)
+    {
+        radix_tree_insert(tree, partition.keys[i], partition.lens[i], partition.values[i]);
+    }
+
+    radix_partition_release(&partition);
+    free(parts);
+    free(handles);
+}
+
+typedef struct
+{
+    const unsigned char **keys;
+    const int *lens;
+    void **values;
+    int n;
+    int max_len;
+    int sorted;     // nonzero when the arrays are the caller's
+} radix_sorted_batch_t;
+
+typedef struct
+{
+    radix_tree_node_t *node;
+    int end;        // key length at the end of the node label
+} radix_batch_frame_t;
+
+/* byte order, a key before every key it is a prefix of */
+static int radix_key_compare(const unsigned char *a, int a_len, const unsigned char *b, int b_len)
+{
+    int len;
+    int lcp;
+
+    len = a_len < b_len ? a_len : b_len;
+    lcp = radix_key_mismatch(a, b, len);
+    if (lcp < len)
+    {
+        return (int)a[lcp] - (int)b[lcp];
+    }
+    return a_len - b_len;
+}
+
+typedef struct
+{
+    radix_word_t word;  // 8 key bytes from the sort depth on, first byte highest
+    int index;
+} radix_sort_item_t;
+
+/* by word, ties by the whole keys */
+static void radix_sort_insertion(const unsigned char **keys, const int *lens, radix_sort_item_t *items, int n)
+{
+    radix_sort_item_t item;
+    int i;
+    int j;
+
+    for (i = 1; i < n; i++)
+    {
+        item = items[i];
+        for (j = i; j > 0 && (item.word < items[j - 1].word || (item.word == items[j - 1].word
+            && radix_key_compare(keys[item.index], lens[item.index],
+                keys[items[j - 1].index], lens[items[j - 1].index]) < 0)); j--)
+        {
+            items[j] = items[j - 1];
+        }
+        items[j] = item;
+    }
+}
+
+/* sorts n items by the 8 key bytes from depth on. Few items go by
+   insertion, ties by the whole keys, and 0 is returned; more go through a
+   byte per pass LSD radix sort that leaves ties in their order */
+static int radix_sort_words(const unsigned char **keys,
+    const int *lens,
+    radix_sort_item_t *items,
+    radix_sort_item_t *tmp,
+    int n,
+    int depth,
+    int (*count)[256])
+{
+    radix_sort_item_t *out;
+    radix_sort_item_t *swap;
+    int shift;
+    int total;
+    int b;
+    int i;
+    int j;
+
+    for (i = 0; i < n; i++)
+    {
+        items[i].word = 0;
+        for (j = depth; j < depth + 8; j++)
+        {
+            items[i].word = items[i].word << 8 | (j < lens[items[i].index] ? keys[items[i].index][j] : 0);
+        }
+    }
+    if (n < 64)
+    {
+        radix_sort_insertion(keys, lens, items, n);
+        return 0;
+    }
+
+    // one pass counts the bytes for every position
+    memset(count, 0, 8 * sizeof(*count));
+    for (i = 0; i < n; i++)
+    {
+        for (b = 0; b < 8; b++)
+        {
+            count[b][(items[i].word >> (8 * b)) & 0xff]++;
+        }
+    }
+
+    out = items;
+    for (b = 0; b < 8; b++)
+    {
+        shift = 8 * b;
+        if (count[b][(items[0].word >> shift) & 0xff] == n)
+        {
+            continue;
+        }
+        for (j = 0, total = 0; j < 256; j++)
+        {
+            total += count[b][j];
+            count[b][j] = total - count[b][j];
+        }
+        for (i = 0; i < n; i++)
+        {
+            tmp[count[b][(items[i].word >> shift) & 0xff]++] = items[i];
+        }
+        swap = items;
+        items = tmp;
+        tmp = swap;
+    }
+    if (items != out)
+    {
+        memcpy(out, items, n * sizeof(radix_sort_item_t));
+    }
+    return 1;
+}
+
+typedef struct
+{
+    int offset;
+    int n;
+    int depth;      // bytes every key in the range agrees on
+} radix_sort_range_t;
+
+/* stable sort of n items whose keys agree on the first depth bytes, by
+   words of 8 bytes at a time. A run that still ties goes back on the
+   stack past the bytes all of its keys share, so long common parts cost
+   one step and no recursion; returns 0 when out of memory */
+static int radix_tree_sort_keys(const unsigned char **keys,
+    const int *lens,
+    radix_sort_item_t *items,
+    radix_sort_item_t *tmp,
+    int n,
+    int depth)
+{
+    radix_sort_range_t *stack;
+    radix_sort_range_t range;
+    radix_sort_item_t *run;
+    const unsigned char *first;
+    int (*count)[256];
+    int top;
+    int min_len;
+    int max_len;
+    int next;
+    int shared;
+    int i;
+    int j;
+    int k;
+
+    // the ranges on the stack never overlap and hold 2 items or more
+    stack = (radix_sort_range_t *)malloc((n / 2 + 1) * sizeof(radix_sort_range_t));
+    count = (int (*)[256])malloc(8 * sizeof(*count));
+    if (stack == NULL || count == NULL)
+    {
+        free(stack);
+        free(count);
+        return 0;
+    }
+
+    top = 0;
+    stack[top].offset = 0;
+    stack[top].n = n;
+    stack[top].depth = depth;
+    top++;
+    while (top > 0)
+    {
+        range = stack[--top];
+        run = items + range.offset;
+        if (!radix_sort_words(keys, lens, run, tmp + range.offset, range.n, range.depth, count))
+        {
+            continue;
+        }
+
+        // the words only tell apart keys that differ in these 8 bytes
+        for (i = 0; i < range.n; i = j)
+        {
+            min_len = max_len = lens[run[i].index];
+            for (j = i + 1; j < range.n && run[j].word == run[i].word; j++)
+            {
+                min_len = lens[run[j].index] < min_len ? lens[run[j].index] : min_len;
+                max_len = lens[run[j].index] > max_len ? lens[run[j].index] : max_len;
+            }
+            if (j - i == 1)
+            {
+                continue;
+            }
+            next = range.depth + 8;
+            if (max_len <= next)
+            {
+                // equal up to trailing zero bytes
+                radix_sort_insertion(keys, lens, run + i, j - i);
+                continue;
+            }
+
+            if (min_len > next)
+            {
+                // skip the bytes the whole run shares
+                first = keys[run[i].index];
+                shared = min_len - next;
+                for (k = i + 1; k < j && shared > 0; k++)
+                {
+                    shared = radix_key_mismatch(first + next, keys[run[k].index] + next, shared);
+                }
+                next += shared;
+            }
+            stack[top].offset = range.offset + i;
+            stack[top].n = j - i;
+            stack[top].depth = next;
+            top++;
+        }
+    }
+
+    free(stack);
+    free(count);
+    return 1;
+}
+
+/* the batch in byte order, sorted into arrays of its own unless it
+   already is; returns 0 when out of memory */
+static int radix_sorted_batch_init(radix_sorted_batch_t *batch,
+    const unsigned char **keys,
+    const int *lens,
+    void **values,
+    int n)
+{
+    const unsigned char **sorted_keys;
+    int *sorted_lens;
+    void **sorted_values;
+    radix_sort_item_t *items;
+    radix_sort_item_t *tmp;
+    int shared;
+    int i;
+
+    batch->n = n;
+    batch->sorted = radix_tree_bulk_sorted(keys, lens, n, &batch->max_len);
+    if (batch->sorted)
+    {
+        batch->keys = keys;
+        batch->lens = lens;
+        batch->values = values;
+        return 1;
+    }
+
+    sorted_keys = (const unsigned char **)malloc(n * sizeof(const unsigned char *));
+    sorted_lens = (int *)malloc(n * sizeof(int));
+    sorted_values = values != NULL ? (void **)malloc(n * sizeof(void *)) : NULL;
+    items = (radix_sort_item_t *)malloc(n * sizeof(radix_sort_item_t));
+    tmp = (radix_sort_item_t *)malloc(n * sizeof(radix_sort_item_t));
+    if (sorted_keys == NULL || sorted_lens == NULL || (values != NULL && sorted_values == NULL)
+        || items == NULL || tmp == NULL)
+    {
+        free((void *)sorted_keys);
+        free(sorted_lens);
+        free(sorted_values);
+        free(items);
+        free(tmp);
+        return 0;
+    }
+
+    // the check above stopped short of the longest key
+    shared = n > 0 ? lens[0] : 0;
+    for (i = 0; i < n; i++)
+    {
+        shared = radix_key_mismatch(keys[0], keys[i], lens[i] < shared ? lens[i] : shared);
+        items[i].index = i;
+    }
+    if (!radix_tree_sort_keys(keys, lens, items, tmp, n, shared))
+    {
+        free((void *)sorted_keys);
+        free(sorted_lens);
+        free(sorted_values);
+        free(items);
+        free(tmp);
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (lens[i] > batch->max_len)
+        {
+            batch->max_len = lens[i];
+        }
+        sorted_keys[i] = keys[items[i].index];
+        sorted_lens[i] = lens[items[i].index];
+        if (values != NULL)
+        {
+            sorted_values[i] = values[items[i].index];
+        }
+    }
+    free(items);
+    free(tmp);
+
+    batch->keys = sorted_keys;
+    batch->lens = sorted_lens;
+    batch->values = sorted_values;
+    return 1;
+}
+
+static void radix_sorted_batch_release(radix_sorted_batch_t *batch)
+{
+    if (!batch->sorted)
+    {
+        free((void *)batch->keys);
+        free((void *)batch->lens);
+        free(batch->values);
+    }
+}
+
+/* goes down from the top frame to the node that ends at key_len, making
+   what is missing the way radix_tree_replace does and pushing every node
+   on the way; NULL when out of memory */
+static radix_tree_node_t *radix_tree_batch_make(radix_tree_t *tree,
+    radix_batch_frame_t *frames,
+    int *depth,
+    const unsigned char *key,
+    int key_len)
+{
+    radix_tree_node_t *node;
+    radix_tree_node_t *child;
+    int off;
+    int a_off;
+
+    node = frames[*depth].node;
+    off = frames[*depth].end;
+    while (off < key_len)
+    {
+        child = radix_tree_get_child_node(node, OFFSET_KEY(key, off));
+        if (child == NULL)
+        {
+            child = new_radix_tree_node(tree, OFFSET_KEY(key, off), key, off, key_len);
+            if (child == NULL)
+            {
+                return NULL;
+            }
+            radix_tree_put_child_node(tree, node, OFFSET_KEY(key, off), child);
+            off = key_len;
+        }
+        else
+        {
+            child = radix_tree_own(tree, node, child);
+            if (child == NULL)
+            {
+                return NULL;
+            }
+            a_off = radix_tree_match_label(tree, child, key, off, key_len);
+            if (a_off < child->keys_len)
+            {
+                child = radix_tree_split_node(tree, node, child, a_off);
+                if (child == NULL)
+                {
+                    return NULL;
+                }
+            }
+            off += a_off;
+        }
+
+        (*depth)++;
+        frames[*depth].node = child;
+        frames[*depth].end = off;
+        node = child;
+    }
+    return node;
+}
+
+/* goes down from the top frame without changing anything, pushing the
+   nodes key runs through; returns the node key ends at, NULL when none */
+static radix_tree_node_t *radix_tree_batch_find(radix_tree_t *tree,
+    radix_batch_frame_t *frames,
+    int *depth,
+    const unsigned char *key,
+    int key_len)
+{
+    radix_tree_node_t *node;
+    int off;
+    int a_off;
+
+    node = frames[*depth].node;
+    off = frames[*depth].end;
+    while (off < key_len)
+    {
+        node = radix_tree_get_child_node(node, OFFSET_KEY(key, off));
+        if (node == NULL)
+        {
+            return NULL;
+        }
+        a_off = radix_tree_match_label(tree, node, key, off, key_len);
+        if (a_off < node->keys_len)
+        {
+            return NULL;
+        }
+        off += a_off;
+
+        (*depth)++;
+        frames[*depth].node = node;
+        frames[*depth].end = off;
+    }
+    return node;
+}
+
+/* tidies a node an erase or compact batch is done with: it goes once
+   it has neither a value nor children, and is merged into a single child */
+static void radix_tree_batch_leave(radix_tree_t *tree, radix_tree_node_t *parent, radix_tree_node_t *node)
+{
+    if (node->value == NULL && node->table == NULL)
+    {
+        radix_tree_del_child_node(tree, parent, node->key);
+        radix_tree_retire_node(tree, node);
+    }
+    else
+    {
+        radix_tree_merge_node(tree, parent, node);
+    }
+}
+
+// what radix_tree_apply_batch does with each key
+#define RADIX_BATCH_INSERT  0
+#define RADIX_BATCH_ERASE   1
+#define RADIX_BATCH_COMPACT 2   // only tidies the nodes on its path
+
+/* applies a sorted batch: every key starts from the deepest node it
+   shares with the key before it instead of the root. Since no key comes
+   back to a node the batch has moved past, an erase batch leaves the
+   removal and merging of emptied nodes until then and does it once.
+   Returns 0 when out of memory before a compact batch could start */
+static int radix_tree_apply_batch(radix_tree_t *tree, const radix_sorted_batch_t *batch, int mode)
+{
+    radix_batch_frame_t *frames;
+    radix_tree_node_t *node;
+    void *value;
+    int depth = 0;
+    int owned = 0;  // frames below this one are the live tree's own
+    int lcp;
+    int len;
+    int i;
+
+    frames = (radix_batch_frame_t *)malloc((batch->max_len + 2) * sizeof(radix_batch_frame_t));
+    if (frames == NULL)
+    {
+        for (i = 0; i < batch->n && mode != RADIX_BATCH_COMPACT; i++)
+        {
+            if (mode == RADIX_BATCH_ERASE)
+            {
+                radix_tree_erase(tree, batch->keys[i], batch->lens[i]);
+            }
+            else
+            {
+                radix_tree_insert(tree, batch->keys[i], batch->lens[i], batch->values[i]);
+            }
+        }
+        return mode != RADIX_BATCH_COMPACT;
+    }
+
+    frames[0].node = tree->root;
+    frames[0].end = 0;
+    for (i = 0; i < batch->n; i++)
+    {
+        lcp = 0;
+        if (i > 0)
+        {
+            len = batch->lens[i - 1] < batch->lens[i] ? batch->lens[i - 1] : batch->lens[i];
+            lcp = radix_key_mismatch(batch->keys[i - 1], batch->keys[i], len);
+        }
+
+        // keep the frames on the path both keys share
+        while (frames[depth].end > lcp)
+        {
+            if (mode != RADIX_BATCH_INSERT && depth < owned)
+            {
+                radix_tree_batch_leave(tree, frames[depth - 1].node, frames[depth].node);
+            }
+            depth--;
+        }
+        if (owned > depth + 1)
+        {
+            owned = depth + 1;
+        }
+
+        if (mode == RADIX_BATCH_INSERT)
+        {
+            RADIX_COUNT(tree, inserts, 1);
+            if (tree->log != NULL)
+            {
+                radix_log_append(tree->log, RADIX_LOG_INSERT, batch->keys[i], batch->lens[i], batch->values[i]);
+            }
+            for (; owned <= depth; owned++)
+            {
+                node = radix_tree_own(tree, owned > 0 ? frames[owned - 1].node : NULL, frames[owned].node);
+                if (node == NULL)
+                {
+                    break;
+                }
+                frames[owned].node = node;
+            }
+            node = NULL;
+            if (owned > depth)
+            {
+                node = radix_tree_batch_make(tree, frames, &depth, batch->keys[i], batch->lens[i]);
+                owned = depth + 1;
+            }
+            if (node != NULL)
+            {
+                value = node->value;
+                RADIX_STORE_PTR(node->value, tree->copy_leaf != NULL ? tree->copy_leaf(batch->values[i]) : batch->values[i]);
+                radix_tree_retire_value(tree, value);
+            }
+            continue;
+        }
+
+        node = radix_tree_batch_find(tree, frames, &depth, batch->keys[i], batch->lens[i]);
+        if (mode == RADIX_BATCH_COMPACT)
+        {
+            // a key that was put back keeps its node, which leave skips
+            if (node == NULL)
+            {
+                continue;
+            }
+        }
+        else
+        {
+            RADIX_COUNT(tree, removes, 1);
+            if (node == NULL || node->value == NULL)
+            {
+                continue;
+            }
+        }
+        for (; owned <= depth; owned++)
+        {
+            node = radix_tree_own(tree, owned > 0 ? frames[owned - 1].node : NULL, frames[owned].node);
+            if (node == NULL)
+            {
+                break;
+            }
+            frames[owned].node = node;
+        }
+        if (owned > depth && mode == RADIX_BATCH_ERASE)
+        {
+            if (tree->log != NULL)
+            {
+                radix_log_append(tree->log, RADIX_LOG_REMOVE, batch->keys[i], batch->lens[i], NULL);
+            }
+            node = frames[depth].node;
+            value = node->value;
+            RADIX_STORE_PTR(node->value, NULL);
+            radix_tree_retire_value(tree, value);
+        }
+    }
+
+    for (; depth > 0; depth--)
+    {
+        if (mode != RADIX_BATCH_INSERT && depth < owned)
+        {
+            radix_tree_batch_leave(tree, frames[depth - 1].node, frames[depth].node);
+        }
+    }
+    free(frames);
+    return 1;
+}
+
+/* radix_tree_insert for n keys in a row, equal keys end up with the last
+   of their values. Unsorted batches are sorted first, an empty tree is
+   bulk loaded */
+void radix_tree_insert_batch(radix_tree_t *tree,
+    const unsigned char **keys,
+    const int *lens,
+    void **values,
+    int n)
+{
+    radix_sorted_batch_t batch;
+    int i;
+
+    if (!radix_sorted_batch_init(&batch, keys, lens, values, n))
+    {
+        for (i = 0; i < n; i++)
+        {
+            radix_tree_insert(tree, keys[i], lens[i], values[i]);
+        }
+        return;
+    }
+
+    if (tree->root->table == NULL && tree->root->value == NULL && tree->snapshots == NULL)
+    {
+        radix_tree_bulk_load(tree, batch.keys, batch.lens, batch.values, n);
+    }
+    else
+    {
+        radix_tree_apply_batch(tree, &batch, RADIX_BATCH_INSERT);
+    }
+    radix_sorted_batch_release(&batch);
+}
+
+/* radix_tree_erase for n keys, keys that are not in the tree are skipped */
+void radix_tree_erase_batch(radix_tree_t *tree, const unsigned char **keys, const int *lens, int n)
+{
+    radix_sorted_batch_t batch;
+    int i;
+
+    if (!radix_sorted_batch_init(&batch, keys, lens, NULL, n))
+    {
+        for (i = 0; i < n; i++)
+        {
+            radix_tree_erase(tree, keys[i], lens[i]);
+        }
+        return;
+    }
+
+    radix_tree_apply_batch(tree, &batch, RADIX_BATCH_ERASE);
+    radix_sorted_batch_release(&batch);
+}
+
+/* takes the oldest budget keys off the queue and tidies their paths as
+   one sorted batch, so the work a call does is bounded by budget */
+int radix_tree_compact(radix_tree_t *tree, int budget)
+{
+    radix_tombstones_t *tombstones;
+    radix_tombstone_block_t *block;
+    radix_tombstone_block_t *taken;
+    radix_sorted_batch_t batch;
+    const unsigned char **keys;
+    int *lens;
+    size_t off;
+    int done;
+    int n;
+    int i;
+
+    tombstones = tree->tombstones;
+    if (tombstones == NULL || tombstones->keys == 0)
+    {
+        return 0;
+    }
+
+    n = budget <= 0 || budget > tombstones->keys ? tombstones->keys : budget;
+    keys = (const unsigned char **)malloc(n * sizeof(const unsigned char *));
+    lens = (int *)malloc(n * sizeof(int));
+    if (keys == NULL || lens == NULL)
+    {
+        free((void *)keys);
+        free(lens);
+        return tombstones->keys;
+    }
+
+    block = tombstones->head;
+    off = tombstones->off;
+    for (i = 0; i < n; i++)
+    {
+        if (off == block->len)
+        {
+            block = block->next;
+            off = 0;
+        }
+        memcpy(&lens[i], block->buf + off, sizeof(int));
+        keys[i] = block->buf + off + sizeof(int);
+        off += sizeof(int) + lens[i];
+    }
+
+    done = 0;
+    if (radix_sorted_batch_init(&batch, keys, lens, NULL, n))
+    {
+        done = radix_tree_apply_batch(tree, &batch, RADIX_BATCH_COMPACT);
+        radix_sorted_batch_release(&batch);
+    }
+    free((void *)keys);
+    free(lens);
+    if (!done)
+    {
+        return tombstones->keys;
+    }
+
+    tombstones->keys -= n;
+    if (tombstones->keys == 0)
+    {
+        radix_tree_drop_tombstones(tree);
+        return 0;
+    }
+    while (tombstones->head != block)
+    {
+        taken = tombstones->head;
+        tombstones->head = taken->next;
+        radix_tombstones_recycle(tombstones, taken);
+    }
+    tombstones->off = off;
+    return tombstones->keys;
+}
+
+typedef struct
+{
+    int fd;
+    int failed;
+    size_t len;
+    unsigned long long off;     // image bytes written so far, buffered ones included
+    unsigned long long nodes;
+    unsigned char buf[64 * 1024];
+} radix_image_writer_t;
+
+static void radix_image_flush(radix_image_writer_t *w)
+{
+    size_t done;
+    int n;
+
+    for (done = 0; done < w->len && !w->failed; done += n)
+    {
+        n = RADIX_WRITE(w->fd, w->buf + done, (unsigned int)(w->len - done));
+        if (n <= 0)
+        {
+            w->failed = 1;
+        }
+    }
+    w->len = 0;
+}
+
+static void radix_image_write(radix_image_writer_t *w, const void *p, size_t len)
+{
+    size_t n;
+
+    w->off += len;
+    while (len > 0)
+    {
+        if (w->len == sizeof(w->buf))
+        {
+            radix_image_flush(w);
+        }
+        n = sizeof(w->buf) - w->len;
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(w->buf + w->len, p, n);
+        w->len += n;
+        p = (const unsigned char *)p + n;
+        len -= n;
+    }
+}
+
+static void radix_image_pad(radix_image_writer_t *w)
+{
+    static const unsigned char zeros[8];
+    radix_image_write(w, zeros, RADIX_IMAGE_ALIGN(w->off) - w->off);
+}
+
+/* writes the children first so the node can refer to them by offset,
+   returns the offset of the node or 0 once a write failed */
+static unsigned long long radix_tree_save_node(radix_image_writer_t *w, radix_tree_node_t *node)
+{
+    radix_image_node_t record;
+    radix_tree_node_t *child;
+    unsigned long long *offsets;
+    unsigned char *keys;
+    unsigned long long off;
+    int items;
+    int key;
+    int i;
+
+    items = RADIX_NODE_ITEMS(node);
+    offsets = NULL;
+    keys = NULL;
+    if (items > 0)
+    {
+        offsets = (unsigned long long *)calloc(items > RADIX_IMAGE_DIRECT ? 256 : items, sizeof(unsigned long long));
+        keys = (unsigned char *)malloc(RADIX_IMAGE_ALIGN(items));
+        if (offsets == NULL || keys == NULL)
+        {
+            w->failed = 1;
+        }
+    }
+
+    key = -1;
+    for (i = 0; !w->failed && (child = radix_tree_next_child_node(node, &key)) != NULL; i++)
+    {
+        off = radix_tree_save_node(w, child);
+        if (items > RADIX_IMAGE_DIRECT)
+        {
+            offsets[key] = off;
+        }
+        else
+        {
+            keys[i] = (unsigned char)key;
+            offsets[i] = off;
+        }
+    }
+
+    off = w->off;
+    if (!w->failed)
+    {
+        memset(&record, 0, sizeof(record));
+        record.value = (unsigned long long)(size_t)node->value;
+        record.keys_len = node->keys_len;
+        record.items = (unsigned short)items;
+        record.direct = items > RADIX_IMAGE_DIRECT;
+        radix_image_write(w, &record, sizeof(record));
+        radix_image_write(w, RADIX_NODE_KEYS(node), node->keys_len);
+        radix_image_pad(w);
+        if (record.direct)
+        {
+            radix_image_write(w, offsets, 256 * sizeof(unsigned long long));
+        }
+        else if (items > 0)
+        {
+            memset(keys + items, 0, RADIX_IMAGE_ALIGN(items) - items);
+            radix_image_write(w, keys, RADIX_IMAGE_ALIGN(items));
+            radix_image_write(w, offsets, items * sizeof(unsigned long long));
+        }
+        w->nodes++;
+    }
+
+    free(offsets);
+    free(keys);
+    return w->failed ? 0 : off;
+}
+
+/* writes an image of the tree to fd for radix_tree_open_mmap. Values are
+   stored as the words they are, so they have to mean the same thing to
+   the processes that map the image, indexes rather than pointers.
+   Returns 0 on success and -1 if a write failed */
+int radix_tree_save(radix_tree_t *tree, int fd)
+{
+    radix_image_writer_t *w;
+    radix_image_header_t header;
+    radix_image_trailer_t trailer;
+    int failed;
+
+    w = (radix_image_writer_t *)malloc(sizeof(radix_image_writer_t));
+    if (w == NULL)
+    {
+        return -1;
+    }
+    w->fd = fd;
+    w->failed = 0;
+    w->len = 0;
+    w->off = 0;
+    w->nodes = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RADIX_IMAGE_MAGIC, 8);
+    header.order = RADIX_IMAGE_ORDER;
+    header.word_size = sizeof(void *);
+    radix_image_write(w, &header, sizeof(header));
+
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.root = radix_tree_save_node(w, tree->root);
+    trailer.nodes = w->nodes;
+    memcpy(trailer.magic, RADIX_IMAGE_MAGIC, 8);
+    radix_image_write(w, &trailer, sizeof(trailer));
+    radix_image_flush(w);
+
+    failed = w->failed;
+    free(w);
+    return failed ? -1 : 0;
+}
+
+/* lays the nodes out in level order, the layout radix_frozen_t
+   expects; the tree must not change meanwhile */
+radix_frozen_t *radix_tree_freeze(radix_tree_t *tree)
+{
+    radix_frozen_t *frozen;
+    radix_tree_node_t **order;
+    radix_tree_node_t **p;
+    radix_tree_node_t *node;
+    radix_tree_node_t *child;
+    size_t size;
+    size_t head;
+    size_t count;
+    size_t values;
+    size_t tails;
+    size_t n;
+    size_t c;
+    int key;
+    int ok;
+
+    size = 1024;
+    order = (radix_tree_node_t **)malloc(size * sizeof(radix_tree_node_t *));
+    if (order == NULL)
+    {
+        return NULL;
+    }
+
+    order[0] = tree->root;
+    values = tree->root->value != NULL;
+    tails = 0;
+    for (head = 0, count = 1; head < count; head++)
+    {
+        key = -1;
+        while ((child = radix_tree_next_child_node(order[head], &key)) != NULL)
+        {
+            if (count == size)
+            {
+                size *= 2;
+                p = (radix_tree_node_t **)realloc(order, size * sizeof(radix_tree_node_t *));
+                if (p == NULL)
+                {
+                    free(order);
+                    return NULL;
+                }
+                order = p;
+            }
+            order[count++] = child;
+            values += child->value != NULL;
+            tails += child->keys_len - 1;
+        }
+    }
+
+    frozen = (radix_frozen_t *)calloc(1, sizeof(radix_frozen_t));
+    if (frozen == NULL)
+    {
+        free(order);
+        return NULL;
+    }
+    frozen->nodes = count;
+    frozen->edges = count - 1;
+    frozen->tail_len = tails;
+    frozen->copy_leaf = tree->copy_leaf;
+    frozen->edge_keys = (unsigned char *)malloc(count);
+    frozen->tails = (unsigned char *)malloc(tails + 1);
+    frozen->values = (void **)malloc((values + 1) * sizeof(void *));
+    ok = frozen->edge_keys != NULL && frozen->tails != NULL && frozen->values != NULL
+        && radix_bits_init(&frozen->has_child, count)
+        && radix_bits_init(&frozen->has_value, count)
+        && radix_bits_init(&frozen->has_tail, count)
+        && radix_bits_init(&frozen->first_edge, count - 1)
+        && radix_bits_init(&frozen->tail_start, tails);
+
+    // children of a node take the next ids in level order
+    values = 0;
+    tails = 0;
+    c = 1;
+    for (n = 0; ok && n < count; n++)
+    {
+        node = order[n];
+        if (RADIX_NODE_ITEMS(node) > 0)
+        {
+            radix_bits_set(&frozen->has_child, n);
+            radix_bits_set(&frozen->first_edge, c - 1);
+            c += RADIX_NODE_ITEMS(node);
+        }
+        if (node->value != NULL)
+        {
+            radix_bits_set(&frozen->has_value, n);
+            frozen->values[values++] = node->value;
+        }
+        if (n > 0)
+        {
+            frozen->edge_keys[n - 1] = RADIX_NODE_KEYS(node)[0];
+            if (node->keys_len > 1)
+            {
+                radix_bits_set(&frozen->has_tail, n);
+                radix_bits_set(&frozen->tail_start, tails);
+                memcpy(frozen->tails + tails, RADIX_NODE_KEYS(node) + 1, node->keys_len - 1);
+                tails += node->keys_len - 1;
+            }
+        }
+    }
+    free(order);
+
+    ok = ok && radix_bits_index(&frozen->has_child)
+        && radix_bits_index(&frozen->has_value)
+        && radix_bits_index(&frozen->has_tail)
+        && radix_bits_index(&frozen->first_edge)
+        && radix_bits_index(&frozen->tail_start);
+    if (!ok)
+    {
+        radix_frozen_destroy(frozen);
+        return NULL;
+    }
+
+    frozen->bytes = sizeof(radix_frozen_t) + count + frozen->tail_len + values * sizeof(void *)
+        + radix_bits_bytes(&frozen->has_child) + radix_bits_bytes(&frozen->has_value)
+        + radix_bits_bytes(&frozen->has_tail) + radix_bits_bytes(&frozen->first_edge)
+        + radix_bits_bytes(&frozen->tail_start);
+    return frozen;
+}
+
+/* releases everything the tree owns but not the tree itself */
+void radix_tree_release(radix_tree_t *tree)
+{
+    assert(tree->snapshots == NULL);
+    if (tree->tombstones != NULL)
+    {
+        radix_tree_drop_tombstones(tree);
+        free(tree->tombstones->spare);
+        free(tree->tombstones);
+        tree->tombstones = NULL;
+    }
+    if (tree->arena != NULL)
+    {
+        if (tree->delete_leaf != NULL && tree->root != NULL)
+        {
+            radix_tree_delete_values(tree, tree->root);
+        }
+        radix_arena_destroy(tree->arena);
+        tree->arena = NULL;
+        tree->root = NULL;
+        return;
+    }
+
+    if (tree->root)
+    {
+        free_radix_tree_node(tree, tree->root);
+        tree->root = NULL;
+    }
+}
+
+void radix_tree_destroy(radix_tree_t *tree)
+{
+    radix_tree_release(tree);
+    free(tree);
+}
+
+radix_snapshot_t *radix_tree_snapshot(radix_tree_t *tree)
+{
+    radix_snapshot_t *snapshot;
+
+    snapshot = (radix_snapshot_t *)malloc(sizeof(radix_snapshot_t));
+    if (snapshot == NULL)
+    {
+        return NULL;
+    }
+
+    // no epoch, log or delete_leaf, nothing reachable from the view is
+    // freed before it is released
+    memset(&snapshot->view, 0, sizeof(radix_tree_t));
+    snapshot->view.root = tree->root;
+    snapshot->view.copy_leaf = tree->copy_leaf;
+    snapshot->view.generation = tree->generation;
+    snapshot->tree = tree;
+    snapshot->generation = tree->generation;
+    snapshot->prev = NULL;
+    snapshot->next = tree->snapshots;
+    if (tree->snapshots != NULL)
+    {
+        tree->snapshots->prev = snapshot;
+    }
+    tree->snapshots = snapshot;
+    tree->generation++;
+    return snapshot;
+}
+
+void radix_tree_snapshot_release(radix_snapshot_t *snapshot)
+{
+    radix_tree_t *tree;
+    radix_snapshot_t *oldest;
+
+    tree = snapshot->tree;
+    if (snapshot->prev != NULL)
+    {
+        snapshot->prev->next = snapshot->next;
+    }
+    else
+    {
+        tree->snapshots = snapshot->next;
+    }
+    if (snapshot->next != NULL)
+    {
+        snapshot->next->prev = snapshot->prev;
+    }
+    free(snapshot);
+
+    // whatever was unlinked after the oldest one left is out of reach
+    oldest = tree->snapshots;
+    while (oldest != NULL && oldest->next != NULL)
+    {
+        oldest = oldest->next;
+    }
+    radix_tree_reclaim_deferred(tree, oldest != NULL ? oldest->generation : tree->generation);
+}
+
+void radix_tree_cursor_init(radix_tree_cursor_t *cursor, radix_tree_t *tree)
+{
+    memset(cursor, 0, sizeof(radix_tree_cursor_t));
+    cursor->tree = tree;
+}
+
+void radix_tree_cursor_release(radix_tree_cursor_t *cursor)
+{
+    free(cursor->stack);
+    free(cursor->key);
+    memset(cursor, 0, sizeof(radix_tree_cursor_t));
+}
+
+static int radix_cursor_end(radix_tree_cursor_t *cursor)
+{
+    cursor->depth = 0;
+    cursor->key_len = 0;
+    cursor->value = NULL;
+    return 0;
+}
+
+static int radix_cursor_found(radix_tree_cursor_t *cursor)
+{
+    cursor->value = RADIX_LOAD_PTR(cursor->stack[cursor->depth - 1].node->value);
+    return 1;
 }
 
-void radix_tree_insert(radix_tree_t *tree,
-    const unsigned char *key,
-    int key_len,
-    void *value)
+#define RADIX_CURSOR_TOP(cursor) ((cursor)->stack[(cursor)->depth - 1].node)
+
+/* moves down to child and appends its label to the key */
+static int radix_cursor_push(radix_tree_cursor_t *cursor, radix_tree_node_t *node, int key)
 {
-    radix_tree_node_t **p_node;
-    radix_tree_node_t *node;
-    radix_tree_node_t *new_node;
-    int off = 0;
-    int a_off = 0;
-    int idx;
-    int table_size;
-    int done_flag = 0;
-    table_size = tree->table_size;
-    node = tree->root;
-    for (off = 0; off < key_len; )
+    radix_cursor_frame_t *stack;
+    unsigned char *buf;
+    int size;
+    int base;
+
+    if (cursor->depth == cursor->stack_size)
     {
-        if (node->table == NULL)
+        size = cursor->stack_size == 0 ? 16 : cursor->stack_size * 2;
+        stack = (radix_cursor_frame_t *)realloc(cursor->stack, size * sizeof(radix_cursor_frame_t));
+        if (stack == NULL)
         {
-            new_node = new_radix_tree_node(OFFSET_KEY(key, off),
-                key,
-                off,
-                key_len);
-            radix_tree_put_child_node(tree, node, OFFSET_KEY(key, off), new_node);
-            node = new_node;
-            break;
+            return 0;
         }
+        cursor->stack = stack;
+        cursor->stack_size = size;
+    }
 
-        idx = OFFSET_KEY(key, off) % table_size;
-        for (p_node = &node->table[idx]; 
-            *p_node != NULL; 
-            p_node = &(*p_node)->next)
+    base = cursor->depth > 0 ? cursor->stack[cursor->depth - 1].key_len : 0;
+    if (cursor->key == NULL || base + node->keys_len > cursor->key_size)
+    {
+        size = cursor->key_size == 0 ? 64 : cursor->key_size;
+        while (size < base + node->keys_len)
         {
-            if (OFFSET_KEY(key, off) == (*p_node)->key)
-            {
-                break;
-            }
+            size *= 2;
         }
-
-        if (*p_node == NULL)
+        buf = (unsigned char *)realloc(cursor->key, size);
+        if (buf == NULL)
         {
-            *p_node = new_radix_tree_node(OFFSET_KEY(key, off), key, off, key_len);
-            node = *p_node;
-            break;
+            return 0;
         }
+        cursor->key = buf;
+        cursor->key_size = size;
+    }
+
+    if (node->keys_len > 0)
+    {
+        memcpy(cursor->key + base, RADIX_NODE_KEYS(node), node->keys_len);
+    }
+    cursor->stack[cursor->depth].node = node;
+    cursor->stack[cursor->depth].key = key;
+    cursor->stack[cursor->depth].key_len = base + node->keys_len;
+    cursor->key_len = base + node->keys_len;
+    cursor->depth++;
+    return 1;
+}
+
+/* moves back up to the parent and returns the key byte of the node left */
+static int radix_cursor_pop(radix_tree_cursor_t *cursor)
+{
+    int key;
+    key = cursor->stack[--cursor->depth].key;
+    cursor->key_len = cursor->stack[cursor->depth - 1].key_len;
+    return key;
+}
 
-        node = *p_node;
+/* finds the next node with a value in preorder, which is key order;
+   with descend unset the subtree below the current node is skipped */
+static int radix_cursor_advance(radix_tree_cursor_t *cursor, int descend)
+{
+    radix_tree_node_t *child;
+    int key;
 
-        a_off = 0;
-        while (off < key_len && a_off + node->keys_off < node->keys_len
-            && OFFSET_KEY(key, off) == OFFSET_KEY(node->keys, node->keys_off + a_off))
+    for (;;)
+    {
+        child = NULL;
+        if (descend)
         {
-            off++;
-            a_off++;
+            key = -1;
+            child = radix_tree_next_child_node(RADIX_CURSOR_TOP(cursor), &key);
         }
 
-        if (a_off + node->keys_off < node->keys_len)
+        while (child == NULL)
         {
-            radix_tree_node_t *rest;
-            rest = new_radix_tree_node(OFFSET_KEY(node->keys, node->keys_off + a_off),
-                node->keys,
-                a_off,
-                node->keys_len);
-            rest->table = node->table;
-            rest->table_items = node->table_items;
-            rest->value = node->value;
-            node->table = NULL;
-            node->table_items = 0;
-            node->keys_len = a_off;
-            node->value = NULL;
-            radix_tree_put_child_node(tree, node, OFFSET_KEY(node->keys, node->keys_off + a_off), rest);
-
-            if (off < key_len)
+            if (cursor->depth <= cursor->floor)
             {
-                new_node = new_radix_tree_node(OFFSET_KEY(key, off),
-                    key,
-                    off,
-                    key_len);
-                radix_tree_put_child_node(tree, node, OFFSET_KEY(key, off), new_node);
-                node = new_node;
+                return radix_cursor_end(cursor);
             }
-
-            break;
+            key = radix_cursor_pop(cursor);
+            child = radix_tree_next_child_node(RADIX_CURSOR_TOP(cursor), &key);
         }
-    }
 
-    if (node != NULL)
-    {
-        if (node->value != NULL && tree->delete_leaf)
+        if (!radix_cursor_push(cursor, child, key))
         {
-            tree->delete_leaf(node->value);
+            return radix_cursor_end(cursor);
         }
-
-        if (tree->copy_leaf != NULL)
+        if (child->value != NULL)
         {
-            node->value = tree->copy_leaf(value);
+            return radix_cursor_found(cursor);
         }
-        else
-        {
-            node->value = value;
-        } 
+        descend = 1;
     }
 }
 
-void *radix_tree_exact_match(radix_tree_t *tree, const unsigned char *key, int key_len)
+/* reverse preorder: the last key of the previous sibling subtree, or
+   the parent once all smaller siblings are done */
+static int radix_cursor_retreat(radix_tree_cursor_t *cursor)
 {
-    radix_tree_node_t *node;
-    int off = 0;
-    int a_off = 0;
-    int idx;
-    node = tree->root;
-    while (off < key_len)
+    radix_tree_node_t *child;
+    int key;
+
+    for (;;)
     {
-        if (node->table == NULL)
+        if (cursor->depth <= cursor->floor)
         {
-            break;
+            return radix_cursor_end(cursor);
         }
 
-        idx = OFFSET_KEY(key, off) % tree->table_size;
-        for (node = node->table[idx]; node != NULL; node = node->next)
+        key = radix_cursor_pop(cursor);
+        child = radix_tree_prev_child_node(RADIX_CURSOR_TOP(cursor), &key);
+        if (child == NULL)
         {
-            if (OFFSET_KEY(key, off) == node->key)
+            if (RADIX_CURSOR_TOP(cursor)->value != NULL)
             {
-                break;
+                return radix_cursor_found(cursor);
             }
+            continue;
         }
 
-        if (node == NULL)
-        {
-            break;
-        }
-
-        a_off = 0;
-        while (off < key_len && a_off + node->keys_off < node->keys_len
-            && OFFSET_KEY(key, off) == OFFSET_KEY(node->keys, node->keys_off + a_off))
+        do
         {
-            off++;
-            a_off++;
-        }
+            if (!radix_cursor_push(cursor, child, key))
+            {
+                return radix_cursor_end(cursor);
+            }
+            key = 256;
+        } while ((child = radix_tree_prev_child_node(child, &key)) != NULL);
 
-        if (a_off + node->keys_off < node->keys_len)
+        if (RADIX_CURSOR_TOP(cursor)->value != NULL)
         {
-            node = NULL;
-            break;
+            return radix_cursor_found(cursor);
         }
     }
+}
+
+static int radix_cursor_reset(radix_tree_cursor_t *cursor)
+{
+    cursor->depth = 0;
+    cursor->floor = 1;
+    return radix_cursor_push(cursor, cursor->tree->root, -1);
+}
 
-    if (off == key_len && node != NULL && node->value != NULL)
+/* positions the cursor on the smallest key, returns 0 if the tree is empty */
+int radix_tree_cursor_first(radix_tree_cursor_t *cursor)
+{
+    if (!radix_cursor_reset(cursor))
     {
-        if (tree->copy_leaf != NULL)
-        {
-            return tree->copy_leaf(node->value);
-        }
-        else
-        {
-            return node->value;
-        }
+        return radix_cursor_end(cursor);
     }
-    else
+    if (cursor->tree->root->value != NULL)
     {
-        return NULL;
+        return radix_cursor_found(cursor);
     }
+    return radix_cursor_advance(cursor, 1);
 }
 
-int radix_tree_prefix_match(radix_tree_t *tree, const unsigned char *key, int key_len, void **value)
+int radix_tree_cursor_last(radix_tree_cursor_t *cursor)
 {
-    radix_tree_node_t *node;
-    radix_tree_node_t *last;
-    int off = 0;
-    int a_off = 0;
-    int idx;
-    int nc = 0;
-    node = tree->root;
-    last = NULL;
-    if (node->value != NULL)
+    radix_tree_node_t *child;
+    int key;
+
+    if (!radix_cursor_reset(cursor))
     {
-        last = node;
-        nc++;
+        return radix_cursor_end(cursor);
     }
-    while (off < key_len)
+
+    key = 256;
+    while ((child = radix_tree_prev_child_node(RADIX_CURSOR_TOP(cursor), &key)) != NULL)
     {
-        if (node->table == NULL)
+        if (!radix_cursor_push(cursor, child, key))
         {
-            break;
+            return radix_cursor_end(cursor);
         }
+        key = 256;
+    }
 
-        idx = OFFSET_KEY(key, off) % tree->table_size;
-        for (node = node->table[idx]; node != NULL; node = node->next)
-        {
-            if (OFFSET_KEY(key, off) == node->key)
-            {
-                break;
-            }
-        }
+    if (RADIX_CURSOR_TOP(cursor)->value != NULL)
+    {
+        return radix_cursor_found(cursor);
+    }
+    return radix_cursor_retreat(cursor);
+}
 
-        if (node == NULL)
-        {
-            break;
-        }
+/* positions the cursor on the smallest key not less than key */
+int radix_tree_cursor_seek(radix_tree_cursor_t *cursor, const unsigned char *key, int key_len)
+{
+    radix_tree_node_t *node;
+    radix_tree_node_t *child;
+    const unsigned char *keys;
+    int off;
+    int a_off;
+    int next;
 
-        a_off = 0;
-        while (off < key_len && a_off + node->keys_off < node->keys_len
-            && OFFSET_KEY(key, off) == OFFSET_KEY(node->keys, node->keys_off + a_off))
-        {
-            off++;
-            a_off++;
-        }
+    if (!radix_cursor_reset(cursor))
+    {
+        return radix_cursor_end(cursor);
+    }
 
-        if (a_off + node->keys_off < node->keys_len)
+    node = cursor->tree->root;
+    for (off = 0; off < key_len; off += a_off)
+    {
+        child = radix_tree_get_child_node(node, OFFSET_KEY(key, off));
+        if (child == NULL)
         {
-            node = NULL;
-            break;
+            // everything below node that sorts after key starts at the
+            // next larger child, if there is none the whole subtree is smaller
+            next = OFFSET_KEY(key, off);
+            child = radix_tree_next_child_node(node, &next);
+            if (child == NULL)
+            {
+                return radix_cursor_advance(cursor, 0);
+            }
+            if (!radix_cursor_push(cursor, child, next))
+            {
+                return radix_cursor_end(cursor);
+            }
+            return child->value != NULL ? radix_cursor_found(cursor) : radix_cursor_advance(cursor, 1);
         }
 
-        if (node->value != NULL)
+        if (!radix_cursor_push(cursor, child, OFFSET_KEY(key, off)))
         {
-            last = node;
-            nc++;
+            return radix_cursor_end(cursor);
         }
-    }
 
-    if (last != NULL && last->value != NULL)
-    {
-        if (tree->copy_leaf != NULL)
-        {
-            *value =  tree->copy_leaf(last->value);
-        }
-        else
+        a_off = radix_tree_match_label(cursor->tree, child, key, off, key_len);
+        if (a_off < child->keys_len)
         {
-            *value = last->value;
+            keys = RADIX_NODE_KEYS(child);
+            if (off + a_off < key_len && keys[a_off] < OFFSET_KEY(key, off + a_off))
+            {
+                return radix_cursor_advance(cursor, 0);
+            }
+            return child->value != NULL ? radix_cursor_found(cursor) : radix_cursor_advance(cursor, 1);
         }
-    }
-    else
-    {
-        *value = NULL;
+        node = child;
     }
 
-    return nc;
+    return node->value != NULL ? radix_cursor_found(cursor) : radix_cursor_advance(cursor, 1);
 }
 
-void radix_tree_merge_node(radix_tree_node_t *node)
+int radix_tree_cursor_next(radix_tree_cursor_t *cursor)
 {
-    radix_tree_node_t *child = NULL;
-    char *keys;
-    int keys_len;
-    while (node->table_items == 1 && node->value != NULL)
+    if (cursor->depth == 0)
     {
-        for (int i = 0; i < node->table_items; i++)
-        {
-            if (node->table[i] != NULL)
-            {
-                child = node->table[i];
-                break;
-            }
-        }
-        assert (child != NULL);
-        keys_len = node->keys_len + child->keys_len;
-        keys = mergestr(node->keys, node->keys_len, child->keys, child->keys_len);
-        node->keys = keys;
-        node->keys_len = keys_len;
-        free(node->table);
-        node->table_items = child->table_items;
-        node->table = child->table;
-        node->value = child->value;
-        child->table_items = 0;
-        child->table = NULL;
-        child->value = NULL;
-        free_radix_tree_node(NULL, child);
+        return 0;
     }
+    return radix_cursor_advance(cursor, 1);
 }
 
-void radix_tree_unmap_node(radix_tree_t *tree, radix_tree_node_t *parent, radix_tree_node_t *node)
+int radix_tree_cursor_prev(radix_tree_cursor_t *cursor)
 {
-    if (node->value != NULL)
-    {
-        if (tree->delete_leaf != NULL)
-        {
-            tree->delete_leaf(node->value);
-        }
-        node->value = NULL;
-    }
-    if (parent != NULL)
+    if (cursor->depth == 0)
     {
-        parent->table_items--;
+        return 0;
     }
+    return radix_cursor_retreat(cursor);
 }
 
-void radix_tree_remove(radix_tree_t *tree, const unsigned char *key, int key_len, void **value)
+/* calls visit for every key in [lo, hi) in order until it returns
+   nonzero; a NULL lo or hi leaves that end open. Returns the number of
+   keys visited */
+int radix_tree_range(radix_tree_t *tree,
+    const unsigned char *lo,
+    int lo_len,
+    const unsigned char *hi,
+    int hi_len,
+    radix_visit_fn visit,
+    void *ctx)
 {
-    radix_tree_node_t *parent = NULL;
-    radix_tree_node_t **p_node;
-    radix_tree_node_t *node;
-    int off = 0;
-    int a_off = 0;
-    int idx;
-    p_node = &tree->root;
-    node = tree->root;
-    parent = NULL;
-    while (off < key_len)
-    {
-        parent = node;
-
-        if (node->table == NULL)
-        {
-            break;
-        }
+    radix_tree_cursor_t cursor;
+    int found;
+    int cmp;
+    int len;
+    int n = 0;
 
-        idx = OFFSET_KEY(key, off) % tree->table_size;
-        for (p_node = &node->table[idx]; 
-            (*p_node) != NULL; 
-            (*p_node) = (*p_node)->next)
+    radix_tree_cursor_init(&cursor, tree);
+    found = lo != NULL ? radix_tree_cursor_seek(&cursor, lo, lo_len) : radix_tree_cursor_first(&cursor);
+    for (; found; found = radix_tree_cursor_next(&cursor))
+    {
+        if (hi != NULL)
         {
-            node = *p_node;
-            if (OFFSET_KEY(key, off) == node->key)
+            len = cursor.key_len < hi_len ? cursor.key_len : hi_len;
+            cmp = len > 0 ? memcmp(cursor.key, hi, len) : 0;
+            if (cmp > 0 || (cmp == 0 && cursor.key_len >= hi_len))
             {
                 break;
             }
         }
 
-        if (node == NULL)
+        n++;
+        if (visit(ctx, cursor.key, cursor.key_len, cursor.value))
         {
             break;
         }
+    }
+    radix_tree_cursor_release(&cursor);
+    return n;
+}
+
+/* pushes the path down to the node whose subtree holds every key that
+   starts with prefix, the prefix may end inside its label; returns 0 if
+   no key has that prefix */
+static int radix_cursor_descend(radix_tree_cursor_t *cursor, const unsigned char *prefix, int prefix_len)
+{
+    radix_tree_node_t *node;
+    radix_tree_node_t *child;
+    int off;
+    int a_off;
+
+    if (!radix_cursor_reset(cursor))
+    {
+        return 0;
+    }
 
-        a_off = 0;
-        while (off < key_len && a_off + node->keys_off < node->keys_len
-            && OFFSET_KEY(key, off) == OFFSET_KEY(node->keys, node->keys_off + a_off))
+    node = cursor->tree->root;
+    for (off = 0; off < prefix_len; off += a_off)
+    {
+        child = radix_tree_get_child_node(node, OFFSET_KEY(prefix, off));
+        if (child == NULL || !radix_cursor_push(cursor, child, OFFSET_KEY(prefix, off)))
         {
-            off++;
-            a_off++;
+            return 0;
         }
 
-        if (a_off + node->keys_off < node->keys_len)
+        a_off = radix_tree_match_label(cursor->tree, child, prefix, off, prefix_len);
+        if (a_off < child->keys_len)
         {
-            node = NULL;
-            break;
+            return off + a_off == prefix_len;
         }
+        node = child;
     }
-    
-    if (node != NULL)
+    return 1;
+}
+
+/* calls visit for the keys that start with prefix in order, skipping the
+   first offset of them and stopping after limit (none if limit <= 0) or
+   when visit returns nonzero. Returns the number of keys visited */
+int radix_tree_prefix_walk(radix_tree_t *tree,
+    const unsigned char *prefix,
+    int prefix_len,
+    int offset,
+    int limit,
+    radix_visit_fn visit,
+    void *ctx)
+{
+    radix_tree_cursor_t cursor;
+    int found;
+    int n = 0;
+
+    radix_tree_cursor_init(&cursor, tree);
+    found = radix_cursor_descend(&cursor, prefix, prefix_len);
+    if (found)
     {
-        *value = node->value;
-        node->value = NULL;
+        // the cursor stays inside the subtree of the prefix
+        cursor.floor = cursor.depth;
+        found = RADIX_CURSOR_TOP(&cursor)->value != NULL
+            ? radix_cursor_found(&cursor) : radix_cursor_advance(&cursor, 1);
+    }
 
-        if (node->table_items == 0)
+    for (; found && (limit <= 0 || n < limit); found = radix_tree_cursor_next(&cursor))
+    {
+        if (offset > 0)
         {
-            (*p_node) = node->next;
-            node->next = NULL;
-            free_radix_tree_node(tree, node);
-            parent->table_items--;
+            offset--;
+            continue;
         }
-        else
+
+        n++;
+        if (visit(ctx, cursor.key, cursor.key_len, cursor.value))
         {
-            radix_tree_unmap_node(tree, parent, node);
-            if (parent != NULL)
-            {
-                radix_tree_merge_node(parent);
-            }
+            break;
         }
     }
-    else
-    {
-        *value = NULL;
-    }
+    radix_tree_cursor_release(&cursor);
+    return n;
 }
 
-void radix_tree_erase(radix_tree_t *tree, const unsigned char *key, int key_len)
+void radix_tree_dump_node(radix_tree_t *tree,
+    radix_tree_node_t *node,
+    int level)
 {
-    void *value;
-    radix_tree_remove(tree, key, key_len, &value);
-    if (value != NULL && tree->delete_leaf)
+    radix_tree_node_t *child;
+    int i;
+    int key;
+    char *keys;
+
+    for (i = 0; i < level; i++) printf("\t");
+
+    keys = strndup(RADIX_NODE_KEYS(node), node->keys_len);
+    printf(" - %s => [%s]\n", keys, node->value ? (char *)node->value : "");
+    free(keys);
+
+    key = -1;
+    while ((child = radix_tree_next_child_node(node, &key)) != NULL)
     {
-        tree->delete_leaf(value);
+        radix_tree_dump_node(tree, child, level + 1);
     }
 }
 
-void radix_tree_clear(radix_tree_t *tree)
+void radix_tree_dump(radix_tree_t *tree)
 {
-    radix_tree_clear_children(tree, tree->root);
+    radix_tree_dump_node(tree, tree->root, 0);
 }
 
-void radix_tree_init(radix_tree_t *tree, 
-    int table_size, 
-    radix_copy_fn copy_leaf, 
-    radix_destruct_fn delete_leaf)
+static void radix_tree_stats_node(radix_tree_node_t *node, int depth, radix_tree_stats_t *stats)
 {
-    tree->copy_leaf = copy_leaf;
-    tree->delete_leaf = delete_leaf;
-    tree->table_size = table_size;
-    tree->root = new_radix_tree_node(0, NULL, 0, 0);
-}
+    radix_tree_node_t *child;
+    int items;
+    int key;
 
-radix_tree_t *radix_tree_create(int table_size, radix_copy_fn copy_leaf, radix_destruct_fn delete_leaf)
-{
-    radix_tree_t *tree;
-    tree = malloc(sizeof(radix_tree_t));
-    if (tree != NULL)
+    stats->nodes++;
+    stats->node_bytes += sizeof(radix_tree_node_t);
+    stats->depth[depth < RADIX_STATS_DEPTHS ? depth : RADIX_STATS_DEPTHS - 1]++;
+    if (depth > stats->max_depth)
     {
-        radix_tree_init(tree, table_size, copy_leaf, delete_leaf);
+        stats->max_depth = depth;
     }
-    return tree;
-}
-
-void radix_tree_destroy(radix_tree_t *tree)
-{
-    radix_tree_clear(tree);
-    if (tree->root)
+    if (node->value != NULL)
     {
-        free_radix_tree_node(tree, tree->root);
+        stats->values++;
+    }
+    if (node->keys_len > RADIX_INLINE_KEYS)
+    {
+        stats->label_bytes += node->keys_len;
     }
-    free(tree);
-}
-
-void radix_tree_dump_node(radix_tree_t *tree, 
-    radix_tree_node_t *node, 
-    int level)
-{
-    int i;
-    char *keys;
-
-    for (i = 0; i < level; i++) printf("\t");
-
-    keys = strndup(node->keys, node->keys_len);
-    printf(" - %s => [%s]\n", keys, node->value ? (char *)node->value : "");
-    free(keys);
 
     if (node->table != NULL)
     {
-        for (i = 0; i < tree->table_size; i++)
-        {
-            if (node->table[i] != NULL)
-            {
-                radix_tree_dump_node(tree, node->table[i], level + 1);
-            }
-        }
+        stats->tables[node->table->type]++;
+        stats->table_bytes += radix_table_bytes(node->table->type);
+        stats->slots += radix_table_capacity[node->table->type];
+    }
+    items = RADIX_NODE_ITEMS(node);
+    if (items == 0)
+    {
+        stats->leaves++;
+        return;
+    }
+
+    stats->inner++;
+    stats->children += items;
+    if (items > stats->max_children)
+    {
+        stats->max_children = items;
     }
 
-    node = node->next;
-    while (node != NULL)
+    key = -1;
+    while ((child = radix_tree_next_child_node(node, &key)) != NULL)
     {
-        radix_tree_dump_node(tree, node, level);
-        node = node->next;
+        radix_tree_stats_node(child, depth + 1, stats);
     }
 }
 
-void radix_tree_dump(radix_tree_t *tree)
+/* shape and memory of the tree as it is now, plus the operation counters
+   when they are kept; no writer may run meanwhile */
+void radix_tree_stats(radix_tree_t *tree, radix_tree_stats_t *stats)
 {
-    radix_tree_dump_node(tree, tree->root, 0);
+    memset(stats, 0, sizeof(*stats));
+    if (tree->root != NULL)
+    {
+        radix_tree_stats_node(tree->root, 0, stats);
+    }
+    stats->counters = tree->counters;
 }
@@ -1,44 +1,199 @@
 #ifndef RADIX_TREE_H
 #define RADIX_TREE_H
 
+#include "radix_arena.h"
+#include "radix_epoch.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif  /* __cplusplus */
 
+// child table layouts, picked by the number of children
+#define RADIX_TABLE_4       0
+#define RADIX_TABLE_16      1
+#define RADIX_TABLE_48      2
+#define RADIX_TABLE_256     3
+
+// edge labels up to this many bytes live inside the node
+#define RADIX_INLINE_KEYS   16
+
+// keys walked side by side by the batch lookups
+#define RADIX_BATCH_GROUP   16
+
+// every child table starts with this header, so a reader that loaded
+// node->table sees a layout and an item count that belong together
+typedef struct
+{
+    unsigned char type;
+    unsigned short items;
+} radix_table_t;
+
 typedef struct _radix_tree_node
 {
-    struct _radix_tree_node *next; //sibling
     unsigned char key;
-    unsigned char *keys;
-    int keys_off;
     int keys_len;
+    // write lock and change count for optimistic writers, otherwise the
+    // tree generation the node was made in, see radix_tree_snapshot
+    volatile long version;
     void *value;
     // children
-    int table_items;
-    struct _radix_tree_node **table;
+    radix_table_t *table;
+    union
+    {
+        unsigned char *ptr;
+        unsigned char buf[RADIX_INLINE_KEYS];
+    } keys;
 } radix_tree_node_t;
 
+#define RADIX_NODE_KEYS(node) \
+    ((node)->keys_len <= RADIX_INLINE_KEYS ? (node)->keys.buf : (node)->keys.ptr)
+#define RADIX_NODE_ITEMS(node) ((node)->table == NULL ? 0 : (node)->table->items)
+
 typedef void *(*radix_copy_fn)(void *);
 typedef void (*radix_destruct_fn)(void *);
+// return nonzero to stop the walk
+typedef int (*radix_visit_fn)(void *ctx, const unsigned char *key, int key_len, void *value);
+
+// only counted when built with RADIX_TREE_STATS; plain increments, so
+// they drift while lock-free readers run alongside each other
+typedef struct
+{
+    unsigned long long lookups;
+    unsigned long long inserts;
+    unsigned long long removes;
+    unsigned long long probes;          // node labels compared against a key
+    unsigned long long compare_bytes;   // label bytes those compares covered
+    unsigned long long splits;
+    unsigned long long merges;
+} radix_tree_counters_t;
 
 typedef struct
 {
     radix_tree_node_t *root;
-    int table_size;
+    int table_size; // unused, child tables are sized per node
     radix_copy_fn copy_leaf;
     radix_destruct_fn delete_leaf;
+    radix_arena_t *arena; // NULL when nodes come from malloc
+    radix_epoch_t *epoch; // set when lock-free readers may be walking the tree
+    struct _radix_log *log; // set to record every mutation, see radix_log.h
+    radix_tree_counters_t counters;
+    long generation;        // bumped by every snapshot
+    struct _radix_snapshot *snapshots;  // live ones, newest first
+    struct _radix_deferred *deferred;   // unlinked memory snapshots may still see, oldest first
+    struct _radix_deferred *deferred_tail;
+    int lazy_remove;        // see radix_tree_set_lazy_remove
+    struct _radix_tombstones *tombstones;   // keys radix_tree_compact has yet to tidy
 } radix_tree_t;
 
+// the tree as it was when the snapshot was taken; view takes every call
+// that only reads a tree and never changes while the tree goes on
+typedef struct _radix_snapshot
+{
+    radix_tree_t view;
+    radix_tree_t *tree;
+    long generation;
+    struct _radix_snapshot *prev;
+    struct _radix_snapshot *next;
+} radix_snapshot_t;
+
+// node depths up to this, deeper nodes are counted in the last bucket
+#define RADIX_STATS_DEPTHS  32
+
+typedef struct
+{
+    size_t nodes;
+    size_t inner;           // nodes with children, the rest are leaves
+    size_t leaves;
+    size_t values;
+    size_t tables[4];       // by RADIX_TABLE_* layout
+    size_t slots;           // child slots in all tables
+    size_t children;        // slots in use
+    int max_children;
+    size_t depth[RADIX_STATS_DEPTHS];   // nodes by distance from the root
+    int max_depth;
+    size_t node_bytes;
+    size_t table_bytes;
+    size_t label_bytes;     // labels too long to live inside the node
+    radix_tree_counters_t counters;
+} radix_tree_stats_t;
+
+typedef struct
+{
+    radix_tree_node_t *node;
+    int key;        // dispatch byte in the parent, -1 for the root
+    int key_len;    // length of the key up to the end of the node label
+} radix_cursor_frame_t;
+
+// walks the keys in byte order, key and value describe the current entry;
+// values are not passed through copy_leaf and the tree must not change
+// while a cursor is positioned
+typedef struct
+{
+    radix_tree_t *tree;
+    radix_cursor_frame_t *stack;
+    int depth;      // 0 once the cursor ran off either end
+    int floor;      // frames the cursor never moves above, 1 is the root
+    int stack_size;
+    unsigned char *key;
+    int key_len;
+    int key_size;
+    void *value;
+} radix_tree_cursor_t;
+
 radix_tree_t *radix_tree_create(int table_size, radix_copy_fn copy_leaf, radix_destruct_fn delete_leaf);
+radix_tree_t *radix_tree_create_arena(radix_copy_fn copy_leaf, radix_destruct_fn delete_leaf, int block_size);
 void radix_tree_init(radix_tree_t *tree, int table_size, radix_copy_fn copy_leaf, radix_destruct_fn delete_leaf);
 void radix_tree_insert(radix_tree_t *tree, const unsigned char *key, int key_len, void *value);
+void *radix_tree_replace(radix_tree_t *tree, const unsigned char *key, int key_len, void *value);
+void radix_tree_bulk_load(radix_tree_t *tree, const unsigned char **keys, const int *lens, void **values, int n);
+void radix_tree_parallel_load(radix_tree_t *tree, const unsigned char **keys, const int *lens, void **values, int n, int threads);
+void radix_tree_insert_batch(radix_tree_t *tree, const unsigned char **keys, const int *lens, void **values, int n);
+void radix_tree_erase_batch(radix_tree_t *tree, const unsigned char **keys, const int *lens, int n);
 void *radix_tree_exact_match(radix_tree_t *tree, const unsigned char *key, int key_len);
 int radix_tree_prefix_match(radix_tree_t *tree, const unsigned char *key, int key_len, void **value);
+const void *radix_tree_exact_match_borrow(radix_tree_t *tree, const unsigned char *key, int key_len);
+int radix_tree_prefix_match_borrow(radix_tree_t *tree, const unsigned char *key, int key_len, const void **value);
+void radix_tree_exact_match_batch(radix_tree_t *tree, const unsigned char **keys, const int *lens, int n, void **values);
+void radix_tree_prefix_match_batch(radix_tree_t *tree, const unsigned char **keys, const int *lens, int n, void **values, int *ncs);
+// remove and replace hand the old value back instead of deleting it; an
+// older snapshot can still return it, so the caller must not free it until
+// every such snapshot is released (erase and insert defer it themselves)
 void radix_tree_remove(radix_tree_t *tree, const unsigned char *key, int key_len, void **value);
 void radix_tree_erase(radix_tree_t *tree, const unsigned char *key, int key_len);
+// with lazy set, remove and erase only drop the value and queue the key;
+// radix_tree_compact later frees the nodes left empty and merges chains,
+// at most budget keys per call (all with 0), and returns how many are left
+void radix_tree_set_lazy_remove(radix_tree_t *tree, int lazy);
+int radix_tree_compact(radix_tree_t *tree, int budget);
+// writers that may run in parallel, the tree needs an epoch and every call
+// has to be made from inside it
+void radix_tree_insert_olc(radix_tree_t *tree, const unsigned char *key, int key_len, void *value);
+void radix_tree_remove_olc(radix_tree_t *tree, const unsigned char *key, int key_len, void **value);
+void radix_tree_erase_olc(radix_tree_t *tree, const unsigned char *key, int key_len);
+void radix_tree_clear_olc(radix_tree_t *tree);
 void radix_tree_clear(radix_tree_t *tree);
+int radix_tree_save(radix_tree_t *tree, int fd);
+// O(1); the writers copy the nodes they change from then on instead of
+// changing them in place. Both calls count as writes, and the _olc
+// writers must not be used on a tree with snapshots. See radix_tree_remove
+// for the values remove and replace return while one is live
+radix_snapshot_t *radix_tree_snapshot(radix_tree_t *tree);
+void radix_tree_snapshot_release(radix_snapshot_t *snapshot);
+void radix_tree_release(radix_tree_t *tree);
 void radix_tree_destroy(radix_tree_t *tree);
 void radix_tree_dump(radix_tree_t *tree);
+void radix_tree_stats(radix_tree_t *tree, radix_tree_stats_t *stats);
+
+void radix_tree_cursor_init(radix_tree_cursor_t *cursor, radix_tree_t *tree);
+void radix_tree_cursor_release(radix_tree_cursor_t *cursor);
+int radix_tree_cursor_first(radix_tree_cursor_t *cursor);
+int radix_tree_cursor_last(radix_tree_cursor_t *cursor);
+int radix_tree_cursor_seek(radix_tree_cursor_t *cursor, const unsigned char *key, int key_len);
+int radix_tree_cursor_next(radix_tree_cursor_t *cursor);
+int radix_tree_cursor_prev(radix_tree_cursor_t *cursor);
+int radix_tree_range(radix_tree_t *tree, const unsigned char *lo, int lo_len, const unsigned char *hi, int hi_len, radix_visit_fn visit, void *ctx);
+int radix_tree_prefix_walk(radix_tree_t *tree, const unsigned char *prefix, int prefix_len, int offset, int limit, radix_visit_fn visit, void *ctx);
+int radix_tree_erase_prefix(radix_tree_t *tree, const unsigned char *prefix, int prefix_len);
 
 #ifdef __cplusplus
 }
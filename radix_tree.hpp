@@ -0,0 +1,449 @@
+#ifndef RADIX_TREE_HPP
+#define RADIX_TREE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+#include "radix_tree.h"
+#include "bit_radix_tree.h"
+
+// A typed front end over the C trees. The C trees get no copy_leaf or
+// delete_leaf; every value is constructed, moved and destroyed by code
+// picked at compile time from Value and Traits.
+//
+// Traits decide the key granularity and the node policy:
+//   tree_type, create(block_size), destroy, replace, exact_match,
+//   prefix_match, remove and clear over that tree;
+//   data(key) and length(key), the length in bytes or bits;
+//   block_size, 0 to malloc every node or the arena block size.
+
+// byte keys from anything with data() and size(), e.g. std::string
+template <class Key>
+struct radix_byte_traits
+{
+    typedef radix_tree_t tree_type;
+    static const int block_size = 0;
+
+    static const unsigned char *data(const Key &key)
+    {
+        return (const unsigned char *)key.data();
+    }
+    static int length(const Key &key)
+    {
+        return (int)key.size();
+    }
+
+    static tree_type *create(int block_size)
+    {
+        return block_size > 0 ? radix_tree_create_arena(NULL, NULL, block_size) : radix_tree_create(0, NULL, NULL);
+    }
+    static void destroy(tree_type *tree)
+    {
+        radix_tree_destroy(tree);
+    }
+    static void *replace(tree_type *tree, const unsigned char *key, int key_len, void *value)
+    {
+        return radix_tree_replace(tree, key, key_len, value);
+    }
+    static void *exact_match(tree_type *tree, const unsigned char *key, int key_len)
+    {
+        return radix_tree_exact_match(tree, key, key_len);
+    }
+    static int prefix_match(tree_type *tree, const unsigned char *key, int key_len, void **value)
+    {
+        return radix_tree_prefix_match(tree, key, key_len, value);
+    }
+    static void remove(tree_type *tree, const unsigned char *key, int key_len, void **value)
+    {
+        radix_tree_remove(tree, key, key_len, value);
+    }
+    static void clear(tree_type *tree)
+    {
+        radix_tree_clear(tree);
+    }
+};
+
+// bit keys branching on Stride bits per level; every byte of the key
+// counts unless length is overridden, e.g. for address prefixes
+template <class Key, int Stride = 1>
+struct radix_bit_traits
+{
+    typedef bit_radix_tree_t tree_type;
+    static const int block_size = 0;
+
+    static const unsigned char *data(const Key &key)
+    {
+        return (const unsigned char *)key.data();
+    }
+    static int length(const Key &key)
+    {
+        return (int)key.size() * 8;
+    }
+
+    static tree_type *create(int block_size)
+    {
+        tree_type *tree;
+        tree = block_size > 0 ? bit_radix_tree_create_arena(2, NULL, NULL, block_size) : bit_radix_tree_create(2, NULL, NULL);
+        if (tree != NULL)
+        {
+            bit_radix_tree_set_stride(tree, Stride);
+        }
+        return tree;
+    }
+    static void destroy(tree_type *tree)
+    {
+        bit_radix_tree_destroy(tree);
+    }
+    static void *replace(tree_type *tree, const unsigned char *key, int key_len, void *value)
+    {
+        return bit_radix_tree_replace(tree, key, key_len, value);
+    }
+    static void *exact_match(tree_type *tree, const unsigned char *key, int key_len)
+    {
+        return bit_radix_tree_exact_match(tree, key, key_len);
+    }
+    static int prefix_match(tree_type *tree, const unsigned char *key, int key_len, void **value)
+    {
+        return bit_radix_tree_prefix_match(tree, key, key_len, value);
+    }
+    static void remove(tree_type *tree, const unsigned char *key, int key_len, void **value)
+    {
+        bit_radix_tree_remove(tree, key, key_len, value);
+    }
+    static void clear(tree_type *tree)
+    {
+        bit_radix_tree_clear(tree);
+    }
+};
+
+// small trivially copyable values live in the tree word itself, above a
+// tag byte that keeps the word from ever being NULL
+template <class Value>
+class radix_inline_values
+{
+public:
+    template <class V>
+    void *make(V &&value)
+    {
+        unsigned char bytes[sizeof(Value)];
+        uintptr_t word = 0;
+        size_t i;
+        Value v(std::forward<V>(value));
+
+        memcpy(bytes, &v, sizeof(Value));
+        for (i = 0; i < sizeof(Value); i++)
+        {
+            word |= (uintptr_t)bytes[i] << (8 * i + 8);
+        }
+        return (void *)(word | 1);
+    }
+
+    void load(void *word, Value &out) const
+    {
+        unsigned char bytes[sizeof(Value)];
+        size_t i;
+
+        for (i = 0; i < sizeof(Value); i++)
+        {
+            bytes[i] = (unsigned char)((uintptr_t)word >> (8 * i + 8));
+        }
+        memcpy(&out, bytes, sizeof(Value));
+    }
+
+    void take(void *word, Value &out)
+    {
+        load(word, out);
+    }
+
+    void release(void *word)
+    {
+        (void)word;
+    }
+
+    void reset()
+    {
+    }
+
+    void swap(radix_inline_values &other)
+    {
+        (void)other;
+    }
+};
+
+// every other value is constructed in place in chunks of slots the tree
+// owns, the tree word is the slot number + 1
+template <class Value>
+class radix_pooled_values
+{
+public:
+    enum { chunk = 256 };
+
+    radix_pooled_values() : used(0), free_slot(0)
+    {
+    }
+
+    ~radix_pooled_values()
+    {
+        reset();
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            ::operator delete(chunks[i]);
+        }
+    }
+
+    template <class V>
+    void *make(V &&value)
+    {
+        slot_t *s;
+        size_t n;
+
+        if (free_slot != 0)
+        {
+            n = free_slot - 1;
+            free_slot = at(n)->next;
+        }
+        else
+        {
+            if (used == chunks.size() * chunk)
+            {
+                chunks.push_back((slot_t *)::operator new(chunk * sizeof(slot_t)));
+            }
+            n = used++;
+        }
+        s = at(n);
+        new (&s->storage) Value(std::forward<V>(value));
+        s->live = true;
+        return (void *)(n + 1);
+    }
+
+    void load(void *word, Value &out)
+    {
+        out = get(word);
+    }
+
+    void take(void *word, Value &out)
+    {
+        out = std::move(get(word));
+        release(word);
+    }
+
+    void release(void *word)
+    {
+        slot_t *s;
+
+        s = at((size_t)word - 1);
+        get(word).~Value();
+        s->live = false;
+        s->next = free_slot;
+        free_slot = (size_t)word;
+    }
+
+    void reset()
+    {
+        for (size_t n = 0; n < used; n++)
+        {
+            if (at(n)->live)
+            {
+                ((Value *)&at(n)->storage)->~Value();
+            }
+        }
+        used = 0;
+        free_slot = 0;
+    }
+
+    void swap(radix_pooled_values &other)
+    {
+        chunks.swap(other.chunks);
+        std::swap(used, other.used);
+        std::swap(free_slot, other.free_slot);
+    }
+
+    Value &get(void *word)
+    {
+        return *(Value *)&at((size_t)word - 1)->storage;
+    }
+
+private:
+    struct slot_t
+    {
+        typename std::aligned_storage<sizeof(Value), std::alignment_of<Value>::value>::type storage;
+        size_t next;    // free slot number + 1 while not live
+        bool live;
+    };
+
+    slot_t *at(size_t n)
+    {
+        return &chunks[n / chunk][n % chunk];
+    }
+
+    std::vector<slot_t *> chunks;
+    size_t used;
+    size_t free_slot;
+
+    radix_pooled_values(const radix_pooled_values &);
+    radix_pooled_values &operator=(const radix_pooled_values &);
+};
+
+template <class Key, class Value, class Traits = radix_byte_traits<Key> >
+class radix_tree
+{
+public:
+    typedef typename Traits::tree_type tree_type;
+    typedef typename std::conditional<sizeof(Value) < sizeof(void *) && std::is_trivially_copyable<Value>::value,
+        radix_inline_values<Value>, radix_pooled_values<Value> >::type values_type;
+
+    radix_tree() : tree(Traits::create(Traits::block_size)), items(0)
+    {
+        if (tree == NULL)
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    radix_tree(radix_tree &&other) : tree(NULL), items(0)
+    {
+        swap(other);
+    }
+
+    radix_tree &operator=(radix_tree &&other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~radix_tree()
+    {
+        if (tree != NULL)
+        {
+            values.reset();
+            Traits::destroy(tree);
+        }
+    }
+
+    // returns true when the key was new, otherwise the value is replaced
+    template <class V>
+    bool insert(const Key &key, V &&value)
+    {
+        void *word;
+        void *old;
+
+        word = values.make(std::forward<V>(value));
+        old = Traits::replace(tree, Traits::data(key), Traits::length(key), word);
+        if (old != NULL)
+        {
+            values.release(old);
+            return false;
+        }
+        items++;
+        return true;
+    }
+
+    template <class... Args>
+    bool emplace(const Key &key, Args &&... args)
+    {
+        return insert(key, Value(std::forward<Args>(args)...));
+    }
+
+    bool find(const Key &key, Value &out)
+    {
+        void *word;
+
+        word = Traits::exact_match(tree, Traits::data(key), Traits::length(key));
+        if (word == NULL)
+        {
+            return false;
+        }
+        values.load(word, out);
+        return true;
+    }
+
+    bool contains(const Key &key)
+    {
+        return Traits::exact_match(tree, Traits::data(key), Traits::length(key)) != NULL;
+    }
+
+    // value of the longest key that is a prefix of key; returns how many
+    // keys are, out is only written when that is not 0
+    int longest_prefix(const Key &key, Value &out)
+    {
+        void *word;
+        int nc;
+
+        nc = Traits::prefix_match(tree, Traits::data(key), Traits::length(key), &word);
+        if (nc > 0)
+        {
+            values.load(word, out);
+        }
+        return nc;
+    }
+
+    // moves the value out into *out when given; false when there was none
+    bool remove(const Key &key, Value *out = NULL)
+    {
+        void *word;
+
+        Traits::remove(tree, Traits::data(key), Traits::length(key), &word);
+        if (word == NULL)
+        {
+            return false;
+        }
+        if (out != NULL)
+        {
+            values.take(word, *out);
+        }
+        else
+        {
+            values.release(word);
+        }
+        items--;
+        return true;
+    }
+
+    void clear()
+    {
+        void *word;
+
+        // the C trees keep the empty key across a clear
+        Traits::remove(tree, (const unsigned char *)"", 0, &word);
+        Traits::clear(tree);
+        values.reset();
+        items = 0;
+    }
+
+    size_t size() const
+    {
+        return items;
+    }
+
+    bool empty() const
+    {
+        return items == 0;
+    }
+
+    void swap(radix_tree &other)
+    {
+        std::swap(tree, other.tree);
+        std::swap(items, other.items);
+        values.swap(other.values);
+    }
+
+    // the C tree, whose values are the words described above
+    tree_type *native()
+    {
+        return tree;
+    }
+
+private:
+    tree_type *tree;
+    size_t items;
+    values_type values;
+
+    radix_tree(const radix_tree &);
+    radix_tree &operator=(const radix_tree &);
+};
+
+#endif
@@ -21,10 +21,16 @@ static __inline void string_map_init(string_map_t *map,
     radix_destruct_fn destruct_func)
 {
     radix_tree_init(map, 
+        0, 
         copy_func, 
         destruct_func);
 }
 
+static __inline void string_map_release(string_map_t *map)
+{
+    radix_tree_release(map);
+}
+
 static __inline  void string_map_insert(string_map_t *map, 
     const unsigned char *key, 
     int key_len, 
@@ -44,7 +50,15 @@ static __inline STRING_MAP_BOOL string_map_exists(string_map_t *map,
     const unsigned char *key, 
     int key_len)
 {
-    return NULL == radix_tree_exact_match(map, key, key_len);
+    return NULL != radix_tree_exact_match_borrow(map, key, key_len) ? STRING_MAP_TRUE : STRING_MAP_FALSE;
+}
+
+// the stored value, valid until the key is replaced or erased
+static __inline const void *string_map_find(string_map_t *map, 
+    const unsigned char *key, 
+    int key_len)
+{
+    return radix_tree_exact_match_borrow(map, key, key_len);
 }
 
 static __inline void string_map_clear(string_map_t *map)
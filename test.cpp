@@ -1,8 +1,37 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include "radix_tree.h"
 #include "bit_radix_tree.h"
+#include "radix_key.h"
+#include "concurrent_radix_tree.h"
+#include "radix_atomic.h"
+#include "radix_image.h"
+#include "radix_log.h"
+#include "radix_frozen.h"
+#include "radix_lpm.h"
+#include "radix_tree.hpp"
+#include "string_map.h"
+#include <string>
+
+void assert_radix_key()
+{
+    const unsigned char *a = (const unsigned char *)"http://example.com/path/to/resource?id=1";
+    const unsigned char *b = (const unsigned char *)"http://example.com/path/to/resource?id=2";
+    int len = (int)strlen((const char *)a);
+
+    assert(len - 1 == radix_key_mismatch(a, b, len));
+    assert(len - 1 == radix_key_mismatch(a, b, len - 1));
+    assert(0 == radix_key_mismatch(a, b + 1, len - 1));
+    assert(0 == radix_key_mismatch(a, b, 0));
+
+    // '1' = 0x31 and '2' = 0x32 first differ in bit 0 of the last byte
+    assert(8 * (len - 1) == radix_key_mismatch_bits(a, 0, b, 0, 8 * len));
+    assert(8 * (len - 1) - 3 == radix_key_mismatch_bits(a, 3, b, 3, 8 * len - 3));
+    assert(5 == radix_key_mismatch_bits(a, 3, b, 3, 5));
+    assert(8 * len - 9 == radix_key_mismatch_bits(a, 9, a, 9, 8 * len - 9));
+}
 
 void assert_radix_tree_remove()
 {
@@ -79,6 +108,1205 @@ void assert_radix_tree()
     radix_tree_destroy(t);
 }
 
+void assert_radix_tree_fanout()
+{
+    unsigned char key[2];
+    char *values[256];
+    void *leaf;
+    int i;
+    radix_tree_t *t = radix_tree_create(0, NULL, NULL);
+
+    for (i = 0; i < 256; i++)
+    {
+        values[i] = (char *)malloc(4);
+        sprintf(values[i], "%d", i);
+        key[0] = 'k';
+        key[1] = (unsigned char)(i * 7);
+        radix_tree_insert(t, key, 2, values[i]);
+        leaf = radix_tree_exact_match(t, key, 2);
+        assert(leaf == values[i]);
+    }
+
+    for (i = 0; i < 256; i++)
+    {
+        key[1] = (unsigned char)(i * 7);
+        leaf = radix_tree_exact_match(t, key, 2);
+        assert(leaf == values[i]);
+    }
+
+    for (i = 0; i < 255; i++)
+    {
+        key[1] = (unsigned char)(i * 7);
+        radix_tree_remove(t, key, 2, &leaf);
+        assert(leaf == values[i]);
+        leaf = radix_tree_exact_match(t, key, 2);
+        assert(NULL == leaf);
+        key[1] = (unsigned char)(255 * 7);
+        leaf = radix_tree_exact_match(t, key, 2);
+        assert(leaf == values[255]);
+    }
+
+    assert(1 == radix_tree_prefix_match(t, key, 2, &leaf));
+    assert(leaf == values[255]);
+    assert(1 == RADIX_NODE_ITEMS(t->root));
+
+    radix_tree_destroy(t);
+    for (i = 0; i < 256; i++)
+    {
+        free(values[i]);
+    }
+}
+
+void assert_radix_tree_labels()
+{
+    const char *url = "https://example.com/a/very/long/path/index.html";
+    void *leaf;
+    radix_tree_t *t = radix_tree_create(0, NULL, NULL);
+
+    radix_tree_insert(t, (unsigned char *)url, strlen(url), (void *)"long");
+    radix_tree_insert(t, (unsigned char *)url, 8, (void *)"scheme");
+    radix_tree_insert(t, (unsigned char *)url, 30, (void *)"dir");
+    leaf = radix_tree_exact_match(t, (unsigned char *)url, strlen(url));
+    assert(0 == strcmp((char *)leaf, "long"));
+    leaf = radix_tree_exact_match(t, (unsigned char *)url, 30);
+    assert(0 == strcmp((char *)leaf, "dir"));
+
+    radix_tree_remove(t, (unsigned char *)url, 8, &leaf);
+    assert(0 == strcmp((char *)leaf, "scheme"));
+    radix_tree_remove(t, (unsigned char *)url, 30, &leaf);
+    assert(0 == strcmp((char *)leaf, "dir"));
+    assert(1 == RADIX_NODE_ITEMS(t->root));
+    leaf = radix_tree_exact_match(t, (unsigned char *)url, strlen(url));
+    assert(0 == strcmp((char *)leaf, "long"));
+    assert(NULL == radix_tree_exact_match(t, (unsigned char *)url, 8));
+
+    radix_tree_destroy(t);
+}
+
+void assert_radix_tree_batch()
+{
+    char buf[100][32];
+    const unsigned char *keys[100];
+    int lens[100];
+    void *values[100];
+    int ncs[100];
+    void *leaf;
+    int nc;
+    int i;
+    radix_tree_t *t = radix_tree_create(0, NULL, NULL);
+
+    for (i = 0; i < 100; i++)
+    {
+        // every third key is stored, the rest are misses or longer keys
+        sprintf(buf[i], "/batch/%d/%s", i / 3, i % 3 == 0 ? "" : "x");
+        keys[i] = (const unsigned char *)buf[i];
+        lens[i] = strlen(buf[i]);
+        if (i % 3 == 0)
+        {
+            radix_tree_insert(t, keys[i], lens[i], buf[i]);
+        }
+    }
+    lens[99] = 0;
+    radix_tree_insert(t, keys[0], 7, (void *)"/batch/");
+
+    radix_tree_exact_match_batch(t, keys, lens, 100, values);
+    for (i = 0; i < 100; i++)
+    {
+        assert(values[i] == radix_tree_exact_match(t, keys[i], lens[i]));
+    }
+
+    radix_tree_prefix_match_batch(t, keys, lens, 100, values, ncs);
+    for (i = 0; i < 100; i++)
+    {
+        nc = radix_tree_prefix_match(t, keys[i], lens[i], &leaf);
+        assert(nc == ncs[i]);
+        assert(leaf == values[i]);
+    }
+    assert(2 == ncs[4] && values[4] == buf[3]);
+    assert(0 == ncs[99] && NULL == values[99]);
+
+    radix_tree_destroy(t);
+}
+
+static int collect_keys(void *ctx, const unsigned char *key, int key_len, void *value)
+{
+    char *out = (char *)ctx;
+    strncat(out, (const char *)key, key_len);
+    strcat(out, ",");
+    return strlen(out) > 10;
+}
+
+void assert_radix_tree_cursor()
+{
+    const char *words[] = { "b", "abc", "ab", "abd", "", "ba", "c" };
+    char out[64];
+    radix_tree_cursor_t c;
+    radix_tree_t *t = radix_tree_create(0, NULL, NULL);
+    int i;
+
+    for (i = 0; i < 7; i++)
+    {
+        radix_tree_insert(t, (unsigned char *)words[i], strlen(words[i]), (void *)words[i]);
+    }
+
+    radix_tree_cursor_init(&c, t);
+    out[0] = 0;
+    for (i = radix_tree_cursor_first(&c); i; i = radix_tree_cursor_next(&c))
+    {
+        strcat(out, (char *)c.value);
+        strcat(out, ",");
+    }
+    assert(0 == strcmp(out, ",ab,abc,abd,b,ba,c,"));
+
+    out[0] = 0;
+    for (i = radix_tree_cursor_last(&c); i; i = radix_tree_cursor_prev(&c))
+    {
+        strcat(out, (char *)c.value);
+        strcat(out, ",");
+    }
+    assert(0 == strcmp(out, "c,ba,b,abd,abc,ab,,"));
+
+    assert(radix_tree_cursor_seek(&c, (unsigned char *)"abca", 4));
+    assert(0 == strcmp((char *)c.value, "abd"));
+    assert(radix_tree_cursor_prev(&c));
+    assert(0 == strcmp((char *)c.value, "abc"));
+    assert(radix_tree_cursor_seek(&c, (unsigned char *)"a", 1));
+    assert(2 == c.key_len && 0 == memcmp(c.key, "ab", 2));
+    assert(!radix_tree_cursor_seek(&c, (unsigned char *)"ca", 2));
+    radix_tree_cursor_release(&c);
+
+    out[0] = 0;
+    assert(3 == radix_tree_range(t, (unsigned char *)"abc", 3, (unsigned char *)"ba", 2, collect_keys, out));
+    assert(0 == strcmp(out, "abc,abd,b,"));
+    out[0] = 0;
+    assert(4 == radix_tree_range(t, NULL, 0, NULL, 0, collect_keys, out));
+    assert(0 == strcmp(out, ",ab,abc,abd,"));
+
+    radix_tree_destroy(t);
+}
+
+static void *copy_string(void *s)
+{
+    size_t len = strlen((char *)s) + 1;
+    return memcpy(malloc(len), s, len);
+}
+
+static int count_keys(void *ctx, const unsigned char *key, int key_len, void *value)
+{
+    (*(int *)ctx)++;
+    return 0;
+}
+
+void assert_radix_tree_borrow()
+{
+    radix_tree_t *t = radix_tree_create(0, copy_string, free);
+    const void *value;
+    void *leaf;
+
+    radix_tree_insert(t, (unsigned char *)"ab", 2, (void *)"12");
+    radix_tree_insert(t, (unsigned char *)"abcd", 4, (void *)"1234");
+    value = radix_tree_exact_match_borrow(t, (unsigned char *)"ab", 2);
+    assert(0 == strcmp((const char *)value, "12"));
+    assert(value == radix_tree_exact_match_borrow(t, (unsigned char *)"ab", 2));
+    assert(NULL == radix_tree_exact_match_borrow(t, (unsigned char *)"abc", 3));
+    assert(1 == radix_tree_prefix_match_borrow(t, (unsigned char *)"abc", 3, &value));
+    assert(value == radix_tree_exact_match_borrow(t, (unsigned char *)"ab", 2));
+    assert(0 == radix_tree_prefix_match_borrow(t, (unsigned char *)"x", 1, &value));
+    assert(NULL == value);
+
+    // the copying lookups still hand out copies
+    leaf = radix_tree_exact_match(t, (unsigned char *)"abcd", 4);
+    assert(leaf != radix_tree_exact_match_borrow(t, (unsigned char *)"abcd", 4));
+    assert(0 == strcmp((char *)leaf, "1234"));
+    free(leaf);
+    radix_tree_destroy(t);
+}
+
+static void assert_snapshot_keys(radix_snapshot_t *snapshot, int from, int to, int step, int count)
+{
+    char key[32];
+    const void *value;
+    int n = 0;
+    int i;
+
+    for (i = from; i < to; i += step)
+    {
+        sprintf(key, "/snapshot/key/%d", i);
+        value = radix_tree_exact_match_borrow(&snapshot->view, (unsigned char *)key, strlen(key));
+        assert(value != NULL && 0 == strcmp((const char *)value, key));
+    }
+    radix_tree_prefix_walk(&snapshot->view, NULL, 0, 0, -1, count_keys, &n);
+    assert(count == n);
+}
+
+static void assert_radix_tree_snapshot_on(radix_tree_t *t)
+{
+    radix_snapshot_t *first;
+    radix_snapshot_t *second;
+    radix_snapshot_t *empty;
+    char key[32];
+    void *value;
+    void *old;
+    int n = 0;
+    int i;
+
+    empty = radix_tree_snapshot(t);
+    for (i = 0; i < 300; i += 2)
+    {
+        sprintf(key, "/snapshot/key/%d", i);
+        radix_tree_insert(t, (unsigned char *)key, strlen(key), key);
+    }
+    first = radix_tree_snapshot(t);
+
+    // new keys split the shared nodes, replaced and removed ones drop
+    // values the snapshot still hands out
+    for (i = 1; i < 300; i += 2)
+    {
+        sprintf(key, "/snapshot/key/%d", i);
+        radix_tree_insert(t, (unsigned char *)key, strlen(key), key);
+    }
+    for (i = 0; i < 300; i += 4)
+    {
+        sprintf(key, "/snapshot/key/%d", i);
+        radix_tree_insert(t, (unsigned char *)key, strlen(key), (void *)"replaced");
+    }
+    second = radix_tree_snapshot(t);
+    for (i = 0; i < 300; i += 3)
+    {
+        sprintf(key, "/snapshot/key/%d", i);
+        radix_tree_erase(t, (unsigned char *)key, strlen(key));
+    }
+    assert(75 == radix_tree_erase_prefix(t, (unsigned char *)"/snapshot/key/2", 15));
+
+    assert_snapshot_keys(first, 0, 300, 2, 150);
+    value = radix_tree_exact_match(&second->view, (unsigned char *)"/snapshot/key/12", 16);
+    assert(0 == strcmp((char *)value, "replaced"));
+    free(value);
+    assert(NULL == radix_tree_exact_match_borrow(t, (unsigned char *)"/snapshot/key/12", 16));
+    radix_tree_prefix_walk(&second->view, NULL, 0, 0, -1, count_keys, &n);
+    assert(300 == n);
+    n = 0;
+    radix_tree_prefix_walk(&empty->view, NULL, 0, 0, -1, count_keys, &n);
+    assert(0 == n);
+
+    radix_tree_snapshot_release(second);
+    radix_tree_clear(t);
+    assert(NULL == radix_tree_exact_match_borrow(t, (unsigned char *)"/snapshot/key/1", 15));
+    assert_snapshot_keys(first, 0, 300, 2, 150);
+    radix_tree_snapshot_release(first);
+    radix_tree_snapshot_release(empty);
+
+    // remove and replace give back values the snapshot still reads, which
+    // only go once it is released
+    radix_tree_insert(t, (unsigned char *)"/snapshot/a", 11, (void *)"a");
+    radix_tree_insert(t, (unsigned char *)"/snapshot/b", 11, (void *)"b");
+    first = radix_tree_snapshot(t);
+    radix_tree_remove(t, (unsigned char *)"/snapshot/a", 11, &value);
+    old = radix_tree_replace(t, (unsigned char *)"/snapshot/b", 11, (void *)"c");
+    assert(value == radix_tree_exact_match_borrow(&first->view, (unsigned char *)"/snapshot/a", 11));
+    assert(old == radix_tree_exact_match_borrow(&first->view, (unsigned char *)"/snapshot/b", 11));
+    assert(0 == strcmp((char *)value, "a") && 0 == strcmp((char *)old, "b"));
+    radix_tree_snapshot_release(first);
+    free(value);
+    free(old);
+    radix_tree_clear(t);
+
+    // without snapshots the tree changes in place again
+    sprintf(key, "/snapshot/key/%d", 7);
+    radix_tree_insert(t, (unsigned char *)key, strlen(key), key);
+    value = radix_tree_exact_match(t, (unsigned char *)key, strlen(key));
+    assert(0 == strcmp((char *)value, key));
+    free(value);
+    radix_tree_destroy(t);
+}
+
+void assert_radix_tree_snapshot()
+{
+    assert_radix_tree_snapshot_on(radix_tree_create(0, copy_string, free));
+    assert_radix_tree_snapshot_on(radix_tree_create_arena(copy_string, free, 4096));
+}
+
+void assert_radix_tree_stats()
+{
+    radix_tree_t *t = radix_tree_create(0, NULL, NULL);
+    const char *keys[] = { "a", "ab", "abc", "b", "cxxxxxxxxxxxxxxxxxxx" };
+    radix_tree_stats_t stats;
+    void *value;
+    int i;
+
+    for (i = 0; i < 5; i++)
+    {
+        radix_tree_insert(t, (unsigned char *)keys[i], strlen(keys[i]), (void *)(size_t)(i + 1));
+    }
+    radix_tree_stats(t, &stats);
+    assert(6 == stats.nodes && 3 == stats.inner && 3 == stats.leaves && 5 == stats.values);
+    assert(3 == stats.tables[RADIX_TABLE_4] && 0 == stats.tables[RADIX_TABLE_256]);
+    assert(12 == stats.slots && 5 == stats.children && 3 == stats.max_children);
+    assert(1 == stats.depth[0] && 3 == stats.depth[1] && 1 == stats.depth[2] && 1 == stats.depth[3] && 3 == stats.max_depth);
+    assert(20 == stats.label_bytes && 6 * sizeof(radix_tree_node_t) == stats.node_bytes);
+
+    radix_tree_remove(t, (unsigned char *)"ab", 2, &value);
+    radix_tree_insert(t, (unsigned char *)"cx", 2, (void *)6);
+    assert(NULL != radix_tree_exact_match(t, (unsigned char *)"abc", 3));
+    radix_tree_stats(t, &stats);
+    assert(6 == stats.nodes && 5 == stats.values && 18 == stats.label_bytes);
+#ifdef RADIX_TREE_STATS
+    assert(6 == stats.counters.inserts && 1 == stats.counters.removes && 1 == stats.counters.lookups);
+    assert(1 == stats.counters.splits && 1 == stats.counters.merges);
+    assert(stats.counters.probes >= 3 && stats.counters.compare_bytes >= 3);
+#endif
+    radix_tree_destroy(t);
+}
+
+void assert_string_map()
+{
+    string_map_t map;
+
+    string_map_init(&map, copy_string, free);
+    string_map_insert(&map, (unsigned char *)"user", 4, (void *)"alice");
+    string_map_insert(&map, (unsigned char *)"users", 5, (void *)"bob");
+    assert(string_map_exists(&map, (unsigned char *)"user", 4));
+    assert(string_map_exists(&map, (unsigned char *)"users", 5));
+    assert(!string_map_exists(&map, (unsigned char *)"use", 3));
+    assert(0 == strcmp((const char *)string_map_find(&map, (unsigned char *)"users", 5), "bob"));
+    string_map_erase(&map, (unsigned char *)"user", 4);
+    assert(!string_map_exists(&map, (unsigned char *)"user", 4));
+    assert(string_map_exists(&map, (unsigned char *)"users", 5));
+    string_map_clear(&map);
+    assert(!string_map_exists(&map, (unsigned char *)"users", 5));
+    string_map_release(&map);
+}
+
+void assert_radix_tree_prefix_walk()
+{
+    const char *paths[] = { "/tenant/a/1", "/tenant/a/2", "/tenant/a/3", "/tenant/ab", "/tenant/b/1", "/other" };
+    char out[64];
+    radix_tree_t *t = radix_tree_create(0, copy_string, free);
+    void *leaf;
+    int n;
+    int i;
+
+    for (i = 0; i < 6; i++)
+    {
+        radix_tree_insert(t, (unsigned char *)paths[i], strlen(paths[i]), (void *)paths[i]);
+    }
+
+    // the prefix ends inside the label of "/tenant/"
+    n = 0;
+    assert(3 == radix_tree_prefix_walk(t, (unsigned char *)"/ten", 4, 2, 3, count_keys, &n));
+    assert(3 == n);
+    n = 0;
+    assert(5 == radix_tree_prefix_walk(t, (unsigned char *)"", 0, 1, 0, count_keys, &n));
+    out[0] = 0;
+    assert(1 == radix_tree_prefix_walk(t, (unsigned char *)"/tenant/a/", 10, 1, 0, collect_keys, out));
+    assert(0 == strcmp(out, "/tenant/a/2,"));
+    assert(0 == radix_tree_prefix_walk(t, (unsigned char *)"/tenant/c", 9, 0, 0, count_keys, &n));
+
+    assert(3 == radix_tree_erase_prefix(t, (unsigned char *)"/tenant/a/", 10));
+    assert(NULL == radix_tree_exact_match(t, (unsigned char *)paths[0], strlen(paths[0])));
+    leaf = radix_tree_exact_match(t, (unsigned char *)"/tenant/ab", 10);
+    assert(0 == strcmp((char *)leaf, "/tenant/ab"));
+    free(leaf);
+    assert(0 == radix_tree_erase_prefix(t, (unsigned char *)"/tenant/a/", 10));
+    assert(2 == radix_tree_erase_prefix(t, (unsigned char *)"/t", 2));
+    assert(1 == RADIX_NODE_ITEMS(t->root));
+
+    radix_tree_destroy(t);
+}
+
+void assert_radix_tree_bulk_load()
+{
+    const char *sorted[] = { "", "ab", "abc", "abc", "abd", "b", "ba", "bcd" };
+    const char *unsorted[] = { "b", "a" };
+    const unsigned char *keys[8];
+    int lens[8];
+    void *values[8];
+    char out[64];
+    radix_tree_t *t = radix_tree_create(0, NULL, NULL);
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        keys[i] = (const unsigned char *)sorted[i];
+        lens[i] = strlen(sorted[i]);
+        values[i] = (void *)sorted[i];
+    }
+    values[3] = (void *)"abc2";
+
+    radix_tree_bulk_load(t, keys, lens, values, 8);
+    assert(0 == strcmp((char *)radix_tree_exact_match(t, keys[2], 3), "abc2"));
+    assert(values[0] == radix_tree_exact_match(t, keys[0], 0));
+    // "ab" and "b" hang off the root, "abc" and "abd" off "ab"
+    assert(2 == RADIX_NODE_ITEMS(t->root));
+    out[0] = 0;
+    radix_tree_prefix_walk(t, (unsigned char *)"b", 1, 0, 0, collect_keys, out);
+    assert(0 == strcmp(out, "b,ba,bcd,"));
+
+    radix_tree_destroy(t);
+
+    // unsorted input goes through radix_tree_insert
+    t = radix_tree_create(0, NULL, NULL);
+    for (i = 0; i < 2; i++)
+    {
+        keys[i] = (const unsigned char *)unsorted[i];
+        lens[i] = 1;
+        values[i] = (void *)unsorted[i];
+    }
+    radix_tree_bulk_load(t, keys, lens, values, 2);
+    assert(values[0] == radix_tree_exact_match(t, keys[0], 1));
+    assert(values[1] == radix_tree_exact_match(t, keys[1], 1));
+    radix_tree_destroy(t);
+}
+
+void assert_radix_tree_write_batch()
+{
+    const char *batch[] = { "bcd", "abd", "ab", "", "abc", "ba", "abc", "b" };
+    const char *erased[] = { "abd", "zz", "b", "abc", "ab" };
+    const unsigned char *keys[8];
+    int lens[8];
+    void *values[8];
+    radix_tree_stats_t stats;
+    radix_snapshot_t *snapshot;
+    radix_tree_t *t = radix_tree_create(0, copy_string, free);
+    void *value;
+    int n = 0;
+    int i;
+
+    // unsorted, the later "abc" wins
+    radix_tree_insert(t, (unsigned char *)"abcdef", 6, (void *)"abcdef");
+    for (i = 0; i < 8; i++)
+    {
+        keys[i] = (const unsigned char *)batch[i];
+        lens[i] = strlen(batch[i]);
+        values[i] = (void *)batch[i];
+    }
+    values[6] = (void *)"abc2";
+    radix_tree_insert_batch(t, keys, lens, values, 8);
+    value = radix_tree_exact_match(t, (unsigned char *)"abc", 3);
+    assert(0 == strcmp((char *)value, "abc2"));
+    free(value);
+    assert(NULL != radix_tree_exact_match_borrow(t, (unsigned char *)"", 0));
+    radix_tree_prefix_walk(t, NULL, 0, 0, 0, count_keys, &n);
+    assert(8 == n);
+
+    // emptied nodes are merged once the batch is past them
+    snapshot = radix_tree_snapshot(t);
+    for (i = 0; i < 5; i++)
+    {
+        keys[i] = (const unsigned char *)erased[i];
+        lens[i] = strlen(erased[i]);
+    }
+    radix_tree_erase_batch(t, keys, lens, 5);
+    n = 0;
+    radix_tree_prefix_walk(t, NULL, 0, 0, 0, count_keys, &n);
+    assert(4 == n && NULL != radix_tree_exact_match_borrow(t, (unsigned char *)"abcdef", 6));
+    radix_tree_stats(t, &stats);
+    assert(5 == stats.nodes && 2 == stats.inner);
+    n = 0;
+    radix_tree_prefix_walk(&snapshot->view, NULL, 0, 0, 0, count_keys, &n);
+    assert(8 == n && NULL != radix_tree_exact_match_borrow(&snapshot->view, (unsigned char *)"abd", 3));
+    radix_tree_snapshot_release(snapshot);
+    radix_tree_destroy(t);
+}
+
+void assert_radix_tree_write_batch_long()
+{
+    static unsigned char buf[130][20000];
+    const unsigned char *keys[130];
+    int lens[130];
+    void *values[130];
+    radix_tree_t *t = radix_tree_create(0, NULL, NULL);
+    int n = 0;
+    int i;
+
+    // half the keys only differ in their last byte, the rest far apart
+    // from each other, and none of them in order
+    for (i = 0; i < 130; i++)
+    {
+        memset(buf[i], 'x', 20000);
+        if (i < 65)
+        {
+            buf[i][19999] = (unsigned char)(200 - i);
+        }
+        else
+        {
+            buf[i][0] = (unsigned char)('a' + i % 7);
+            buf[i][10000] = (unsigned char)(255 - i);
+        }
+        keys[i] = buf[i];
+        lens[i] = 20000;
+        values[i] = (void *)(size_t)(i + 1);
+    }
+    radix_tree_insert_batch(t, keys, lens, values, 130);
+    for (i = 0; i < 130; i++)
+    {
+        assert(values[i] == radix_tree_exact_match(t, keys[i], 20000));
+    }
+    radix_tree_prefix_walk(t, NULL, 0, 0, 0, count_keys, &n);
+    assert(130 == n);
+
+    radix_tree_erase_batch(t, keys, lens, 65);
+    n = 0;
+    radix_tree_prefix_walk(t, NULL, 0, 0, 0, count_keys, &n);
+    assert(65 == n && NULL == radix_tree_exact_match(t, keys[0], 20000));
+    radix_tree_destroy(t);
+}
+
+void assert_radix_tree_lazy_remove()
+{
+    const char *words[] = { "ab", "abc", "abcdef", "abd", "b", "ba", "bb" };
+    const char *removed[] = { "abd", "abc", "ba", "ab", "bb" };
+    radix_tree_stats_t eager;
+    radix_tree_stats_t lazy;
+    radix_snapshot_t *snapshot;
+    radix_tree_t *e = radix_tree_create(0, NULL, NULL);
+    radix_tree_t *t = radix_tree_create_arena(NULL, NULL, 4096);
+    void *value;
+    int n = 0;
+    int i;
+
+    radix_tree_set_lazy_remove(t, 1);
+    for (i = 0; i < 7; i++)
+    {
+        radix_tree_insert(e, (unsigned char *)words[i], strlen(words[i]), (void *)words[i]);
+        radix_tree_insert(t, (unsigned char *)words[i], strlen(words[i]), (void *)words[i]);
+    }
+    radix_tree_stats(t, &lazy);
+    for (i = 0; i < 5; i++)
+    {
+        radix_tree_remove(e, (unsigned char *)removed[i], strlen(removed[i]), &value);
+        radix_tree_remove(t, (unsigned char *)removed[i], strlen(removed[i]), &value);
+        assert(value == (void *)removed[i]);
+        assert(NULL == radix_tree_exact_match(t, (unsigned char *)removed[i], strlen(removed[i])));
+    }
+
+    // only the values are gone, and walks skip what is left
+    radix_tree_stats(t, &eager);
+    assert(lazy.nodes == eager.nodes && 2 == eager.values);
+    radix_tree_prefix_walk(t, NULL, 0, 0, -1, count_keys, &n);
+    assert(2 == n);
+    assert(1 == radix_tree_prefix_match(t, (unsigned char *)"abcdefg", 7, &value));
+    assert(value == (void *)words[2]);
+
+    // put back before its turn, the key keeps its node
+    radix_tree_insert(t, (unsigned char *)"ba", 2, (void *)words[5]);
+    radix_tree_insert(e, (unsigned char *)"ba", 2, (void *)words[5]);
+    snapshot = radix_tree_snapshot(t);
+    assert(3 == radix_tree_compact(t, 1));
+    assert(0 == radix_tree_compact(t, 0));
+    assert(0 == radix_tree_compact(t, 0));
+    radix_tree_stats(e, &eager);
+    radix_tree_stats(t, &lazy);
+    assert(lazy.nodes == eager.nodes && lazy.inner == eager.inner && 3 == lazy.values);
+    assert(words[5] == radix_tree_exact_match(t, (unsigned char *)"ba", 2));
+    assert(words[2] == radix_tree_exact_match(t, (unsigned char *)"abcdef", 6));
+    assert(NULL == radix_tree_exact_match(&snapshot->view, (unsigned char *)"abd", 3));
+    assert(words[2] == radix_tree_exact_match(&snapshot->view, (unsigned char *)"abcdef", 6));
+    radix_tree_snapshot_release(snapshot);
+
+    // erasing a key again finds no value and queues nothing more
+    radix_tree_insert(t, (unsigned char *)"abd", 3, (void *)words[3]);
+    for (i = 0; i < 1000; i++)
+    {
+        radix_tree_erase(t, (unsigned char *)"abd", 3);
+    }
+    radix_tree_remove(t, (unsigned char *)"abd", 3, &value);
+    assert(NULL == value);
+    assert(0 == radix_tree_compact(t, 1));
+    assert(words[2] == radix_tree_exact_match(t, (unsigned char *)"abcdef", 6));
+
+    // a clear drops whatever is queued
+    radix_tree_remove(t, (unsigned char *)"abcdef", 6, &value);
+    radix_tree_clear(t);
+    assert(0 == radix_tree_compact(t, 0));
+    radix_tree_destroy(e);
+    radix_tree_destroy(t);
+}
+
+void assert_radix_tree_parallel_load()
+{
+    static char words[600][8];
+    const unsigned char *keys[601];
+    int lens[601];
+    void *values[601];
+    radix_tree_t *t = radix_tree_create_arena(NULL, NULL, 4096);
+    bit_radix_tree_t *b = bit_radix_tree_create(2, NULL, NULL);
+    int i;
+
+    // unsorted, spread over a few leading bytes, with a duplicate and an empty key
+    for (i = 0; i < 600; i++)
+    {
+        sprintf(words[i], "%c%d", 'a' + (i * 7) % 11, i / 3);
+        keys[i] = (const unsigned char *)words[i];
+        lens[i] = strlen(words[i]);
+        values[i] = words[i];
+    }
+    strcpy(words[599], words[1]);
+    lens[599] = lens[1];
+    keys[600] = (const unsigned char *)"";
+    lens[600] = 0;
+    values[600] = (void *)"";
+
+    radix_tree_parallel_load(t, keys, lens, values, 601, 4);
+    for (i = 0; i < 600; i++)
+    {
+        assert(0 == strcmp((char *)radix_tree_exact_match(t, keys[i], lens[i]), words[i]));
+    }
+    assert(values[599] == radix_tree_exact_match(t, keys[1], lens[1]));
+    assert(values[600] == radix_tree_exact_match(t, keys[600], 0));
+    assert(11 == RADIX_NODE_ITEMS(t->root));
+    radix_tree_destroy(t);
+
+    // a 3 bit key is shorter than the leading byte the bit tree splits on
+    for (i = 0; i < 601; i++)
+    {
+        lens[i] *= 8;
+    }
+    lens[600] = 3;
+    keys[600] = (const unsigned char *)"\x05";
+    bit_radix_tree_parallel_load(b, keys, lens, values, 601, 4);
+    for (i = 0; i < 600; i++)
+    {
+        assert(0 == strcmp((char *)bit_radix_tree_exact_match(b, keys[i], lens[i]), words[i]));
+    }
+    assert(values[599] == bit_radix_tree_exact_match(b, keys[1], lens[1]));
+    assert(values[600] == bit_radix_tree_exact_match(b, keys[600], 3));
+    assert(NULL == bit_radix_tree_exact_match(b, (const unsigned char *)"a", 8));
+    bit_radix_tree_destroy(b);
+}
+
+void assert_radix_tree_image()
+{
+    const char *words[] = { "", "route", "router", "routes/a/very/long/label/1", "routes/a/very/long/label/2", "x" };
+    char key[8];
+    radix_tree_t *t = radix_tree_create(0, NULL, NULL);
+    radix_image_t *image;
+    void *leaf;
+    FILE *f;
+    int i;
+
+    for (i = 0; i < 6; i++)
+    {
+        radix_tree_insert(t, (unsigned char *)words[i], strlen(words[i]), (void *)(size_t)(i + 1));
+    }
+    // enough children under "k" for a direct table
+    for (i = 0; i < 100; i++)
+    {
+        sprintf(key, "k%c", i + 1);
+        radix_tree_insert(t, (unsigned char *)key, 2, (void *)(size_t)(i + 100));
+    }
+
+    f = fopen("radix_tree_test.img", "wb");
+    assert(f != NULL);
+    assert(0 == radix_tree_save(t, fileno(f)));
+    fclose(f);
+
+    image = radix_tree_open_mmap("radix_tree_test.img");
+    assert(image != NULL);
+    for (i = 0; i < 6; i++)
+    {
+        assert((void *)(size_t)(i + 1) == radix_image_exact_match(image, (unsigned char *)words[i], strlen(words[i])));
+    }
+    for (i = 0; i < 100; i++)
+    {
+        sprintf(key, "k%c", i + 1);
+        assert((void *)(size_t)(i + 100) == radix_image_exact_match(image, (unsigned char *)key, 2));
+    }
+    assert(NULL == radix_image_exact_match(image, (unsigned char *)"rout", 4));
+    assert(NULL == radix_image_exact_match(image, (unsigned char *)"routes/a/very/long/label/", 25));
+    assert(NULL == radix_image_exact_match(image, (unsigned char *)"k", 1));
+
+    assert(3 == radix_image_prefix_match(image, (unsigned char *)"routerx", 7, &leaf));
+    assert((void *)3 == leaf);
+    assert(radix_tree_prefix_match(t, (unsigned char *)"routes/a/very/long/label/2", 26, &leaf)
+        == radix_image_prefix_match(image, (unsigned char *)"routes/a/very/long/label/2", 26, &leaf));
+    assert((void *)5 == leaf);
+    radix_image_close(image);
+    radix_tree_destroy(t);
+
+    // a truncated image is refused
+    f = fopen("radix_tree_test.img", "wb");
+    fputs(RADIX_IMAGE_MAGIC, f);
+    fclose(f);
+    assert(NULL == radix_tree_open_mmap("radix_tree_test.img"));
+    remove("radix_tree_test.img");
+}
+
+void assert_radix_log()
+{
+    radix_tree_t *t = radix_tree_create(0, NULL, NULL);
+    radix_log_t *log;
+    FILE *f;
+
+    remove("radix_tree_test.log");
+    remove("radix_tree_test.img");
+    log = radix_log_open("radix_tree_test.log");
+    assert(log != NULL);
+    t->log = log;
+
+    radix_tree_insert(t, (unsigned char *)"alpha", 5, (void *)1);
+    radix_tree_insert(t, (unsigned char *)"beta", 4, (void *)2);
+    radix_tree_insert(t, (unsigned char *)"/a/1", 4, (void *)3);
+    assert(0 == radix_log_checkpoint(log, t, "radix_tree_test.img"));
+
+    // only these go into the log after the checkpoint
+    radix_tree_insert(t, (unsigned char *)"/a/2", 4, (void *)4);
+    radix_tree_insert(t, (unsigned char *)"alpha", 5, (void *)5);
+    radix_tree_erase(t, (unsigned char *)"beta", 4);
+    radix_tree_erase(t, (unsigned char *)"gamma", 5);
+    radix_tree_erase(t, (unsigned char *)"/a/", 3);  // a branch point, not a key
+    assert(0 == radix_log_commit(log));
+    radix_tree_erase_prefix(t, (unsigned char *)"/a/", 3);
+    radix_tree_insert(t, (unsigned char *)"delta", 5, (void *)6);
+    radix_log_close(log);
+    radix_tree_destroy(t);
+
+    // a torn record at the end is ignored, and cut off by the next open
+    f = fopen("radix_tree_test.log", "ab");
+    fwrite("torn", 1, 4, f);
+    fclose(f);
+
+    t = radix_tree_create(0, NULL, NULL);
+    assert(5 == radix_log_recover(t, "radix_tree_test.img", "radix_tree_test.log"));
+    assert((void *)5 == radix_tree_exact_match(t, (unsigned char *)"alpha", 5));
+    assert((void *)6 == radix_tree_exact_match(t, (unsigned char *)"delta", 5));
+    assert(NULL == radix_tree_exact_match(t, (unsigned char *)"beta", 4));
+    assert(NULL == radix_tree_exact_match(t, (unsigned char *)"/a/1", 4));
+    assert(NULL == radix_tree_exact_match(t, (unsigned char *)"/a/2", 4));
+
+    log = radix_log_open("radix_tree_test.log");
+    assert(log != NULL);
+    t->log = log;
+    radix_tree_insert(t, (unsigned char *)"beta", 4, (void *)7);
+    radix_log_close(log);
+    radix_tree_destroy(t);
+
+    t = radix_tree_create(0, NULL, NULL);
+    assert(6 == radix_log_recover(t, "radix_tree_test.img", "radix_tree_test.log"));
+    assert((void *)7 == radix_tree_exact_match(t, (unsigned char *)"beta", 4));
+
+    // a clear drops the checkpoint too, only what follows it comes back
+    log = radix_log_open("radix_tree_test.log");
+    assert(log != NULL);
+    t->log = log;
+    radix_tree_clear(t);
+    radix_tree_insert(t, (unsigned char *)"epsilon", 7, (void *)8);
+    radix_tree_insert(t, (unsigned char *)"zeta", 4, (void *)9);
+    radix_log_close(log);
+    radix_tree_destroy(t);
+
+    t = radix_tree_create(0, NULL, NULL);
+    assert(9 == radix_log_recover(t, "radix_tree_test.img", "radix_tree_test.log"));
+    assert(NULL == radix_tree_exact_match(t, (unsigned char *)"alpha", 5));
+    assert(NULL == radix_tree_exact_match(t, (unsigned char *)"beta", 4));
+    assert((void *)8 == radix_tree_exact_match(t, (unsigned char *)"epsilon", 7));
+    assert((void *)9 == radix_tree_exact_match(t, (unsigned char *)"zeta", 4));
+    radix_tree_destroy(t);
+
+    remove("radix_tree_test.log");
+    remove("radix_tree_test.img");
+}
+
+void assert_radix_tree_freeze()
+{
+    const char *words[] = { "", "a", "ab", "abc", "abcdefghijklmnopqrstuvwxyz", "abd", "b", "zz" };
+    char key[16];
+    char out[64];
+    radix_tree_t *t = radix_tree_create(0, NULL, NULL);
+    radix_frozen_t *f;
+    void *leaf;
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        radix_tree_insert(t, (unsigned char *)words[i], strlen(words[i]), (void *)words[i]);
+    }
+    for (i = 0; i < 2000; i++)
+    {
+        sprintf(key, "k%d", i * 7);
+        radix_tree_insert(t, (unsigned char *)key, strlen(key), (void *)(size_t)(i + 1));
+    }
+
+    f = radix_tree_freeze(t);
+    assert(f != NULL);
+    for (i = 0; i < 8; i++)
+    {
+        assert(words[i] == radix_frozen_exact_match(f, (unsigned char *)words[i], strlen(words[i])));
+    }
+    for (i = 0; i < 2000; i++)
+    {
+        sprintf(key, "k%d", i * 7);
+        assert((void *)(size_t)(i + 1) == radix_frozen_exact_match(f, (unsigned char *)key, strlen(key)));
+    }
+    assert(NULL == radix_frozen_exact_match(f, (unsigned char *)"abcdefg", 7));
+    assert(NULL == radix_frozen_exact_match(f, (unsigned char *)"k1", 2));
+    assert(NULL == radix_frozen_exact_match(f, (unsigned char *)"abe", 3));
+
+    assert(4 == radix_frozen_prefix_match(f, (unsigned char *)"abcdx", 5, &leaf));
+    assert(words[3] == leaf);
+    assert(1 == radix_frozen_prefix_match(f, (unsigned char *)"q", 1, &leaf));
+    assert(words[0] == leaf);
+
+    out[0] = 0;
+    assert(5 == radix_frozen_walk(f, collect_keys, out));
+    assert(0 == strcmp(out, ",a,ab,abc,abcdefghijklmnopqrstuvwxyz,"));
+    i = 0;
+    assert(2008 == radix_frozen_walk(f, count_keys, &i));
+    assert(2008 == i);
+    // a few bytes of topology per key besides the value pointer
+    assert(f->bytes < 2008 * (sizeof(void *) + 8));
+
+    radix_frozen_destroy(f);
+    radix_tree_destroy(t);
+}
+
+void assert_radix_lpm()
+{
+    const unsigned char p0[4] = { 0, 0, 0, 0 };
+    const unsigned char p8[4] = { 10, 0, 0, 0 };
+    const unsigned char p24[4] = { 10, 1, 2, 0 };
+    const unsigned char p25[4] = { 10, 1, 2, 128 };
+    const unsigned char p32[4] = { 10, 1, 2, 200 };
+    const unsigned char v6[16] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+    const unsigned char addr[4] = { 10, 1, 2, 201 };
+    unsigned int addrs[5];
+    void *values[5];
+    radix_lpm_t *lpm;
+
+    lpm = radix_lpm_create(32);
+    assert(NULL == radix_lpm_lookup_ipv4(lpm, 0x0a010203));
+    assert(0 == radix_lpm_add(lpm, p25, 25, (void *)"25"));
+    assert(0 == radix_lpm_add(lpm, p8, 8, (void *)"8"));
+    assert(0 == radix_lpm_add(lpm, p32, 32, (void *)"32"));
+    assert(0 == radix_lpm_add(lpm, p24, 24, (void *)"24"));
+    assert(0 == radix_lpm_add(lpm, p0, 0, (void *)"0"));
+    assert(-1 == radix_lpm_add(lpm, p0, 33, (void *)"33"));
+
+    addrs[0] = 0x0b000001;
+    addrs[1] = 0x0a020304;
+    addrs[2] = 0x0a010203;
+    addrs[3] = 0x0a0102c8;
+    addrs[4] = 0x0a0102c9;
+    radix_lpm_lookup_ipv4_batch(lpm, addrs, 5, values);
+    assert(0 == strcmp((char *)values[0], "0"));
+    assert(0 == strcmp((char *)values[1], "8"));
+    assert(0 == strcmp((char *)values[2], "24"));
+    assert(0 == strcmp((char *)values[3], "32"));
+    assert(0 == strcmp((char *)values[4], "25"));
+    assert(values[4] == radix_lpm_lookup(lpm, addr));
+    assert(values[3] == radix_lpm_lookup_ipv4(lpm, addrs[3]));
+
+    assert(0 == radix_lpm_add(lpm, p25, 25, (void *)"25b"));
+    assert(0 == strcmp((char *)radix_lpm_lookup_ipv4(lpm, addrs[4]), "25b"));
+
+    // every address falls back to the next shorter prefix
+    assert(0 == radix_lpm_delete(lpm, p25, 25));
+    assert(-1 == radix_lpm_delete(lpm, p25, 25));
+    assert(0 == strcmp((char *)radix_lpm_lookup_ipv4(lpm, addrs[4]), "24"));
+    assert(0 == strcmp((char *)radix_lpm_lookup_ipv4(lpm, addrs[3]), "32"));
+    assert(0 == radix_lpm_delete(lpm, p24, 24));
+    assert(0 == strcmp((char *)radix_lpm_lookup_ipv4(lpm, addrs[4]), "8"));
+    assert(0 == radix_lpm_delete(lpm, p32, 32));
+    assert(0 == strcmp((char *)radix_lpm_lookup_ipv4(lpm, addrs[3]), "8"));
+    assert(lpm->free_group != 0);
+    assert(0 == radix_lpm_delete(lpm, p0, 0));
+    assert(NULL == radix_lpm_lookup_ipv4(lpm, addrs[0]));
+    assert(0 == strcmp((char *)radix_lpm_lookup_ipv4(lpm, addrs[1]), "8"));
+    radix_lpm_destroy(lpm);
+
+    lpm = radix_lpm_create(128);
+    assert(0 == radix_lpm_add(lpm, v6, 32, (void *)"32"));
+    assert(0 == radix_lpm_add(lpm, v6, 128, (void *)"128"));
+    assert(0 == radix_lpm_add(lpm, v6, 20, (void *)"20"));
+    assert(0 == strcmp((char *)radix_lpm_lookup(lpm, v6), "128"));
+    assert(0 == radix_lpm_delete(lpm, v6, 128));
+    assert(0 == strcmp((char *)radix_lpm_lookup(lpm, v6), "32"));
+    assert(0 == radix_lpm_delete(lpm, v6, 32));
+    assert(0 == strcmp((char *)radix_lpm_lookup(lpm, v6), "20"));
+    assert(NULL == radix_lpm_lookup(lpm, addr));
+    radix_lpm_destroy(lpm);
+}
+
+void assert_radix_tree_arena()
+{
+    char key[32];
+    void *leaf;
+    int i;
+    int round;
+    radix_tree_t *t = radix_tree_create_arena(copy_string, free, 4096);
+    bit_radix_tree_t *bt = bit_radix_tree_create_arena(2, copy_string, free, 0);
+
+    for (round = 0; round < 2; round++)
+    {
+        for (i = 0; i < 1000; i++)
+        {
+            sprintf(key, "/path/%d/item", i * 37);
+            radix_tree_insert(t, (unsigned char *)key, strlen(key), key);
+            bit_radix_tree_insert(bt, (unsigned char *)key, 8 * strlen(key), key);
+        }
+
+        for (i = 0; i < 1000; i += 2)
+        {
+            sprintf(key, "/path/%d/item", i * 37);
+            radix_tree_erase(t, (unsigned char *)key, strlen(key));
+        }
+
+        for (i = 0; i < 1000; i++)
+        {
+            sprintf(key, "/path/%d/item", i * 37);
+            leaf = radix_tree_exact_match(t, (unsigned char *)key, strlen(key));
+            assert((i % 2 == 0) == (leaf == NULL));
+            if (leaf != NULL)
+            {
+                assert(0 == strcmp((char *)leaf, key));
+                free(leaf);
+            }
+            leaf = bit_radix_tree_exact_match(bt, (unsigned char *)key, 8 * strlen(key));
+            assert(0 == strcmp((char *)leaf, key));
+            free(leaf);
+        }
+
+        radix_tree_clear(t);
+        bit_radix_tree_clear(bt);
+        sprintf(key, "/path/%d/item", 37);
+        assert(NULL == radix_tree_exact_match(t, (unsigned char *)key, strlen(key)));
+        assert(NULL == bit_radix_tree_exact_match(bt, (unsigned char *)key, 8 * strlen(key)));
+    }
+
+    radix_tree_insert(t, (unsigned char *)"left", 4, (void *)"over");
+    radix_tree_destroy(t);
+    bit_radix_tree_destroy(bt);
+}
+
+struct concurrent_test
+{
+    concurrent_radix_tree_t *tree;
+    volatile long done;
+    long lookups;
+};
+
+static void *concurrent_compactor(void *arg)
+{
+    struct concurrent_test *ct = (struct concurrent_test *)arg;
+
+    while (!radix_atomic_load_long(&ct->done))
+    {
+        if (0 == concurrent_radix_tree_compact(ct->tree, 64))
+        {
+            radix_thread_yield();
+        }
+        ct->lookups++;
+    }
+    return NULL;
+}
+
+static void *concurrent_reader(void *arg)
+{
+    struct concurrent_test *ct = (struct concurrent_test *)arg;
+    char key[32];
+    const void *borrowed;
+    void *leaf;
+    int slot;
+    int i;
+
+    while (!radix_atomic_load_long(&ct->done))
+    {
+        // even keys are never touched by the writer
+        for (i = 0; i < 512; i += 2)
+        {
+            sprintf(key, "/route/%d", i);
+            leaf = concurrent_radix_tree_exact_match(ct->tree, (unsigned char *)key, strlen(key));
+            assert(leaf != NULL && 0 == strcmp((char *)leaf, key));
+            free(leaf);
+            ct->lookups++;
+        }
+
+        // values the writer replaces meanwhile stay readable until read_exit
+        slot = concurrent_radix_tree_read_enter(ct->tree);
+        sprintf(key, "/route/%d", 0);
+        borrowed = concurrent_radix_tree_exact_match_borrow(ct->tree, (unsigned char *)key, strlen(key));
+        for (i = 0; i < 512; i += 2)
+        {
+            sprintf(key, "/route/%d", i);
+            assert(1 <= concurrent_radix_tree_prefix_match_borrow(ct->tree, (unsigned char *)key, strlen(key), (const void **)&leaf));
+            assert(0 == strcmp((const char *)leaf, key));
+        }
+        assert(0 == strcmp((const char *)borrowed, "/route/0"));
+        concurrent_radix_tree_read_exit(ct->tree, slot);
+    }
+    return NULL;
+}
+
+void assert_concurrent_radix_tree()
+{
+    struct concurrent_test ct[5];
+    radix_thread_t threads[5];
+    concurrent_radix_tree_t *t = concurrent_radix_tree_create(copy_string, free);
+    radix_snapshot_t *evens;
+    radix_snapshot_t *all = NULL;
+    char key[32];
+    void *leaf;
+    int n = 0;
+    int i;
+    int round;
+
+    for (i = 0; i < 512; i += 2)
+    {
+        sprintf(key, "/route/%d", i);
+        concurrent_radix_tree_insert(t, (unsigned char *)key, strlen(key), key);
+    }
+    evens = concurrent_radix_tree_snapshot(t);
+    assert(evens != NULL);
+
+    for (i = 0; i < 4; i++)
+    {
+        ct[i].tree = t;
+        ct[i].done = 0;
+        ct[i].lookups = 0;
+        assert(0 == radix_thread_create(&threads[i], concurrent_reader, &ct[i]));
+    }
+    ct[4].tree = t;
+    ct[4].done = 0;
+    ct[4].lookups = 0;
+    assert(0 == radix_thread_create(&threads[4], concurrent_compactor, &ct[4]));
+
+    // odd keys split and merge the nodes the readers walk through
+    for (round = 0; round < 50; round++)
+    {
+        for (i = 1; i < 512; i += 2)
+        {
+            sprintf(key, "/route/%d", i);
+            concurrent_radix_tree_insert(t, (unsigned char *)key, strlen(key), key);
+        }
+        for (i = 0; i < 512; i += 2)
+        {
+            sprintf(key, "/route/%d", i);
+            concurrent_radix_tree_insert(t, (unsigned char *)key, strlen(key), key);
+        }
+        // snapshots swap the root and path copy under the readers
+        if (round == 20)
+        {
+            all = concurrent_radix_tree_snapshot(t);
+        }
+        else if (round == 30)
+        {
+            concurrent_radix_tree_snapshot_release(t, all);
+        }
+        // from here on a thread of its own tidies up after the erases
+        if (round == 10)
+        {
+            concurrent_radix_tree_set_lazy_remove(t, 1);
+        }
+        for (i = 1; i < 512; i += 2)
+        {
+            sprintf(key, "/route/%d", i);
+            concurrent_radix_tree_erase(t, (unsigned char *)key, strlen(key));
+        }
+    }
+
+    for (i = 0; i < 5; i++)
+    {
+        radix_atomic_store_long(&ct[i].done, 1);
+        radix_thread_join(threads[i]);
+        assert(ct[i].lookups > 0);
+    }
+    assert(0 == concurrent_radix_tree_compact(t, 0));
+
+    radix_tree_prefix_walk(&evens->view, NULL, 0, 0, -1, count_keys, &n);
+    assert(256 == n);
+    leaf = radix_tree_exact_match(&evens->view, (unsigned char *)"/route/2", 8);
+    assert(0 == strcmp((char *)leaf, "/route/2"));
+    free(leaf);
+    concurrent_radix_tree_snapshot_release(t, evens);
+
+    concurrent_radix_tree_synchronize(t);
+    leaf = concurrent_radix_tree_exact_match(t, (unsigned char *)"/route/1", 8);
+    assert(NULL == leaf);
+    concurrent_radix_tree_clear(t);
+    leaf = concurrent_radix_tree_exact_match(t, (unsigned char *)"/route/2", 8);
+    assert(NULL == leaf);
+    concurrent_radix_tree_destroy(t);
+}
+
+struct olc_test
+{
+    concurrent_radix_tree_t *tree;
+    int id;
+};
+
+static void *olc_writer(void *arg)
+{
+    struct olc_test *ot = (struct olc_test *)arg;
+    char key[32];
+    void *leaf;
+    int i;
+    int round;
+
+    // keys of all writers share prefixes, so splits and merges keep
+    // hitting the same upper nodes
+    for (round = 0; round < 20; round++)
+    {
+        for (i = 0; i < 300; i++)
+        {
+            sprintf(key, "/k/%d/%d", i, ot->id);
+            concurrent_radix_tree_insert(ot->tree, (unsigned char *)key, strlen(key), key);
+        }
+        for (i = 0; i < 300; i++)
+        {
+            sprintf(key, "/k/%d/%d", i, ot->id);
+            leaf = concurrent_radix_tree_exact_match(ot->tree, (unsigned char *)key, strlen(key));
+            assert(leaf != NULL && 0 == strcmp((char *)leaf, key));
+            free(leaf);
+        }
+        for (i = round % 2; i < 300; i += 2)
+        {
+            sprintf(key, "/k/%d/%d", i, ot->id);
+            concurrent_radix_tree_remove(ot->tree, (unsigned char *)key, strlen(key), &leaf);
+            assert(leaf != NULL && 0 == strcmp((char *)leaf, key));
+            concurrent_radix_tree_synchronize(ot->tree);
+            free(leaf);
+        }
+    }
+    return NULL;
+}
+
+void assert_concurrent_radix_tree_olc()
+{
+    struct olc_test ot[4];
+    radix_thread_t threads[4];
+    concurrent_radix_tree_t *t = concurrent_radix_tree_create_olc(copy_string, free);
+    char key[32];
+    void *leaf;
+    int i;
+    int j;
+
+    for (i = 0; i < 4; i++)
+    {
+        ot[i].tree = t;
+        ot[i].id = i;
+        assert(0 == radix_thread_create(&threads[i], olc_writer, &ot[i]));
+    }
+    for (i = 0; i < 4; i++)
+    {
+        radix_thread_join(threads[i]);
+    }
+
+    // the last round removed the odd keys
+    for (i = 0; i < 300; i++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            sprintf(key, "/k/%d/%d", i, j);
+            leaf = concurrent_radix_tree_exact_match(t, (unsigned char *)key, strlen(key));
+            assert((i % 2 == 1) == (leaf == NULL));
+            free(leaf);
+            concurrent_radix_tree_erase(t, (unsigned char *)key, strlen(key));
+        }
+    }
+    assert(0 == RADIX_NODE_ITEMS(t->tree.root));
+    concurrent_radix_tree_destroy(t);
+}
+
 void assert_bit_radix_tree()
 {
     void *leaf;
@@ -112,11 +1340,308 @@ void assert_bit_radix_tree()
     bit_radix_tree_destroy(t);
 }
 
+void assert_bit_radix_tree_stride()
+{
+    // 0x0b is 1101 in key bit order
+    const unsigned char k[2] = { 0x0b, 0xf0 };
+    void *leaf;
+    int stride;
+    int nc;
+    bit_radix_tree_t *t;
+
+    for (stride = 1; stride <= 8; stride *= 2)
+    {
+        t = bit_radix_tree_create(2, NULL, NULL);
+        assert(0 == bit_radix_tree_set_stride(t, stride));
+        bit_radix_tree_insert(t, k, 0, (void *)"0");
+        bit_radix_tree_insert(t, k, 1, (void *)"1");
+        bit_radix_tree_insert(t, k, 3, (void *)"3");
+        bit_radix_tree_insert(t, k, 9, (void *)"9");
+        bit_radix_tree_insert(t, k, 16, (void *)"16");
+        assert(-1 == bit_radix_tree_set_stride(t, 4));
+        assert(t->table_size == 1 << stride);
+
+        assert(0 == strcmp((char *)bit_radix_tree_exact_match(t, k, 3), "3"));
+        assert(0 == strcmp((char *)bit_radix_tree_exact_match(t, k, 9), "9"));
+        assert(NULL == bit_radix_tree_exact_match(t, k, 2));
+        assert(NULL == bit_radix_tree_exact_match(t, k, 8));
+        nc = bit_radix_tree_prefix_match(t, k, 12, &leaf);
+        assert(4 == nc);
+        assert(0 == strcmp((char *)leaf, "9"));
+        nc = bit_radix_tree_prefix_match(t, k, 2, &leaf);
+        assert(2 == nc);
+        assert(0 == strcmp((char *)leaf, "1"));
+
+        bit_radix_tree_remove(t, k, 3, &leaf);
+        assert(0 == strcmp((char *)leaf, "3"));
+        bit_radix_tree_remove(t, k, 9, &leaf);
+        assert(0 == strcmp((char *)leaf, "9"));
+        bit_radix_tree_remove(t, k, 9, &leaf);
+        assert(NULL == leaf);
+        nc = bit_radix_tree_prefix_match(t, k, 16, &leaf);
+        assert(3 == nc);
+        assert(0 == strcmp((char *)leaf, "16"));
+        bit_radix_tree_destroy(t);
+    }
+}
+
+static int count_bit_nodes(bit_radix_tree_node_t *node)
+{
+    int n = 0;
+    int i;
+
+    for (; node != NULL; node = node->next)
+    {
+        n++;
+        for (i = 0; i < node->table_size; i++)
+        {
+            n += count_bit_nodes(node->table[i]);
+        }
+    }
+    return n;
+}
+
+void assert_bit_radix_tree_merge()
+{
+    static const int kept[3] = { 5, 77, 130 };
+    unsigned char keys[200][4];
+    bit_radix_tree_t *t;
+    bit_radix_tree_t *fresh;
+    void *leaf;
+    int stride;
+    int round;
+    int len;
+    int i;
+
+    for (i = 0; i < 200; i++)
+    {
+        keys[i][0] = 10;
+        keys[i][1] = (unsigned char)(i * 37);
+        keys[i][2] = (unsigned char)(i * 11 + 3);
+        keys[i][3] = (unsigned char)i;
+    }
+
+    for (stride = 1; stride <= 8; stride *= 2)
+    {
+        t = bit_radix_tree_create(2, NULL, NULL);
+        fresh = bit_radix_tree_create(2, NULL, NULL);
+        bit_radix_tree_set_stride(t, stride);
+        bit_radix_tree_set_stride(fresh, stride);
+
+        // churn, some keys end between stride boundaries
+        for (round = 0; round < 3; round++)
+        {
+            for (i = 0; i < 200; i++)
+            {
+                len = i % 3 == 0 ? 29 : 32;
+                bit_radix_tree_insert(t, keys[i], len, (void *)(size_t)(i + 1));
+            }
+            for (i = 0; i < 200; i++)
+            {
+                len = i % 3 == 0 ? 29 : 32;
+                if (i != kept[0] && i != kept[1] && i != kept[2])
+                {
+                    bit_radix_tree_remove(t, keys[i], len, &leaf);
+                    assert(leaf == (void *)(size_t)(i + 1));
+                }
+            }
+        }
+
+        // the removes leave the same compressed paths a fresh tree has
+        for (i = 0; i < 3; i++)
+        {
+            len = kept[i] % 3 == 0 ? 29 : 32;
+            bit_radix_tree_insert(fresh, keys[kept[i]], len, (void *)(size_t)(kept[i] + 1));
+            assert(bit_radix_tree_exact_match(t, keys[kept[i]], len) == (void *)(size_t)(kept[i] + 1));
+        }
+        assert(count_bit_nodes(t->root) == count_bit_nodes(fresh->root));
+        bit_radix_tree_destroy(t);
+        bit_radix_tree_destroy(fresh);
+    }
+}
+
+void assert_bit_radix_tree_tables()
+{
+    bit_radix_tree_t *t = bit_radix_tree_create(2, NULL, NULL);
+    unsigned char k[2];
+    void *leaf;
+    int i;
+
+    assert(0 == bit_radix_tree_set_stride(t, 8));
+    k[1] = 7;
+    k[0] = 0;
+    bit_radix_tree_insert(t, k, 16, (void *)1);
+    assert(2 == t->root->table_size);
+
+    // tables double as children arrive, up to one slot per chunk
+    for (i = 1; i < 100; i++)
+    {
+        k[0] = (unsigned char)i;
+        bit_radix_tree_insert(t, k, 16, (void *)(size_t)(i + 1));
+    }
+    assert(100 == t->root->table_items && 128 == t->root->table_size);
+    for (i = 100; i < 256; i++)
+    {
+        k[0] = (unsigned char)i;
+        bit_radix_tree_insert(t, k, 16, (void *)(size_t)(i + 1));
+    }
+    assert(256 == t->root->table_size);
+    for (i = 0; i < 256; i++)
+    {
+        k[0] = (unsigned char)i;
+        assert((void *)(size_t)(i + 1) == bit_radix_tree_exact_match(t, k, 16));
+        assert(NULL == t->root->table[i]->next);
+    }
+
+    // and halve once a quarter full, the last child takes the table along
+    for (i = 0; i < 250; i++)
+    {
+        k[0] = (unsigned char)i;
+        bit_radix_tree_remove(t, k, 16, &leaf);
+        assert((void *)(size_t)(i + 1) == leaf);
+    }
+    assert(6 == t->root->table_items && t->root->table_size <= 24);
+    for (i = 250; i < 256; i++)
+    {
+        k[0] = (unsigned char)i;
+        assert((void *)(size_t)(i + 1) == bit_radix_tree_exact_match(t, k, 16));
+        bit_radix_tree_erase(t, k, 16);
+    }
+    assert(NULL == t->root->table && 0 == t->root->table_size);
+    bit_radix_tree_destroy(t);
+}
+
+static int counted_live;
+
+struct counted
+{
+    std::string s;
+    counted() { counted_live++; }
+    counted(const char *v) : s(v) { counted_live++; }
+    counted(const counted &o) : s(o.s) { counted_live++; }
+    counted(counted &&o) : s(std::move(o.s)) { counted_live++; }
+    counted &operator=(const counted &o) { s = o.s; return *this; }
+    counted &operator=(counted &&o) { s = std::move(o.s); return *this; }
+    ~counted() { counted_live--; }
+};
+
+struct prefix4
+{
+    unsigned char addr[4];
+    int depth;
+};
+
+struct prefix4_traits : radix_bit_traits<prefix4, 4>
+{
+    static const int block_size = 4096;
+    static const unsigned char *data(const prefix4 &key) { return key.addr; }
+    static int length(const prefix4 &key) { return key.depth; }
+};
+
+void assert_radix_tree_template()
+{
+    int v;
+
+    {
+        // ints live in the tree word, 0 included
+        radix_tree<std::string, int> t;
+        assert(t.insert("", 0));
+        assert(t.insert("ab", 2));
+        assert(t.insert("abcd", -4));
+        assert(!t.insert("ab", 20));
+        assert(3 == t.size());
+        assert(t.find("", v) && v == 0);
+        assert(t.find("ab", v) && v == 20);
+        assert(!t.find("abc", v));
+        assert(2 == t.longest_prefix("abcx", v) && v == 20);
+        assert(t.remove("abcd", &v) && v == -4);
+        assert(!t.remove("abcd"));
+        radix_tree<std::string, int> moved(std::move(t));
+        assert(2 == moved.size() && moved.contains("ab"));
+        moved.clear();
+        assert(moved.empty() && !moved.contains(""));
+    }
+
+    {
+        radix_tree<std::string, counted> t;
+        counted c("x");
+        char key[16];
+        int i;
+
+        for (i = 0; i < 1000; i++)
+        {
+            sprintf(key, "k%d", i);
+            t.emplace(key, key);
+        }
+        t.insert("", std::move(c));
+        t.insert("k7", counted("seven"));
+        assert(t.find("k7", c) && c.s == "seven");
+        assert(t.find("k999", c) && c.s == "k999");
+        assert(1 == t.longest_prefix("", c) && c.s == "x");
+        for (i = 0; i < 500; i++)
+        {
+            sprintf(key, "k%d", i);
+            assert(t.remove(key, i == 3 ? &c : NULL));
+        }
+        assert(c.s == "k3");
+        assert(501 == t.size());
+        t.emplace("again", "a");
+        assert(t.find("again", c) && c.s == "a");
+        assert(counted_live == 1 + 502);
+        t.clear();
+        assert(counted_live == 1);
+        t.emplace("k1", "b");
+    }
+    assert(counted_live == 0);
+
+    {
+        radix_tree<prefix4, std::string, prefix4_traits> t;
+        prefix4 p = { { 10, 0, 0, 0 }, 8 };
+        std::string s;
+        t.insert(p, "10/8");
+        p.addr[1] = 1;
+        p.depth = 16;
+        t.insert(p, "10.1/16");
+        p.addr[2] = 2;
+        p.addr[3] = 3;
+        p.depth = 32;
+        assert(2 == t.longest_prefix(p, s) && s == "10.1/16");
+        p.depth = 13;
+        assert(1 == t.longest_prefix(p, s) && s == "10/8");
+    }
+}
+
 int main(int argc, char* argv[])
 {
+    assert_radix_key();
     assert_bit_radix_tree();
+    assert_bit_radix_tree_stride();
+    assert_bit_radix_tree_tables();
+    assert_bit_radix_tree_merge();
     assert_radix_tree();
     assert_radix_tree_remove();
+    assert_radix_tree_fanout();
+    assert_radix_tree_labels();
+    assert_radix_tree_batch();
+    assert_radix_tree_cursor();
+    assert_radix_tree_arena();
+    assert_radix_tree_borrow();
+    assert_string_map();
+    assert_radix_tree_stats();
+    assert_radix_tree_snapshot();
+    assert_radix_tree_prefix_walk();
+    assert_radix_tree_bulk_load();
+    assert_radix_tree_parallel_load();
+    assert_radix_tree_write_batch();
+    assert_radix_tree_write_batch_long();
+    assert_radix_tree_lazy_remove();
+    assert_radix_tree_image();
+    assert_radix_log();
+    assert_radix_tree_freeze();
+    assert_radix_lpm();
+    assert_radix_tree_template();
+    assert_concurrent_radix_tree();
+    assert_concurrent_radix_tree_olc();
     return 0;
 }
 